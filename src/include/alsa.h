@@ -39,6 +39,37 @@ extern "C" {
 int
 hrmp_alsa_init_handle(struct file_metadata* fm, snd_pcm_t** handle);
 
+/**
+ * Size the buffer and period of a hardware configuration from the
+ * latency of a device
+ * @param handle The handle
+ * @param hw_params The hardware parameters
+ * @param device The device
+ * @param rate The rate in Hz
+ * @return 0 upon success, 1 is failure
+ */
+int
+hrmp_alsa_set_latency(snd_pcm_t* handle, snd_pcm_hw_params_t* hw_params, struct device* device, unsigned int rate);
+
+/**
+ * Check if an open ALSA handle can play a file without a new
+ * hardware configuration, and make it ready for more frames.
+ * Frames already queued on the handle keep playing
+ * @param fm The file metadata
+ * @param handle The handle
+ * @return 0 if the handle can be reused, 1 if it must be reopened
+ */
+int
+hrmp_alsa_reuse_handle(struct file_metadata* fm, snd_pcm_t* handle);
+
+/**
+ * Is the ALSA handle set up for memory mapped access
+ * @param handle The handle
+ * @return True if memory mapped, otherwise false
+ */
+bool
+hrmp_alsa_is_mmap(snd_pcm_t* handle);
+
 /**
  * Reset the ALSA handle
  * @param handle The handle
@@ -48,7 +79,7 @@ int
 hrmp_alsa_reset_handle(snd_pcm_t* handle);
 
 /**
- * Close the ALSA handle
+ * Close the ALSA handle once the queued frames have played
  * @param handle The resulting handle
  * @return 0 upon success, 1 is failure
  */
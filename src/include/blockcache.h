@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_BLOCKCACHE_H
+#define HRMP_BLOCKCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define HRMP_BLOCKCACHE_BLOCK_BYTES (1024u * 1024u)
+#define HRMP_BLOCKCACHE_BUCKETS     4096
+
+/** @struct blockcache_file
+ * Identifies a file in the block cache. The modification time and the
+ * size are part of the key, so a file that changed is read again
+ */
+struct blockcache_file
+{
+   uint64_t dev;  /**< The device */
+   uint64_t ino;  /**< The inode */
+   int64_t mtime; /**< The modification time in nanoseconds */
+   uint64_t size; /**< The file size */
+};
+
+/**
+ * Create the process wide block cache. The budget is shared with the
+ * ringbuffers, so the cache only holds what they leave of it
+ * @param budget The number of bytes the cache and the ringbuffers may hold, 0 to disable it
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_blockcache_create(size_t budget);
+
+/**
+ * Destroy the block cache and free all blocks
+ */
+void
+hrmp_blockcache_destroy(void);
+
+/**
+ * Identify an open file
+ * @param fd The file descriptor
+ * @param file The identity
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_blockcache_file(int fd, struct blockcache_file* file);
+
+/**
+ * Copy bytes from the cached block that holds an offset. The file is not
+ * read on a miss
+ * @param file The identity of the file
+ * @param buf The destination
+ * @param n The number of bytes wanted
+ * @param offset The file offset
+ * @return The number of bytes copied, which stops at the end of the block,
+ *         or 0 if the block is not cached
+ */
+size_t
+hrmp_blockcache_lookup(struct blockcache_file* file, void* buf, size_t n, uint64_t offset);
+
+/**
+ * Offer bytes that were read from a file. Only a whole block, or the last
+ * block of the file, is kept, evicting the least recently used blocks when
+ * the budget is exceeded
+ * @param file The identity of the file
+ * @param offset The file offset of the bytes
+ * @param data The bytes
+ * @param n The number of bytes
+ */
+void
+hrmp_blockcache_insert(struct blockcache_file* file, uint64_t offset, void* data, size_t n);
+
+/**
+ * Get the number of block lookups served from memory and from the file
+ * @param hits The number of hits
+ * @param misses The number of misses
+ */
+void
+hrmp_blockcache_counters(uint64_t* hits, uint64_t* misses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
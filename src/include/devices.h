@@ -49,6 +49,17 @@ hrmp_is_device_known(char* name);
 int
 hrmp_init_device(struct device* device);
 
+/**
+ * Set the latency of a device from a profile name (low, balanced or robust)
+ * or from a buffer time in microseconds with an optional period time,
+ * e.g. 100000 or 100000/25000
+ * @param device The device
+ * @param value The latency setting
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_device_set_latency(struct device* device, char* value);
+
 /**
  * Create an active device
  * @param device_name The device name
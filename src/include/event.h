@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_EVENT_H
+#define HRMP_EVENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <poll.h>
+#include <stdbool.h>
+#include <alsa/asoundlib.h>
+
+#define HRMP_EVENT_MAX_FDS 16
+
+#define HRMP_EVENT_FD_STDIN   0
+#define HRMP_EVENT_FD_CONTROL 1
+#define HRMP_EVENT_FD_PCM     2
+
+#define HRMP_EVENT_NONE    0
+#define HRMP_EVENT_DEVICE  1
+#define HRMP_EVENT_INPUT   2
+#define HRMP_EVENT_CONTROL 4
+
+/** @struct event
+ * Waits on the PCM device, the keyboard and an optional control
+ * descriptor with a single poll()
+ */
+struct event
+{
+   snd_pcm_t* pcm;                        /**< The PCM handle */
+   struct pollfd fds[HRMP_EVENT_MAX_FDS]; /**< Stdin, control and the PCM descriptors */
+   unsigned int pcm_count;                /**< The number of PCM descriptors */
+   bool input;                            /**< Is keyboard input pending */
+};
+
+/**
+ * Create an event loop for a PCM handle
+ * @param pcm The PCM handle, or NULL for input only
+ * @param out The event loop
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_event_create(snd_pcm_t* pcm, struct event** out);
+
+/**
+ * Destroy an event loop
+ * @param ev The event loop
+ */
+void
+hrmp_event_destroy(struct event* ev);
+
+/**
+ * Set the control descriptor
+ * @param ev The event loop
+ * @param fd The descriptor, or -1 for none
+ */
+void
+hrmp_event_set_control(struct event* ev, int fd);
+
+/**
+ * Stop polling stdin, for example once it has reached end of file
+ * @param ev The event loop
+ */
+void
+hrmp_event_close_input(struct event* ev);
+
+/**
+ * Wait until the device can take more frames or input arrives
+ * @param ev The event loop
+ * @param device Also wait for the device
+ * @param timeout The timeout in milliseconds, -1 for none
+ * @return The HRMP_EVENT_* flags that are ready
+ */
+int
+hrmp_event_wait(struct event* ev, bool device, int timeout);
+
+/**
+ * Check and clear pending keyboard input seen by hrmp_event_wait()
+ * @param ev The event loop
+ * @return True if there is input to read
+ */
+bool
+hrmp_event_input(struct event* ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -47,6 +47,21 @@ extern "C" {
 #define HRMP_CACHE_FILES_MINIMAL     1
 #define HRMP_CACHE_FILES_ALL         2
 
+#define HRMP_READER_AUTO             0
+#define HRMP_READER_PREAD            1
+#define HRMP_READER_IO_URING         2
+#define HRMP_READER_MMAP             3
+
+#define HRMP_HUGEPAGES_OFF           0
+#define HRMP_HUGEPAGES_AUTO          1
+#define HRMP_HUGEPAGES_TRANSPARENT   2
+#define HRMP_HUGEPAGES_EXPLICIT      3
+
+#define HRMP_LATENCY_LOW             0
+#define HRMP_LATENCY_BALANCED        1
+#define HRMP_LATENCY_ROBUST          2
+#define HRMP_LATENCY_CUSTOM          3
+
 #define DEFAULT_BUFFER_SIZE          131072
 #define ALIGNMENT_SIZE               512
 
@@ -176,6 +191,13 @@ struct device
    bool has_volume;                  /**< Has volume control */
    int volume;                       /**< The current volume */
    bool is_paused;                   /**< Is the active device paused ? */
+   int latency;                      /**< The latency profile */
+   unsigned int buffer_time;         /**< The requested buffer time in microseconds */
+   unsigned int period_time;         /**< The requested period time in microseconds */
+   unsigned int rate;                /**< The rate of the negotiated sizes */
+   unsigned long buffer_size;        /**< The negotiated buffer size in frames */
+   unsigned long period_size;        /**< The negotiated period size in frames */
+   bool busy;                        /**< Was the device in use when the sizes were negotiated */
 };
 
 /** @struct configuration
@@ -196,8 +218,22 @@ struct configuration
    int prev_volume; /**< The previous volume */
    bool is_muted;   /**< Is muted */
 
-   size_t cache_size; /**< The cache size */
-   int cache_files;   /**< The cache files policy */
+   size_t cache_size;      /**< The cache size */
+   int cache_files;        /**< The cache files policy */
+   bool cache_mirror;      /**< Map the cache ringbuffer twice back to back */
+   int cache_hugepages;    /**< The HRMP_HUGEPAGES_* pages backing the cache ringbuffer */
+   size_t cache_prebuffer; /**< The number of bytes to read ahead of the next file */
+   bool cache_blocks;      /**< Keep file blocks in a cache shared by all files */
+   bool cache_metadata;    /**< Keep file metadata in a cache on disk */
+   int reader;             /**< The HRMP_READER_* file reader backend */
+
+   int decode_queue; /**< The number of decoded periods to queue ahead of the device */
+   bool mmap;        /**< Write to the device through memory mapped access */
+
+   bool realtime;         /**< Lock memory and write to the device with SCHED_FIFO */
+   int realtime_priority; /**< The SCHED_FIFO priority */
+
+   char stats_path[MISC_LENGTH]; /**< The file that playback statistics are appended to */
 
    bool metadata; /**< Display metadata about files */
 
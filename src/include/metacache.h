@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_METACACHE_H
+#define HRMP_METACACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <files.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HRMP_METACACHE_FILE    "/.hrmp/metadata.cache"
+#define HRMP_METACACHE_BUCKETS 16384
+#define HRMP_METACACHE_MAX_AGE 64
+
+/**
+ * Load the metadata cache from the home directory. A missing or unreadable
+ * cache starts out empty
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_metacache_open(void);
+
+/**
+ * Write the metadata cache back if it changed and free it. Entries that
+ * were not used since the cache was last written HRMP_METACACHE_MAX_AGE
+ * times are dropped
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_metacache_close(void);
+
+/**
+ * Look up the metadata of a file. The entry is checked against the inode,
+ * the size and the modification time of the file with a single stat(),
+ * and a stale entry is dropped
+ * @param path The path of the file
+ * @param fm The file metadata
+ * @return 0 upon a hit, otherwise 1
+ */
+int
+hrmp_metacache_lookup(char* path, struct file_metadata** fm);
+
+/**
+ * Add or replace the metadata of a file
+ * @param path The path of the file
+ * @param fm The file metadata
+ */
+void
+hrmp_metacache_insert(char* path, struct file_metadata* fm);
+
+/**
+ * Get the number of lookups served from the cache and from the file
+ * @param hits The number of hits
+ * @param misses The number of misses
+ */
+void
+hrmp_metacache_counters(uint64_t* hits, uint64_t* misses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,7 +19,7 @@
 #define HRMP_MKV_H
 
 #include <hrmp.h>
-#include <ringbuffer.h>
+#include <prefetch.h>
 
 #include <stdint.h>
 #include <stddef.h>
@@ -92,8 +92,17 @@ hrmp_mkv_open(FILE* fp, MkvDemuxer** out);
 int
 hrmp_mkv_open_path(const char* path, MkvDemuxer** out);
 
+/**
+ * Open a MKV file reading through a prefetch reader
+ * @param path The file
+ * @param pf The prefetch reader, or NULL to read the file directly
+ * @param file_size The file size
+ * @param bytes_left The number of bytes left in the file
+ * @param out The demuxer
+ * @return The result
+ */
 int
-hrmp_mkv_open_path_rb(const char* path, struct ringbuffer* rb, uint64_t file_size, uint64_t* bytes_left, MkvDemuxer** out);
+hrmp_mkv_open_path_prefetch(const char* path, struct prefetch* pf, uint64_t file_size, uint64_t* bytes_left, MkvDemuxer** out);
 
 /**
  * Close a MKV file
@@ -111,6 +120,17 @@ hrmp_mkv_close(MkvDemuxer* m);
 int
 hrmp_mkv_get_audio_info(MkvDemuxer* m, MkvAudioInfo* out_info);
 
+/**
+ * Get the duration of the audio track without decoding it.
+ * Uses Segment Info/Duration, then the last Cues entry, and
+ * finally a skim of the cluster and block headers
+ * @param m The demuxer
+ * @param duration_ns The duration in nanoseconds
+ * @return The result
+ */
+int
+hrmp_mkv_get_duration(MkvDemuxer* m, uint64_t* duration_ns);
+
 /**
  * Read a packet
  * @param m The demuxer
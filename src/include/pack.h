@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_PACK_H
+#define HRMP_PACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 32bit samples from sf_readf_int() to S16_LE, S24_3LE or S32_LE */
+#define HRMP_PACK_S16    0
+#define HRMP_PACK_S24_3  1
+#define HRMP_PACK_S32    2
+/* Native S16_LE or S24_3LE samples kept at their width */
+#define HRMP_PACK_S16_LE 3
+#define HRMP_PACK_S24_LE 4
+
+#define HRMP_PACK_OPS    5
+
+/**
+ * Pack interleaved samples into stereo device frames. Stereo input is
+ * converted as is, any other channel count is averaged into both
+ * channels
+ * @param in The input samples
+ * @param channels The number of input channels
+ * @param frames The number of frames
+ * @param out The output frames
+ */
+typedef void (*hrmp_pack_kernel)(const void* in, unsigned int channels, size_t frames, uint8_t* out);
+
+/* Planar DSD channel blocks to DoP S32_LE or DSD_U32_BE */
+#define HRMP_PACK_DSD_DOP        0
+#define HRMP_PACK_DSD_U32_BE     1
+#define HRMP_PACK_DSD_U32_BE_REV 2
+
+#define HRMP_PACK_DSD_OPS        3
+
+#define HRMP_PACK_DOP_MARKER_MSB 0xFA
+#define HRMP_PACK_DOP_MARKER_LSB 0x05
+
+/**
+ * Interleave two planar DSD channels into stereo device frames. DoP
+ * takes 2 bytes and DSD_U32_BE 4 bytes per channel and frame. DoP and
+ * HRMP_PACK_DSD_U32_BE_REV reverse the bits of each byte, since DSF
+ * stores the oldest sample in the least significant bit
+ * @param left The bytes of the left channel
+ * @param right The bytes of the right channel
+ * @param frames The number of frames
+ * @param out The output frames
+ * @param marker The DoP marker of the first frame, updated for the next call
+ */
+typedef void (*hrmp_pack_dsd_kernel)(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out,
+                                     uint8_t* marker);
+
+/**
+ * Select the fastest kernel for an operation. The variants available on
+ * the CPU are checked once against the scalar kernel and any variant
+ * that is not bit-exact is not used
+ * @param op The HRMP_PACK_* operation
+ * @param channels The number of input channels
+ * @return The kernel
+ */
+hrmp_pack_kernel
+hrmp_pack_select(int op, unsigned int channels);
+
+/**
+ * Get the name of the instruction set selected for an operation
+ * @param op The HRMP_PACK_* operation
+ * @param channels The number of input channels
+ * @return The name
+ */
+char*
+hrmp_pack_name(int op, unsigned int channels);
+
+/**
+ * Select the fastest DSD kernel for an operation, checked like
+ * hrmp_pack_select()
+ * @param op The HRMP_PACK_DSD_* operation
+ * @return The kernel
+ */
+hrmp_pack_dsd_kernel
+hrmp_pack_dsd_select(int op);
+
+/**
+ * Get the name of the instruction set selected for a DSD operation
+ * @param op The HRMP_PACK_DSD_* operation
+ * @return The name
+ */
+char*
+hrmp_pack_dsd_name(int op);
+
+/**
+ * Get the number of instruction sets compiled in, the scalar kernels
+ * being the first
+ * @return The number of instruction sets
+ */
+int
+hrmp_pack_sets(void);
+
+/**
+ * Get the kernel of an instruction set for an operation, whether or not
+ * it would be selected, for tests and benchmarks
+ * @param set The instruction set, from 0 to hrmp_pack_sets() - 1
+ * @param op The HRMP_PACK_* operation
+ * @param channels The number of input channels
+ * @param name The name of the instruction set
+ * @return The kernel, or NULL if the set has none or the CPU lacks it
+ */
+hrmp_pack_kernel
+hrmp_pack_get(int set, int op, unsigned int channels, char** name);
+
+/**
+ * Get the DSD kernel of an instruction set for an operation, as
+ * hrmp_pack_get()
+ * @param set The instruction set, from 0 to hrmp_pack_sets() - 1
+ * @param op The HRMP_PACK_DSD_* operation
+ * @param name The name of the instruction set
+ * @return The kernel, or NULL if the set has none or the CPU lacks it
+ */
+hrmp_pack_dsd_kernel
+hrmp_pack_dsd_get(int set, int op, char** name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
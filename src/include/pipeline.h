@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_PIPELINE_H
+#define HRMP_PIPELINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HRMP_DEFAULT_DECODE_QUEUE 16
+
+/**
+ * Decode up to frames frames of device format PCM into buf
+ * @param user The user data
+ * @param buf The destination
+ * @param frames The maximum number of frames
+ * @return The number of frames produced, 0 at the end of the stream
+ */
+typedef size_t (*hrmp_pipeline_decode)(void* user, void* buf, size_t frames);
+
+/** @struct pipeline
+ * Decode-ahead stage between a decoder and the device. A decoder thread
+ * fills a bounded queue of device format periods and the playback thread
+ * takes them in order and only writes them to the device.
+ */
+struct pipeline
+{
+   pthread_t thread;              /**< The decoder thread */
+   pthread_mutex_t lock;          /**< Protects the queue state */
+   pthread_cond_t cond;           /**< Signalled on new periods, free slots and requests */
+   hrmp_pipeline_decode decode;   /**< The decode callback */
+   void* user;                    /**< The decode callback user data */
+   uint8_t* data;                 /**< The period storage */
+   size_t* frames;                /**< The number of frames in each period */
+   size_t depth;                  /**< The number of periods */
+   size_t period_frames;          /**< The number of frames in a period */
+   size_t period_bytes;           /**< The number of bytes in a period */
+   size_t head;                   /**< The next period to consume */
+   size_t count;                  /**< The number of decoded periods */
+   bool busy;                     /**< Is the decoder running outside the lock */
+   bool suspended;                /**< Is the decoder held back */
+   bool eof;                      /**< Has the decoder reached the end */
+   bool stop;                     /**< Should the decoder thread stop */
+};
+
+/**
+ * Create a pipeline and start its decoder thread
+ * @param depth The number of periods in the queue
+ * @param period_frames The number of frames in a period
+ * @param bytes_per_frame The number of bytes in a device frame
+ * @param decode The decode callback, run on the decoder thread
+ * @param user The decode callback user data
+ * @param out The pipeline
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_pipeline_create(size_t depth, size_t period_frames, size_t bytes_per_frame,
+                     hrmp_pipeline_decode decode, void* user, struct pipeline** out);
+
+/**
+ * Stop the decoder thread and destroy a pipeline
+ * @param pl The pipeline
+ */
+void
+hrmp_pipeline_destroy(struct pipeline* pl);
+
+/**
+ * Wait for the next decoded period. The period stays valid until
+ * released with hrmp_pipeline_release()
+ * @param pl The pipeline
+ * @param buf The period data
+ * @return The number of frames in the period, 0 at the end of the stream
+ */
+size_t
+hrmp_pipeline_get(struct pipeline* pl, void** buf);
+
+/**
+ * Release the period obtained from hrmp_pipeline_get()
+ * @param pl The pipeline
+ */
+void
+hrmp_pipeline_release(struct pipeline* pl);
+
+/**
+ * Hold the decoder back and wait until it is idle, so the decoder
+ * state can be changed from the playback thread, e.g. for a seek
+ * @param pl The pipeline
+ */
+void
+hrmp_pipeline_suspend(struct pipeline* pl);
+
+/**
+ * Drop all decoded periods and let a suspended decoder continue
+ * @param pl The pipeline
+ */
+void
+hrmp_pipeline_resume(struct pipeline* pl);
+
+/**
+ * Get the number of decoded periods waiting in the queue
+ * @param pl The pipeline
+ * @return The number of periods
+ */
+size_t
+hrmp_pipeline_queued(struct pipeline* pl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,8 +23,13 @@ extern "C" {
 #endif
 
 #include <hrmp.h>
+#include <event.h>
 #include <files.h>
+#include <pipeline.h>
+#include <prefetch.h>
 #include <ringbuffer.h>
+#include <stats.h>
+#include <wav.h>
 
 #include <sndfile.h>
 #include <stdio.h>
@@ -40,11 +45,19 @@ struct playback
    int file_number;               /**< The file number */
    int total_number;              /**< The total number */
    char identifier[MISC_LENGTH];  /**< The file identifier */
-   unsigned long current_samples; /**< The total number of samples */
+   unsigned long current_samples; /**< The number of samples handed to the device */
+   uint64_t progress_ns;          /**< When the progress was last printed */
    snd_pcm_t* pcm_handle;         /**< The PCM handle */
+   bool mmap;                     /**< Is the PCM handle memory mapped */
+   snd_pcm_uframes_t mmap_offset; /**< Offset of the area handed out for conversion */
    struct file_metadata* fm;      /**< The file metadata */
    struct ringbuffer* rb;         /**< Optional ringbuffer for file-backed reads */
+   struct prefetch* pf;           /**< Optional background reader filling the ringbuffer */
+   struct pipeline* pl;           /**< Optional decode-ahead stage feeding the device */
+   struct event* ev;              /**< Waits on the device and the keyboard */
+   struct wav* wav;               /**< The WAVE layout when the data is played as is */
    uint64_t bytes_left;           /**< Bytes left in current file segment (if known) */
+   struct stats stats;            /**< The output and input telemetry */
 };
 
 /**
@@ -67,13 +80,32 @@ int
 hrmp_playback_prepare_ringbuffer(struct playback* pb);
 
 /**
- * Play back a file
+ * Start reading the beginning of a file into its ringbuffer in the
+ * background, so that the file starts from memory when it is played
  * @param pb The playback
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_playback_prebuffer(struct playback* pb);
+
+/**
+ * Stop the background reader of a playback, if any
+ * @param pb The playback
+ */
+void
+hrmp_playback_stop_prebuffer(struct playback* pb);
+
+/**
+ * Play back a file. An open handle with the same format is reused and
+ * is left open afterwards with the end of the file still queued, so the
+ * next file continues without a gap. The caller closes it when done
+ * @param pb The playback
+ * @param handle The PCM handle, or NULL to open a new one
  * @param next Are going forward or backward
  * @return 0 upon success, otherwise 1
  */
 int
-hrmp_playback(struct playback* pb, bool* next);
+hrmp_playback(struct playback* pb, snd_pcm_t** handle, bool* next);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_PREFETCH_H
+#define HRMP_PREFETCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <blockcache.h>
+#include <reader.h>
+#include <ringbuffer.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HRMP_PREFETCH_CHUNK_BYTES (1024u * 1024u)
+
+/* The share of the ringbuffer that keeps already played data */
+#define HRMP_PREFETCH_HISTORY_DIVISOR 4
+
+/* With the mmap reader, how far ahead of the play position pages are
+ * requested and how far behind it they stay mapped in */
+#define HRMP_PREFETCH_WINDOW_BYTES (8u * 1024u * 1024u)
+#define HRMP_PREFETCH_MAPPINGS     64
+
+/** @struct prefetch
+ * Background reader that keeps a ringbuffer topped up from a file segment.
+ * The reader thread is the only producer and the playback thread the only
+ * consumer of the ringbuffer, which runs in SPSC mode so that data moves
+ * without a lock. The lock and condition only park a side that has nothing
+ * to do, and carry seek and stop requests.
+ *
+ * The reader thread queues reads of up to one block straight into the
+ * writable span of the ringbuffer and publishes them in order as they
+ * complete, so with io_uring several reads are in flight at once.
+ *
+ * The ringbuffer keeps a history of consumed bytes, so a seek that lands
+ * anywhere between the start of the history and the end of the buffered
+ * data is served by moving the read position alone.
+ */
+struct prefetch
+{
+   pthread_t thread;              /**< The reader thread */
+   pthread_mutex_t lock;          /**< Protects the request state */
+   pthread_cond_t cond;           /**< Signalled on new data, new space and requests */
+   int fd;                        /**< The file descriptor */
+   struct blockcache_file file;   /**< The identity of the file in the block cache */
+   struct reader* reader;         /**< The file reader, reader side */
+   size_t queued;                 /**< Bytes queued with the file reader past read_pos, reader side */
+   struct ringbuffer* rb;         /**< The ringbuffer */
+   uint64_t pos;                  /**< File offset of the next byte to consume, consumer side */
+   uint64_t read_pos;             /**< File offset of the next byte to read, reader side */
+   uint64_t end;                  /**< File offset where the segment ends */
+   atomic_size_t target;          /**< Number of bytes to keep buffered */
+   uint64_t seek_offset;          /**< Requested seek offset */
+   bool seek_pending;             /**< Is a seek pending */
+   atomic_bool eof;               /**< Has the end of the segment been read */
+   atomic_bool error;             /**< Did a read fail */
+   bool stop;                     /**< Should the reader thread stop */
+   atomic_bool consumer_waiting;  /**< Is the consumer parked on the condition */
+   atomic_bool producer_waiting;  /**< Is the reader parked on the condition */
+   atomic_size_t wake_level;      /**< Fill level at or below which the parked reader wants waking */
+   uint8_t* map;                  /**< The file mapping with the mmap reader, otherwise NULL */
+   size_t map_size;               /**< The size of the mapping */
+   uint64_t advised;              /**< End of the range requested with MADV_WILLNEED, consumer side */
+   uint64_t released;             /**< End of the range released with MADV_DONTNEED, consumer side */
+   atomic_bool truncated;         /**< Did the file shrink under the mapping */
+};
+
+/**
+ * Create a prefetch reader and start its thread
+ * @param path The file path
+ * @param rb The ringbuffer to fill
+ * @param offset The start offset of the segment
+ * @param end The end offset of the segment
+ * @param target The number of bytes to keep buffered, 0 for the ringbuffer maximum
+ * @param out The prefetch reader
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_prefetch_create(char* path, struct ringbuffer* rb, uint64_t offset, uint64_t end, size_t target,
+                     struct prefetch** out);
+
+/**
+ * Stop the reader thread and destroy a prefetch reader
+ * @param pf The prefetch reader
+ */
+void
+hrmp_prefetch_destroy(struct prefetch* pf);
+
+/**
+ * Read buffered bytes, waiting for the reader thread if needed
+ * @param pf The prefetch reader
+ * @param buf The destination
+ * @param n The number of bytes
+ * @return The number of bytes read, less than n at the end of the segment
+ */
+size_t
+hrmp_prefetch_read(struct prefetch* pf, void* buf, size_t n);
+
+/**
+ * Wait until n bytes are buffered and get them in place, without a copy.
+ * The bytes stay valid until released with hrmp_prefetch_consume()
+ * @param pf The prefetch reader
+ * @param n The number of bytes wanted
+ * @param ptr The start of the buffered bytes
+ * @return The number of contiguous bytes at ptr, which is less than n at the
+ *         end of the segment or where an unmirrored ringbuffer wraps
+ */
+size_t
+hrmp_prefetch_peek(struct prefetch* pf, size_t n, void** ptr);
+
+/**
+ * Release bytes obtained from hrmp_prefetch_peek()
+ * @param pf The prefetch reader
+ * @param n The number of bytes
+ */
+void
+hrmp_prefetch_consume(struct prefetch* pf, size_t n);
+
+/**
+ * Move the read position of a prefetch reader. Within the buffered window
+ * and its history this does not involve the reader thread
+ * @param pf The prefetch reader
+ * @param offset The new file offset
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_prefetch_seek(struct prefetch* pf, uint64_t offset);
+
+/**
+ * Change the number of bytes the reader keeps buffered
+ * @param pf The prefetch reader
+ * @param target The number of bytes, 0 for the ringbuffer maximum
+ */
+void
+hrmp_prefetch_set_target(struct prefetch* pf, size_t target);
+
+/**
+ * Get the file offset of the next byte to consume
+ * @param pf The prefetch reader
+ * @return The offset
+ */
+uint64_t
+hrmp_prefetch_tell(struct prefetch* pf);
+
+/**
+ * Get the number of bytes currently buffered
+ * @param pf The prefetch reader
+ * @return The fill level in bytes
+ */
+size_t
+hrmp_prefetch_buffered(struct prefetch* pf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_READER_H
+#define HRMP_READER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define HRMP_READER_DEPTH 4
+
+/** @struct reader_slot
+ * One read request
+ */
+struct reader_slot
+{
+   struct iovec iov; /**< The destination */
+   uint64_t offset;  /**< The file offset */
+   ssize_t result;   /**< The number of bytes read, or -errno */
+   bool done;        /**< Has the read completed */
+};
+
+/** @struct reader
+ * Reads a file through a queue of requests that complete in the order
+ * they were submitted. The io_uring backend keeps the queued reads in
+ * flight in the kernel, the pread backend performs each one when it is
+ * waited for. A ring that fails is torn down and the reader continues
+ * with pread
+ */
+struct reader
+{
+   int type;                                     /**< The HRMP_READER_* backend in use */
+   int fd;                                       /**< The file descriptor */
+   unsigned int depth;                           /**< The number of reads that may be queued */
+   struct reader_slot slots[HRMP_READER_DEPTH];  /**< The queued reads */
+   unsigned int head;                            /**< The oldest queued read */
+   unsigned int count;                           /**< The number of queued reads */
+   unsigned int unsubmitted;                     /**< Reads queued in the ring but not yet entered */
+   int ring_fd;                                  /**< The io_uring descriptor */
+   void* sq_ring;                                /**< The submission ring mapping */
+   size_t sq_ring_size;                          /**< The size of the submission ring mapping */
+   void* cq_ring;                                /**< The completion ring mapping */
+   size_t cq_ring_size;                          /**< The size of the completion ring mapping */
+   void* sqes;                                   /**< The submission entries */
+   size_t sqes_size;                             /**< The size of the submission entries */
+   unsigned int* sq_tail;                        /**< The submission ring tail */
+   unsigned int* sq_mask;                        /**< The submission ring mask */
+   unsigned int* sq_array;                       /**< The submission ring index array */
+   unsigned int* cq_head;                        /**< The completion ring head */
+   unsigned int* cq_tail;                        /**< The completion ring tail */
+   unsigned int* cq_mask;                        /**< The completion ring mask */
+   void* cqes;                                   /**< The completion entries */
+};
+
+/**
+ * Create a reader. HRMP_READER_AUTO and HRMP_READER_IO_URING fall back to
+ * pread when the kernel does not provide io_uring
+ * @param fd The file descriptor
+ * @param type The requested HRMP_READER_* backend
+ * @param out The reader
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_reader_create(int fd, int type, struct reader** out);
+
+/**
+ * Wait for all queued reads and destroy a reader
+ * @param r The reader
+ */
+void
+hrmp_reader_destroy(struct reader* r);
+
+/**
+ * Get the name of a reader backend
+ * @param type The HRMP_READER_* backend
+ * @return The name
+ */
+char*
+hrmp_reader_name(int type);
+
+/**
+ * Queue a read
+ * @param r The reader
+ * @param buf The destination, which must stay valid until the read is waited for
+ * @param n The number of bytes
+ * @param offset The file offset
+ * @return 0 upon success, otherwise 1 if the queue is full
+ */
+int
+hrmp_reader_submit(struct reader* r, void* buf, size_t n, uint64_t offset);
+
+/**
+ * Get the number of queued reads
+ * @param r The reader
+ * @return The number of reads
+ */
+unsigned int
+hrmp_reader_pending(struct reader* r);
+
+/**
+ * Wait for the oldest queued read and remove it from the queue
+ * @param r The reader
+ * @param buf The destination of the read
+ * @param n The number of bytes that were asked for
+ * @return The number of bytes read, otherwise -1 with errno set
+ */
+ssize_t
+hrmp_reader_wait(struct reader* r, void** buf, size_t* n);
+
+/**
+ * Wait for all queued reads and drop their results
+ * @param r The reader
+ */
+void
+hrmp_reader_drain(struct reader* r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
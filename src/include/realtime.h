@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_REALTIME_H
+#define HRMP_REALTIME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HRMP_DEFAULT_REALTIME_PRIORITY 50
+
+/**
+ * Lock the memory of the process and run the calling thread with
+ * SCHED_FIFO. Each step that lacks the capability is skipped with a
+ * warning
+ * @param priority The SCHED_FIFO priority
+ * @return 0 if both steps succeeded, otherwise 1
+ */
+int
+hrmp_realtime_enable(int priority);
+
+/**
+ * Initialize the attributes of a helper thread. Threads inherit the
+ * scheduling of their creator, so a reader or decoder started from a
+ * SCHED_FIFO thread would run with SCHED_FIFO as well; a helper thread
+ * runs with SCHED_OTHER instead. The attributes are usable even when the
+ * policy can not be set, the thread then inherits it
+ * @param attr The attributes, destroyed by the caller
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_realtime_helper_attr(pthread_attr_t* attr);
+
+/**
+ * Is the memory of the process locked
+ * @return True if locked, otherwise false
+ */
+bool
+hrmp_realtime_is_locked(void);
+
+/**
+ * Fault in the pages of a buffer ahead of use without changing its
+ * content, so it is safe on memory another thread is writing
+ * @param buf The buffer
+ * @param size The size of the buffer
+ */
+void
+hrmp_realtime_prefault(void* buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
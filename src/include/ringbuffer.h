@@ -18,6 +18,9 @@
 #ifndef HRMP_RINGBUFFER_H
 #define HRMP_RINGBUFFER_H
 
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -25,33 +28,92 @@
 extern "C" {
 #endif
 
-#define HRMP_RINGBUFFER_MIN_BYTES (4u * 1024u * 1024u)
-#define HRMP_RINGBUFFER_MAX_BYTES (256u * 1024u * 1024u)
+#define HRMP_RINGBUFFER_MIN_BYTES   (4u * 1024u * 1024u)
+#define HRMP_RINGBUFFER_MAX_BYTES   (256u * 1024u * 1024u)
+#define HRMP_RINGBUFFER_CHUNK_BYTES (2u * 1024u * 1024u)
+
+#define HRMP_DEFAULT_CACHE_PREBUFFER (16u * 1024u * 1024u)
+
+#define HRMP_RINGBUFFER_FLAG_NONE      0
+#define HRMP_RINGBUFFER_FLAG_MIRROR    1
+#define HRMP_RINGBUFFER_FLAG_HUGEPAGES 2
+#define HRMP_RINGBUFFER_FLAG_HUGETLB   4
+#define HRMP_RINGBUFFER_FLAG_PREFAULT  8
+
+#define HRMP_RINGBUFFER_BACKING_PAGES       0
+#define HRMP_RINGBUFFER_BACKING_TRANSPARENT 1
+#define HRMP_RINGBUFFER_BACKING_EXPLICIT    2
 
 /** @struct ringbuffer
  * Ringbuffer storage.
+ *
+ * The read and write positions are free running counters, so the size is
+ * always w - r. In single-producer/single-consumer mode one thread may
+ * produce while another consumes without a lock: the producer owns w, the
+ * storage and cap, the consumer owns r, and each publishes its counter with
+ * release semantics. The capacity can then only change while the ringbuffer is
+ * empty, see hrmp_ringbuffer_ensure_write().
+ *
+ * A ringbuffer may keep a history of consumed bytes that the producer does
+ * not overwrite, so the consumer can step back over them with
+ * hrmp_ringbuffer_rewind() instead of having the data read again.
+ *
+ * The address range for the maximum size is reserved up front and the
+ * capacity is always a whole number of HRMP_RINGBUFFER_CHUNK_BYTES chunks,
+ * so the ringbuffer grows and shrinks by making chunks at the end of the
+ * range accessible or releasing them. Only content that wraps is copied
+ * when growing.
+ *
+ * A mirrored ringbuffer keeps its chunks in a memfd that is mapped twice
+ * back to back, so every readable or writable region is a single
+ * contiguous span.
+ *
+ * The chunks can be backed by transparent huge pages or by explicit huge
+ * pages from the pool reserved with vm.nr_hugepages. Explicit huge pages
+ * are taken from the pool as the ringbuffer grows. When the pool runs out
+ * the new chunks use transparent huge pages if requested as well,
+ * otherwise regular pages, and a mirror moves to a regular memfd.
  */
 struct ringbuffer
 {
-   uint8_t *buf; /**< The buffer */
-   size_t cap;   /**< The capacity */
-   size_t min;   /**< The minimum size */
-   size_t max;   /**< The maximum size */
-   size_t r;     /**< The read position */
-   size_t w;     /**< The write position */
-   size_t size;  /**< The size */
+   uint8_t *buf;                     /**< The buffer */
+   int fd;                           /**< The memfd behind a mirrored ringbuffer */
+   size_t cap;                       /**< The capacity */
+   size_t min;                       /**< The minimum size */
+   size_t max;                       /**< The maximum size */
+   int flags;                        /**< The requested HRMP_RINGBUFFER_FLAG_* backing */
+   int backing;                      /**< The HRMP_RINGBUFFER_BACKING_* pages obtained */
+   bool mirrored;                    /**< Is the storage mapped twice back to back */
+   bool spsc;                        /**< Single-producer/single-consumer mode */
+   size_t history;                   /**< Consumed bytes kept for rewinding */
+   size_t r_max;                     /**< The highest read counter, consumer side */
+   alignas(64) atomic_size_t r;      /**< The read counter */
+   alignas(64) atomic_size_t w;      /**< The write counter */
 };
 
 /**
- * Create a ringbuffer
+ * Create a ringbuffer. The sizes are rounded up to whole chunks. A mirrored
+ * backing falls back to a single mapping when the double mapping can not
+ * be set up. Explicit huge pages fall back to transparent huge pages if
+ * requested as well, otherwise to regular pages, when the pool can not back
+ * the initial size. With HRMP_RINGBUFFER_FLAG_PREFAULT every chunk is
+ * faulted in when it is added, so the producer does not take page faults
  * @param min_size The minimum size
  * @param initial_size The initial size
  * @param max_size The maximum size
+ * @param flags The HRMP_RINGBUFFER_FLAG_* backing flags
  * @param out The ringbuffer
  * @return 0 upon success, otherwise 1
  */
 int
-hrmp_ringbuffer_create(size_t min_size, size_t initial_size, size_t max_size, struct ringbuffer **out);
+hrmp_ringbuffer_create(size_t min_size, size_t initial_size, size_t max_size, int flags, struct ringbuffer **out);
+
+/**
+ * The number of bytes held by all ringbuffers of the process
+ * @return The sum of their capacities
+ */
+size_t
+hrmp_ringbuffer_committed(void);
 
 /**
  * Destroy a ringbuffer
@@ -62,21 +124,54 @@ void
 hrmp_ringbuffer_destroy(struct ringbuffer *rb);
 
 /**
- * Reset a ringbuffer
+ * Reset a ringbuffer and shrink it to its minimum size.
+ * Must not race with a producer or a consumer
  * @param rb The ringbuffer
- * @return 0 upon success, otherwise 1
  */
 void
 hrmp_ringbuffer_reset(struct ringbuffer *rb);
 
 /**
- * Get the capacity of a ringbuffer
+ * Drop the content of a ringbuffer but keep its capacity.
+ * Must not race with a producer or a consumer
+ * @param rb The ringbuffer
+ */
+void
+hrmp_ringbuffer_clear(struct ringbuffer *rb);
+
+/**
+ * Enable or disable single-producer/single-consumer mode
+ * @param rb The ringbuffer
+ * @param spsc Enable the mode
+ */
+void
+hrmp_ringbuffer_set_spsc(struct ringbuffer *rb, bool spsc);
+
+/**
+ * Set the number of consumed bytes a ringbuffer keeps for rewinding.
+ * Must not race with a producer or a consumer
+ * @param rb The ringbuffer
+ * @param history The number of bytes
+ */
+void
+hrmp_ringbuffer_set_history(struct ringbuffer *rb, size_t history);
+
+/**
+ * Get the capacity of a ringbuffer. Producer side only in SPSC mode
  * @param rb The ringbuffer
  * @return The capacity
  */
 size_t
 hrmp_ringbuffer_capacity(struct ringbuffer *rb);
 
+/**
+ * Get the name of the pages backing a ringbuffer
+ * @param rb The ringbuffer
+ * @return The name
+ */
+char*
+hrmp_ringbuffer_backing_name(struct ringbuffer *rb);
+
 /**
  * Get the ringbuffer size
  * @param rb The ringbuffer
@@ -85,7 +180,13 @@ hrmp_ringbuffer_capacity(struct ringbuffer *rb);
 size_t hrmp_ringbuffer_size(struct ringbuffer *rb);
 
 /**
- * Ensure the capacity of a ringbuffer
+ * Ensure that n bytes can be written, growing the ringbuffer if needed.
+ * In SPSC mode the ringbuffer only grows while it is empty, as the consumer
+ * may still be reading from the old storage otherwise; the call then fails
+ * and the producer has to wait for the consumer to free up space. With a
+ * history it only grows before anything has been consumed. Outside SPSC
+ * mode content that wraps is made contiguous in the grown ringbuffer by
+ * copying the smaller of its two parts
  * @param rb The ringbuffer
  * @param n The size
  * @return 0 upon success, otherwise 1
@@ -111,12 +212,27 @@ void
 hrmp_ringbuffer_consume(struct ringbuffer *rb, size_t n);
 
 /**
- * Play back a file
- * @param number The file number
- * @param total The total number of files
- * @param fm The file metadata
- * @param next Are going forward or backward
- * @return 0 upon success, otherwise 1
+ * Get the number of consumed bytes that are still held. Consumer side only
+ * @param rb The ringbuffer
+ * @return The number of bytes that can be rewound
+ */
+size_t
+hrmp_ringbuffer_history(struct ringbuffer *rb);
+
+/**
+ * Step back over consumed bytes that are still held. Consumer side only
+ * @param rb The ringbuffer
+ * @param n The size
+ * @return 0 upon success, otherwise 1 if fewer than n bytes are held
+ */
+int
+hrmp_ringbuffer_rewind(struct ringbuffer *rb, size_t n);
+
+/**
+ * Get the contiguous writable span of a ringbuffer
+ * @param rb The ringbuffer
+ * @param ptr The pointer
+ * @return The size of the span
  */
 size_t
 hrmp_ringbuffer_get_write_span(struct ringbuffer *rb, void **ptr);
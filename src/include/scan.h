@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_SCAN_H
+#define HRMP_SCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <files.h>
+#include <list.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HRMP_SCAN_MAX_WORKERS 64
+
+#define HRMP_SCAN_PENDING     0
+#define HRMP_SCAN_DONE        1
+#define HRMP_SCAN_FAILED      2
+
+/** @struct scan_slot
+ * The metadata of one queued file
+ */
+struct scan_slot
+{
+   char* path;               /**< The path, owned by the queue */
+   struct file_metadata* fm; /**< The metadata, until it is taken */
+   int state;                /**< The HRMP_SCAN_* state */
+};
+
+/** @struct scan
+ * Reads the metadata of a queue of files on a pool of worker threads.
+ * Each file is parsed once, and the results are taken in queue order as
+ * soon as they are ready.
+ */
+struct scan
+{
+   pthread_t threads[HRMP_SCAN_MAX_WORKERS]; /**< The worker threads */
+   int workers;                              /**< The number of worker threads */
+   pthread_mutex_t lock;                     /**< Protects the slots */
+   pthread_cond_t cond;                      /**< Signalled when a file is done */
+   struct scan_slot* slots;                  /**< The files in queue order */
+   size_t count;                             /**< The number of files */
+   size_t next;                              /**< The next file to hand to a worker */
+   bool stop;                                /**< Should the workers stop */
+};
+
+/**
+ * Start reading the metadata of a queue of files, with one worker thread
+ * per online core. The queue must outlive the scan
+ * @param files The queue of file paths
+ * @param out The scan
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_scan_create(struct list* files, struct scan** out);
+
+/**
+ * Stop the workers and destroy a scan. Metadata that was not taken is freed
+ * @param scan The scan
+ */
+void
+hrmp_scan_destroy(struct scan* scan);
+
+/**
+ * Get the number of files in a scan
+ * @param scan The scan
+ * @return The number of files
+ */
+size_t
+hrmp_scan_size(struct scan* scan);
+
+/**
+ * Is the metadata of a file ready
+ * @param scan The scan
+ * @param index The index of the file in the queue
+ * @return True if the file is done, otherwise false
+ */
+bool
+hrmp_scan_ready(struct scan* scan, size_t index);
+
+/**
+ * Wait for the metadata of a file and take it
+ * @param scan The scan
+ * @param index The index of the file in the queue
+ * @param fm The file metadata, owned by the caller
+ * @return 0 upon success, otherwise 1 if the file is not supported
+ */
+int
+hrmp_scan_take(struct scan* scan, size_t index, struct file_metadata** fm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
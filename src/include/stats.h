@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_STATS_H
+#define HRMP_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @struct stats
+ * Output and input telemetry of a playback. The output counters are
+ * updated by the thread writing to the device and the input counters by
+ * the thread reading the file, so no field has two writers
+ */
+struct stats
+{
+   uint64_t writes;       /**< The number of writes to the device */
+   uint64_t xruns;        /**< The number of underruns */
+   uint64_t short_writes; /**< The number of writes that took fewer frames than offered */
+   uint64_t recovers;     /**< The number of times the device was recovered */
+   uint64_t max_write_ns; /**< The longest write to the device, not counting the wait for room */
+   uint64_t max_wait_ns;  /**< The longest wait for room on the device */
+   uint64_t reads;        /**< The number of reads from the file */
+   uint64_t read_ns;      /**< The time spent reading from the file */
+   size_t min_fill;       /**< The lowest ringbuffer fill seen before a read */
+   bool has_fill;         /**< Has the ringbuffer fill been sampled */
+   uint64_t cache_hits;   /**< The number of blocks served from the block cache */
+   uint64_t cache_misses; /**< The number of blocks read from the file into the block cache */
+   uint64_t faults;       /**< The number of page faults taken by hrmp */
+};
+
+/**
+ * Reset the statistics
+ * @param stats The statistics
+ */
+void
+hrmp_stats_reset(struct stats* stats);
+
+/**
+ * Get a monotonic timestamp
+ * @return The timestamp in nanoseconds
+ */
+uint64_t
+hrmp_stats_now(void);
+
+/**
+ * Get the number of page faults hrmp has taken so far
+ * @return The number of faults
+ */
+uint64_t
+hrmp_stats_faults(void);
+
+/**
+ * Account a write to the device
+ * @param stats The statistics
+ * @param start The timestamp taken before the write
+ */
+void
+hrmp_stats_write(struct stats* stats, uint64_t start);
+
+/**
+ * Account a wait for room on the device
+ * @param stats The statistics
+ * @param start The timestamp taken before the wait
+ */
+void
+hrmp_stats_wait(struct stats* stats, uint64_t start);
+
+/**
+ * Account a read from the file
+ * @param stats The statistics
+ * @param start The timestamp taken before the read
+ * @param fill The ringbuffer fill before the read
+ * @param buffered Is the read served from a ringbuffer
+ */
+void
+hrmp_stats_read(struct stats* stats, uint64_t start, size_t fill, bool buffered);
+
+/**
+ * Report the statistics in the log, on the console in developer mode,
+ * and as a JSON line appended to the stats_path file if set
+ * @param stats The statistics
+ * @param name The file name
+ */
+void
+hrmp_stats_report(struct stats* stats, char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRMP_WAV_H
+#define HRMP_WAV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <hrmp.h>
+#include <files.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HRMP_WAV_FORMAT_PCM        0x0001
+#define HRMP_WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+/* The fmt chunk and the data chunk header are looked for in this many
+ * bytes from the start of the file */
+#define HRMP_WAV_HEAD_BYTES 16384
+
+/** @struct wav
+ * Defines the layout of a RIFF or RF64 WAVE file
+ */
+struct wav
+{
+   uint16_t format;          /**< The format tag, resolved from the extensible sub format */
+   uint16_t channels;        /**< The number of channels */
+   uint32_t sample_rate;     /**< The sample rate */
+   uint16_t block_align;     /**< The bytes per frame */
+   uint16_t bits_per_sample; /**< The container bits per sample */
+   uint64_t data_offset;     /**< The file offset of the sample data */
+   uint64_t data_size;       /**< The size of the sample data */
+};
+
+/**
+ * Read the head of a WAVE file, parse it with hrmp_wav_parse_header()
+ * and seek to the data chunk
+ * @param f The file
+ * @param file_size The file size
+ * @param wav The layout
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_wav_read_header(FILE* f, uint64_t file_size, struct wav* wav);
+
+/**
+ * Parse the header of a WAVE file from the start of the file. The fmt
+ * chunk and the data chunk header have to be in the buffer
+ * @param buffer The first bytes of the file, up to HRMP_WAV_HEAD_BYTES
+ * @param size The number of bytes in the buffer
+ * @param file_size The file size
+ * @param wav The layout
+ * @return 0 upon success, otherwise 1
+ */
+int
+hrmp_wav_parse_header(uint8_t* buffer, size_t size, uint64_t file_size, struct wav* wav);
+
+/**
+ * Can the data chunk go to the device as is
+ * @param wav The layout
+ * @param fm The file metadata, with the container picked for the device
+ * @return True if the samples already are in the device format
+ */
+bool
+hrmp_wav_is_native(struct wav* wav, struct file_metadata* fm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
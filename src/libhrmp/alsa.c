@@ -23,6 +23,7 @@
 #include <utils.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <alsa/pcm.h>
 
@@ -30,6 +31,7 @@ static int
 find_best_format(struct file_metadata* fm, snd_pcm_format_t* format);
 
 #define MAX_BUFFER_SIZE 131072
+#define MIN_PERIOD_SIZE 64
 
 int
 hrmp_alsa_init_handle(struct file_metadata* fm, snd_pcm_t** handle)
@@ -37,10 +39,11 @@ hrmp_alsa_init_handle(struct file_metadata* fm, snd_pcm_t** handle)
    int err;
    snd_pcm_t* h = NULL;
    snd_pcm_hw_params_t* hw_params = NULL;
-   snd_pcm_uframes_t buffer_size = 32768;
-   snd_pcm_uframes_t period_size = 4096;
+   snd_pcm_uframes_t buffer_size = 0;
+   snd_pcm_uframes_t period_size = 0;
    unsigned int r = (unsigned int)fm->pcm_rate;
    snd_pcm_format_t fmt;
+   snd_pcm_access_t access = SND_PCM_ACCESS_RW_INTERLEAVED;
    struct configuration* config = NULL;
 
    config = (struct configuration*)shmem;
@@ -83,7 +86,16 @@ hrmp_alsa_init_handle(struct file_metadata* fm, snd_pcm_t** handle)
       goto error;
    }
 
-   if ((err = snd_pcm_hw_params_set_access(h, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+   if (config->mmap && snd_pcm_hw_params_test_access(h, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0)
+   {
+      access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+   }
+   else if (config->mmap)
+   {
+      hrmp_log_debug("mmap access not supported by %s", &config->active_device.name[0]);
+   }
+
+   if ((err = snd_pcm_hw_params_set_access(h, hw_params, access)) < 0)
    {
       hrmp_log_error("snd_pcm_hw_params_set_access %s/%s",
                      &config->active_device.name[0], snd_strerror(err));
@@ -113,29 +125,8 @@ hrmp_alsa_init_handle(struct file_metadata* fm, snd_pcm_t** handle)
       goto error;
    }
 
-   if ((err = snd_pcm_hw_params_set_period_size_near(h, hw_params, &period_size, &direction)) < 0)
+   if (hrmp_alsa_set_latency(h, hw_params, &config->active_device, rate))
    {
-      snd_pcm_hw_params_get_buffer_size_max(hw_params, &buffer_size);
-      buffer_size = MIN(buffer_size, (snd_pcm_uframes_t)MAX_BUFFER_SIZE);
-
-      snd_pcm_hw_params_get_period_size_min(hw_params, &period_size, NULL);
-      if (!period_size)
-      {
-         period_size = buffer_size / 4;
-      }
-
-      if ((err = snd_pcm_hw_params_set_period_size_near(h, hw_params, &period_size, NULL)) < 0)
-      {
-         hrmp_log_error("snd_pcm_hw_params_set_period_size_near %s/%s",
-                        &config->active_device.name[0], snd_strerror(err));
-         goto error;
-      }
-   }
-
-   if ((err = snd_pcm_hw_params_set_buffer_size_near(h, hw_params, &buffer_size)) < 0)
-   {
-      hrmp_log_error("snd_pcm_hw_params_set_buffer_size_near %s/%s",
-                     &config->active_device.name[0], snd_strerror(err));
       goto error;
    }
 
@@ -162,6 +153,17 @@ hrmp_alsa_init_handle(struct file_metadata* fm, snd_pcm_t** handle)
       goto error;
    }
 
+   if (snd_pcm_get_params(h, &buffer_size, &period_size) == 0)
+   {
+      config->active_device.rate = rate;
+      config->active_device.buffer_size = (unsigned long)buffer_size;
+      config->active_device.period_size = (unsigned long)period_size;
+
+      hrmp_log_debug("%s: buffer %lu frames, period %lu frames at %u Hz",
+                     &config->active_device.name[0], (unsigned long)buffer_size,
+                     (unsigned long)period_size, rate);
+   }
+
    if (hrmp_alsa_reset_handle(h))
    {
       goto error;
@@ -192,18 +194,90 @@ error:
 }
 
 int
-hrmp_alsa_reset_handle(snd_pcm_t* handle)
+hrmp_alsa_set_latency(snd_pcm_t* handle, snd_pcm_hw_params_t* hw_params, struct device* device, unsigned int rate)
 {
    int err;
+   snd_pcm_uframes_t buffer_size = 0;
+   snd_pcm_uframes_t period_size = 0;
 
-   if (handle != NULL)
+   /* Sized in time so DSD rates get as much headroom as CD rates */
+   buffer_size = (snd_pcm_uframes_t)(((uint64_t)rate * device->buffer_time) / 1000000ULL);
+   period_size = (snd_pcm_uframes_t)(((uint64_t)rate * device->period_time) / 1000000ULL);
+
+   period_size = MAX(period_size, (snd_pcm_uframes_t)MIN_PERIOD_SIZE);
+   buffer_size = MAX(buffer_size, 2 * period_size);
+
+   if ((err = snd_pcm_hw_params_set_period_size_near(handle, hw_params, &period_size, NULL)) < 0)
    {
-      if ((err = snd_pcm_drop(handle)) < 0)
+      snd_pcm_hw_params_get_buffer_size_max(hw_params, &buffer_size);
+      buffer_size = MIN(buffer_size, (snd_pcm_uframes_t)MAX_BUFFER_SIZE);
+
+      snd_pcm_hw_params_get_period_size_min(hw_params, &period_size, NULL);
+      if (!period_size)
       {
-         hrmp_log_error("snd_pcm_drop %s", snd_strerror(err));
+         period_size = buffer_size / 4;
+      }
+
+      if ((err = snd_pcm_hw_params_set_period_size_near(handle, hw_params, &period_size, NULL)) < 0)
+      {
+         hrmp_log_error("snd_pcm_hw_params_set_period_size_near %s/%s",
+                        &device->name[0], snd_strerror(err));
          goto error;
       }
+   }
+
+   if ((err = snd_pcm_hw_params_set_buffer_size_near(handle, hw_params, &buffer_size)) < 0)
+   {
+      hrmp_log_error("snd_pcm_hw_params_set_buffer_size_near %s/%s",
+                     &device->name[0], snd_strerror(err));
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+hrmp_alsa_reuse_handle(struct file_metadata* fm, snd_pcm_t* handle)
+{
+   int err;
+   unsigned int rate = 0;
+   unsigned int channels = 0;
+   snd_pcm_format_t fmt;
+   snd_pcm_format_t current = SND_PCM_FORMAT_UNKNOWN;
+   snd_pcm_hw_params_t* hw_params = NULL;
+   snd_pcm_state_t state;
+
+   if (handle == NULL || find_best_format(fm, &fmt))
+   {
+      goto error;
+   }
 
+   if ((err = snd_pcm_hw_params_malloc(&hw_params)) < 0)
+   {
+      goto error;
+   }
+
+   if ((err = snd_pcm_hw_params_current(handle, hw_params)) < 0)
+   {
+      goto error;
+   }
+
+   snd_pcm_hw_params_get_format(hw_params, &current);
+   snd_pcm_hw_params_get_rate(hw_params, &rate, NULL);
+   snd_pcm_hw_params_get_channels(hw_params, &channels);
+
+   if (current != fmt || rate != fm->pcm_rate || channels != 2)
+   {
+      goto error;
+   }
+
+   state = snd_pcm_state(handle);
+   if (state != SND_PCM_STATE_RUNNING && state != SND_PCM_STATE_PREPARED)
+   {
       if ((err = snd_pcm_prepare(handle)) < 0)
       {
          hrmp_log_error("snd_pcm_prepare %s", snd_strerror(err));
@@ -211,46 +285,78 @@ hrmp_alsa_reset_handle(snd_pcm_t* handle)
       }
    }
 
+   fm->alsa_snd = fmt;
+
+   snd_pcm_hw_params_free(hw_params);
+
    return 0;
 
 error:
 
+   if (hw_params != NULL)
+   {
+      snd_pcm_hw_params_free(hw_params);
+   }
+
    return 1;
 }
 
+bool
+hrmp_alsa_is_mmap(snd_pcm_t* handle)
+{
+   snd_pcm_hw_params_t* hw_params = NULL;
+   snd_pcm_access_t access = SND_PCM_ACCESS_RW_INTERLEAVED;
+
+   if (handle == NULL || snd_pcm_hw_params_malloc(&hw_params) < 0)
+   {
+      return false;
+   }
+
+   if (snd_pcm_hw_params_current(handle, hw_params) == 0)
+   {
+      snd_pcm_hw_params_get_access(hw_params, &access);
+   }
+
+   snd_pcm_hw_params_free(hw_params);
+
+   return access == SND_PCM_ACCESS_MMAP_INTERLEAVED;
+}
+
 int
-hrmp_alsa_close_handle(snd_pcm_t* handle)
+hrmp_alsa_reset_handle(snd_pcm_t* handle)
 {
+   int err;
+
    if (handle != NULL)
    {
-      snd_pcm_hw_params_t* hw = NULL;
-      snd_pcm_format_t fmt = SND_PCM_FORMAT_UNKNOWN;
-      bool use_drop = false;
-      struct configuration* config = (struct configuration*)shmem;
-
-      if (snd_pcm_hw_params_malloc(&hw) == 0)
+      if ((err = snd_pcm_drop(handle)) < 0)
       {
-         if (snd_pcm_hw_params_current(handle, hw) == 0)
-         {
-            snd_pcm_hw_params_get_format(hw, &fmt);
-         }
-         snd_pcm_hw_params_free(hw);
+         hrmp_log_error("snd_pcm_drop %s", snd_strerror(err));
+         goto error;
       }
 
-      if (fmt == SND_PCM_FORMAT_DSD_U32_BE || fmt == SND_PCM_FORMAT_DSD_U32_LE || config->dop)
+      if ((err = snd_pcm_prepare(handle)) < 0)
       {
-         use_drop = true;
+         hrmp_log_error("snd_pcm_prepare %s", snd_strerror(err));
+         goto error;
       }
+   }
 
-      if (use_drop)
-      {
-         snd_pcm_drop(handle);
-      }
-      else
-      {
-         snd_pcm_drain(handle);
-      }
+   return 0;
+
+error:
 
+   return 1;
+}
+
+int
+hrmp_alsa_close_handle(snd_pcm_t* handle)
+{
+   if (handle != NULL)
+   {
+      /* The players leave the end of the last file queued, DSD included
+       * with its silence, so let it play out */
+      snd_pcm_drain(handle);
       snd_pcm_close(handle);
    }
 
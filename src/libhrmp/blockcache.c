@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <blockcache.h>
+#include <ringbuffer.h>
+
+/* system */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+struct block
+{
+   struct blockcache_file file; /**< The file */
+   uint64_t offset;             /**< The block aligned file offset */
+   size_t size;                 /**< The number of valid bytes, short at the end of the file */
+   uint8_t* data;               /**< The data */
+   struct block* chain;         /**< The next block in the bucket */
+   struct block* newer;         /**< The more recently used block */
+   struct block* older;         /**< The less recently used block */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct block** buckets = NULL;
+static struct block* newest = NULL;
+static struct block* oldest = NULL;
+static size_t limit = 0;
+static size_t used = 0;
+static atomic_uint_fast64_t hits;
+static atomic_uint_fast64_t misses;
+
+static size_t bucket(struct blockcache_file* file, uint64_t offset);
+static struct block* lookup(struct blockcache_file* file, uint64_t offset);
+static void touch(struct block* b);
+static void unlink_lru(struct block* b);
+static void remove_block(struct block* b);
+static void evict(struct block* keep);
+static size_t available(void);
+
+int
+hrmp_blockcache_create(size_t budget)
+{
+   pthread_mutex_lock(&lock);
+
+   if (buckets == NULL && budget > 0)
+   {
+      buckets = (struct block**)calloc(HRMP_BLOCKCACHE_BUCKETS, sizeof(struct block*));
+      if (buckets == NULL)
+      {
+         pthread_mutex_unlock(&lock);
+         return 1;
+      }
+   }
+
+   limit = budget;
+   atomic_init(&hits, 0);
+   atomic_init(&misses, 0);
+
+   pthread_mutex_unlock(&lock);
+
+   return 0;
+}
+
+void
+hrmp_blockcache_destroy(void)
+{
+   pthread_mutex_lock(&lock);
+
+   while (oldest != NULL)
+   {
+      remove_block(oldest);
+   }
+
+   free(buckets);
+   buckets = NULL;
+   limit = 0;
+   used = 0;
+
+   pthread_mutex_unlock(&lock);
+}
+
+int
+hrmp_blockcache_file(int fd, struct blockcache_file* file)
+{
+   struct stat st;
+
+   memset(file, 0, sizeof(struct blockcache_file));
+
+   if (fstat(fd, &st) != 0)
+   {
+      return 1;
+   }
+
+   file->dev = (uint64_t)st.st_dev;
+   file->ino = (uint64_t)st.st_ino;
+   file->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + (int64_t)st.st_mtim.tv_nsec;
+   file->size = (uint64_t)st.st_size;
+
+   return 0;
+}
+
+size_t
+hrmp_blockcache_lookup(struct blockcache_file* file, void* buf, size_t n, uint64_t offset)
+{
+   uint64_t start = offset - (offset % HRMP_BLOCKCACHE_BLOCK_BYTES);
+   size_t within = (size_t)(offset - start);
+   size_t count = 0;
+   struct block* b = NULL;
+
+   if (buckets == NULL || limit == 0 || file == NULL || file->size == 0)
+   {
+      return 0;
+   }
+
+   pthread_mutex_lock(&lock);
+
+   b = lookup(file, start);
+   if (b != NULL && within < b->size)
+   {
+      touch(b);
+
+      count = MIN(n, b->size - within);
+      memcpy(buf, b->data + within, count);
+
+      atomic_fetch_add(&hits, 1);
+   }
+
+   pthread_mutex_unlock(&lock);
+
+   return count;
+}
+
+void
+hrmp_blockcache_insert(struct blockcache_file* file, uint64_t offset, void* data, size_t n)
+{
+   struct block* b = NULL;
+   uint8_t* copy = NULL;
+
+   if (buckets == NULL || limit == 0 || file == NULL || file->size == 0 || n == 0)
+   {
+      return;
+   }
+
+   atomic_fetch_add(&misses, 1);
+
+   if (offset % HRMP_BLOCKCACHE_BLOCK_BYTES != 0 ||
+       (n != HRMP_BLOCKCACHE_BLOCK_BYTES && offset + n != file->size))
+   {
+      return;
+   }
+
+   /* The ringbuffers come first, a block that can not be kept is not copied */
+   if (available() < HRMP_BLOCKCACHE_BLOCK_BYTES)
+   {
+      pthread_mutex_lock(&lock);
+      evict(NULL);
+      pthread_mutex_unlock(&lock);
+      return;
+   }
+
+   /* The copy is made without the lock, so other readers are not held up */
+   copy = (uint8_t*)malloc(HRMP_BLOCKCACHE_BLOCK_BYTES);
+   if (copy == NULL)
+   {
+      return;
+   }
+   memcpy(copy, data, n);
+
+   pthread_mutex_lock(&lock);
+
+   /* Another reader may have added the block in the meantime */
+   if (lookup(file, offset) == NULL)
+   {
+      b = (struct block*)calloc(1, sizeof(struct block));
+      if (b != NULL)
+      {
+         b->file = *file;
+         b->offset = offset;
+         b->size = n;
+         b->data = copy;
+         copy = NULL;
+
+         size_t h = bucket(file, offset);
+         b->chain = buckets[h];
+         buckets[h] = b;
+         used += HRMP_BLOCKCACHE_BLOCK_BYTES;
+
+         touch(b);
+         evict(b);
+      }
+   }
+
+   pthread_mutex_unlock(&lock);
+
+   free(copy);
+}
+
+void
+hrmp_blockcache_counters(uint64_t* hits_out, uint64_t* misses_out)
+{
+   *hits_out = (uint64_t)atomic_load(&hits);
+   *misses_out = (uint64_t)atomic_load(&misses);
+}
+
+static size_t
+bucket(struct blockcache_file* file, uint64_t offset)
+{
+   uint64_t h = file->ino * 0x9E3779B97F4A7C15ULL;
+
+   h ^= file->dev + (h << 6) + (h >> 2);
+   h ^= (offset / HRMP_BLOCKCACHE_BLOCK_BYTES) * 0xC2B2AE3D27D4EB4FULL;
+
+   return (size_t)(h % HRMP_BLOCKCACHE_BUCKETS);
+}
+
+static struct block*
+lookup(struct blockcache_file* file, uint64_t offset)
+{
+   for (struct block* b = buckets[bucket(file, offset)]; b != NULL; b = b->chain)
+   {
+      if (b->offset == offset && b->file.ino == file->ino && b->file.dev == file->dev &&
+          b->file.mtime == file->mtime && b->file.size == file->size)
+      {
+         return b;
+      }
+   }
+
+   return NULL;
+}
+
+/* Move a block to the most recently used end */
+static void
+touch(struct block* b)
+{
+   if (newest == b)
+   {
+      return;
+   }
+
+   unlink_lru(b);
+
+   b->older = newest;
+   b->newer = NULL;
+   if (newest != NULL)
+   {
+      newest->newer = b;
+   }
+   newest = b;
+   if (oldest == NULL)
+   {
+      oldest = b;
+   }
+}
+
+static void
+unlink_lru(struct block* b)
+{
+   if (b->newer != NULL)
+   {
+      b->newer->older = b->older;
+   }
+   else if (newest == b)
+   {
+      newest = b->older;
+   }
+
+   if (b->older != NULL)
+   {
+      b->older->newer = b->newer;
+   }
+   else if (oldest == b)
+   {
+      oldest = b->newer;
+   }
+
+   b->newer = NULL;
+   b->older = NULL;
+}
+
+static void
+remove_block(struct block* b)
+{
+   struct block** p = &buckets[bucket(&b->file, b->offset)];
+
+   while (*p != NULL && *p != b)
+   {
+      p = &(*p)->chain;
+   }
+   if (*p == b)
+   {
+      *p = b->chain;
+   }
+
+   unlink_lru(b);
+
+   used -= HRMP_BLOCKCACHE_BLOCK_BYTES;
+   free(b->data);
+   free(b);
+}
+
+static void
+evict(struct block* keep)
+{
+   size_t budget = available();
+
+   while (used > budget && oldest != NULL && oldest != keep)
+   {
+      remove_block(oldest);
+   }
+}
+
+/* What the ringbuffers leave of the budget */
+static size_t
+available(void)
+{
+   size_t rb = hrmp_ringbuffer_committed();
+
+   return limit > rb ? limit - rb : 0;
+}
@@ -20,6 +20,8 @@
 #include <configuration.h>
 #include <devices.h>
 #include <logging.h>
+#include <pipeline.h>
+#include <realtime.h>
 #include <ringbuffer.h>
 #include <shmem.h>
 #include <utils.h>
@@ -60,7 +62,16 @@ static int to_log_mode(char* where, int value);
 static int to_log_type(char* where, int value);
 static int as_cache_files(char* str, int* policy);
 static int to_cache_files(char* where, int value);
+static int as_reader(char* str, int* reader);
+static int to_reader(char* where, int value);
+static int as_hugepages(char* str, int* hugepages);
+static int to_hugepages(char* where, int value);
 static int as_size(char* str, size_t def, size_t* size);
+static int as_bool(char* str, bool* b);
+static int to_bool(char* where, bool value);
+static int to_int(char* where, int value);
+static int to_size(char* where, size_t value);
+static int to_latency(char* where, struct device* device);
 
 #define LINE_LENGTH 512
 
@@ -91,6 +102,19 @@ hrmp_init_configuration(void* shm)
 
    config->cache_size = HRMP_RINGBUFFER_MAX_BYTES;
    config->cache_files = HRMP_CACHE_FILES_OFF;
+   config->cache_mirror = true;
+   config->cache_hugepages = HRMP_HUGEPAGES_OFF;
+   config->cache_prebuffer = HRMP_DEFAULT_CACHE_PREBUFFER;
+   config->cache_blocks = false;
+   config->cache_metadata = true;
+   config->reader = HRMP_READER_AUTO;
+
+   config->decode_queue = HRMP_DEFAULT_DECODE_QUEUE;
+   config->mmap = false;
+
+   config->realtime = false;
+   config->realtime_priority = HRMP_DEFAULT_REALTIME_PRIORITY;
+   memset(config->stats_path, 0, sizeof(config->stats_path));
 
    config->metadata = false;
 
@@ -196,6 +220,7 @@ hrmp_read_configuration(void* shm, char* filename, bool emitWarnings)
                memset(&drv.name, 0, sizeof(drv.name));
                memcpy(&drv.name, &section, strlen(section));
                drv.volume = -1;
+               hrmp_device_set_latency(&drv, "balanced");
                idx_device++;
             }
          }
@@ -307,6 +332,13 @@ hrmp_read_configuration(void* shm, char* filename, bool emitWarnings)
                {
                   drv.volume = as_volume(value);
                }
+               else if (key_in_section("latency", section, key, false, &unknown))
+               {
+                  if (hrmp_device_set_latency(&drv, value))
+                  {
+                     unknown = true;
+                  }
+               }
                else if (key_in_section("cache", section, key, true, &unknown))
                {
                   if (as_size(value, HRMP_RINGBUFFER_MAX_BYTES, &config->cache_size))
@@ -321,6 +353,86 @@ hrmp_read_configuration(void* shm, char* filename, bool emitWarnings)
                      unknown = true;
                   }
                }
+               else if (key_in_section("cache_mirror", section, key, true, &unknown))
+               {
+                  if (as_bool(value, &config->cache_mirror))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("cache_hugepages", section, key, true, &unknown))
+               {
+                  if (as_hugepages(value, &config->cache_hugepages))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("cache_prebuffer", section, key, true, &unknown))
+               {
+                  if (as_size(value, HRMP_DEFAULT_CACHE_PREBUFFER, &config->cache_prebuffer))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("cache_blocks", section, key, true, &unknown))
+               {
+                  if (as_bool(value, &config->cache_blocks))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("cache_metadata", section, key, true, &unknown))
+               {
+                  if (as_bool(value, &config->cache_metadata))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("reader", section, key, true, &unknown))
+               {
+                  if (as_reader(value, &config->reader))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("decode_queue", section, key, true, &unknown))
+               {
+                  if (as_int(value, &config->decode_queue))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("mmap", section, key, true, &unknown))
+               {
+                  if (as_bool(value, &config->mmap))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("realtime", section, key, true, &unknown))
+               {
+                  if (as_bool(value, &config->realtime))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("realtime_priority", section, key, true, &unknown))
+               {
+                  if (as_int(value, &config->realtime_priority))
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (key_in_section("stats_path", section, key, true, &unknown))
+               {
+                  max = strlen(value);
+                  if (max > MISC_LENGTH - 1)
+                  {
+                     max = MISC_LENGTH - 1;
+                  }
+                  memset(config->stats_path, 0, sizeof(config->stats_path));
+                  memcpy(config->stats_path, value, max);
+               }
                else
                {
                   unknown = true;
@@ -459,6 +571,25 @@ hrmp_validate_configuration(void* shm)
       config->cache_files = HRMP_CACHE_FILES_OFF;
    }
 
+   if (config->cache_hugepages < HRMP_HUGEPAGES_OFF || config->cache_hugepages > HRMP_HUGEPAGES_EXPLICIT)
+   {
+      config->cache_hugepages = HRMP_HUGEPAGES_OFF;
+   }
+
+   if (config->reader < HRMP_READER_AUTO || config->reader > HRMP_READER_MMAP)
+   {
+      config->reader = HRMP_READER_AUTO;
+   }
+
+   if (config->decode_queue < 0)
+   {
+      config->decode_queue = 0;
+   }
+   if (config->decode_queue == 1)
+   {
+      config->decode_queue = 2;
+   }
+
    return 0;
 }
 
@@ -564,6 +695,50 @@ hrmp_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_cache_files(buffer, config->cache_files);
       }
+      else if (!strncmp(key, "cache_mirror", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->cache_mirror);
+      }
+      else if (!strncmp(key, "cache_hugepages", MISC_LENGTH))
+      {
+         return to_hugepages(buffer, config->cache_hugepages);
+      }
+      else if (!strncmp(key, "cache_prebuffer", MISC_LENGTH))
+      {
+         return to_size(buffer, config->cache_prebuffer);
+      }
+      else if (!strncmp(key, "cache_blocks", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->cache_blocks);
+      }
+      else if (!strncmp(key, "cache_metadata", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->cache_metadata);
+      }
+      else if (!strncmp(key, "reader", MISC_LENGTH))
+      {
+         return to_reader(buffer, config->reader);
+      }
+      else if (!strncmp(key, "decode_queue", MISC_LENGTH))
+      {
+         return to_int(buffer, config->decode_queue);
+      }
+      else if (!strncmp(key, "mmap", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->mmap);
+      }
+      else if (!strncmp(key, "realtime", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->realtime);
+      }
+      else if (!strncmp(key, "realtime_priority", MISC_LENGTH))
+      {
+         return to_int(buffer, config->realtime_priority);
+      }
+      else if (!strncmp(key, "stats_path", MISC_LENGTH))
+      {
+         return to_string(buffer, config->stats_path, buffer_size);
+      }
       else
       {
          goto error;
@@ -1075,6 +1250,11 @@ hrmp_write_device_config_value(char* buffer, char* device_name, char* config_key
       goto error;
    }
 
+   if (!strncmp(config_key, "latency", MISC_LENGTH))
+   {
+      return to_latency(buffer, &config->devices[device_index]);
+   }
+
    return 0;
 
 error:
@@ -1319,6 +1499,226 @@ to_cache_files(char* where, int value)
    return 0;
 }
 
+static int
+as_reader(char* str, int* reader)
+{
+   if (!reader)
+   {
+      return 1;
+   }
+
+   if (is_empty_string(str))
+   {
+      *reader = HRMP_READER_AUTO;
+      return 1;
+   }
+
+   if (!strcasecmp(str, "auto"))
+   {
+      *reader = HRMP_READER_AUTO;
+      return 0;
+   }
+   else if (!strcasecmp(str, "pread"))
+   {
+      *reader = HRMP_READER_PREAD;
+      return 0;
+   }
+   else if (!strcasecmp(str, "io_uring"))
+   {
+      *reader = HRMP_READER_IO_URING;
+      return 0;
+   }
+   else if (!strcasecmp(str, "mmap"))
+   {
+      *reader = HRMP_READER_MMAP;
+      return 0;
+   }
+
+   *reader = HRMP_READER_AUTO;
+   return 1;
+}
+
+static int
+to_reader(char* where, int value)
+{
+   if (!where || value < 0)
+   {
+      return 1;
+   }
+
+   switch (value)
+   {
+      case HRMP_READER_AUTO:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "auto");
+         break;
+      case HRMP_READER_PREAD:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "pread");
+         break;
+      case HRMP_READER_IO_URING:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "io_uring");
+         break;
+      case HRMP_READER_MMAP:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "mmap");
+         break;
+   }
+
+   return 0;
+}
+
+static int
+as_hugepages(char* str, int* hugepages)
+{
+   if (!hugepages)
+   {
+      return 1;
+   }
+
+   if (is_empty_string(str))
+   {
+      *hugepages = HRMP_HUGEPAGES_OFF;
+      return 1;
+   }
+
+   if (!strcasecmp(str, "off"))
+   {
+      *hugepages = HRMP_HUGEPAGES_OFF;
+      return 0;
+   }
+   else if (!strcasecmp(str, "auto"))
+   {
+      *hugepages = HRMP_HUGEPAGES_AUTO;
+      return 0;
+   }
+   else if (!strcasecmp(str, "transparent"))
+   {
+      *hugepages = HRMP_HUGEPAGES_TRANSPARENT;
+      return 0;
+   }
+   else if (!strcasecmp(str, "explicit"))
+   {
+      *hugepages = HRMP_HUGEPAGES_EXPLICIT;
+      return 0;
+   }
+
+   *hugepages = HRMP_HUGEPAGES_OFF;
+   return 1;
+}
+
+static int
+to_hugepages(char* where, int value)
+{
+   if (!where || value < 0)
+   {
+      return 1;
+   }
+
+   switch (value)
+   {
+      case HRMP_HUGEPAGES_OFF:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "off");
+         break;
+      case HRMP_HUGEPAGES_AUTO:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "auto");
+         break;
+      case HRMP_HUGEPAGES_TRANSPARENT:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "transparent");
+         break;
+      case HRMP_HUGEPAGES_EXPLICIT:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "explicit");
+         break;
+   }
+
+   return 0;
+}
+
+static int
+as_bool(char* str, bool* b)
+{
+   if (!b || is_empty_string(str))
+   {
+      return 1;
+   }
+
+   if (!strcasecmp(str, "on") || !strcasecmp(str, "yes") || !strcasecmp(str, "true") || !strcmp(str, "1"))
+   {
+      *b = true;
+      return 0;
+   }
+   else if (!strcasecmp(str, "off") || !strcasecmp(str, "no") || !strcasecmp(str, "false") || !strcmp(str, "0"))
+   {
+      *b = false;
+      return 0;
+   }
+
+   return 1;
+}
+
+static int
+to_bool(char* where, bool value)
+{
+   if (!where)
+   {
+      return 1;
+   }
+
+   hrmp_snprintf(where, MISC_LENGTH, "%s", value ? "on" : "off");
+
+   return 0;
+}
+
+static int
+to_int(char* where, int value)
+{
+   if (!where)
+   {
+      return 1;
+   }
+
+   hrmp_snprintf(where, MISC_LENGTH, "%d", value);
+
+   return 0;
+}
+
+static int
+to_size(char* where, size_t value)
+{
+   if (!where)
+   {
+      return 1;
+   }
+
+   hrmp_snprintf(where, MISC_LENGTH, "%zu", value);
+
+   return 0;
+}
+
+static int
+to_latency(char* where, struct device* device)
+{
+   if (!where || !device)
+   {
+      return 1;
+   }
+
+   switch (device->latency)
+   {
+      case HRMP_LATENCY_LOW:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "low");
+         break;
+      case HRMP_LATENCY_BALANCED:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "balanced");
+         break;
+      case HRMP_LATENCY_ROBUST:
+         hrmp_snprintf(where, MISC_LENGTH, "%s", "robust");
+         break;
+      default:
+         hrmp_snprintf(where, MISC_LENGTH, "%u/%u", device->buffer_time, device->period_time);
+         break;
+   }
+
+   return 0;
+}
+
 static int
 as_size(char* str, size_t def, size_t* size)
 {
@@ -17,6 +17,7 @@
 
 /* hrmp */
 #include <hrmp.h>
+#include <alsa.h>
 #include <devices.h>
 #include <logging.h>
 #include <stdatomic.h>
@@ -24,10 +25,12 @@
 #include <utils.h>
 
 /* system */
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include <alsa/asoundlib.h>
@@ -40,6 +43,11 @@ static int get_hardware_number(char* device);
 static char* get_hardware_selem(int hardware);
 static bool has_capabilities(struct capabilities c);
 static int copy_device_index(int i);
+static void check_latency(struct device* device);
+static char* latency_name(int latency);
+
+/* Rate used to report the negotiated buffer and period sizes */
+#define LATENCY_PROBE_RATE 44100
 
 void
 hrmp_check_devices(void)
@@ -57,6 +65,7 @@ hrmp_check_devices(void)
          char* selem = NULL;
 
          check_capabilities(&config->devices[i]);
+         check_latency(&config->devices[i]);
          config->devices[i].hardware = get_hardware_number(config->devices[i].name);
 
          selem = get_hardware_selem(config->devices[i].hardware);
@@ -102,10 +111,94 @@ hrmp_init_device(struct device* device)
    device->active = false;
    device->volume = 0;
    device->is_paused = true;
+   device->rate = 0;
+   device->buffer_size = 0;
+   device->period_size = 0;
+   device->busy = false;
+   hrmp_device_set_latency(device, "balanced");
 
    return 0;
 }
 
+int
+hrmp_device_set_latency(struct device* device, char* value)
+{
+   int latency = HRMP_LATENCY_CUSTOM;
+   unsigned long buffer_time = 0;
+   unsigned long period_time = 0;
+   char* end = NULL;
+
+   if (device == NULL || value == NULL)
+   {
+      goto error;
+   }
+
+   if (!strcasecmp(value, "low"))
+   {
+      latency = HRMP_LATENCY_LOW;
+      buffer_time = 40000;
+      period_time = 10000;
+   }
+   else if (!strcasecmp(value, "balanced"))
+   {
+      /* The 32768 frame buffer and 4096 frame periods used before the
+       * profiles, at 44.1kHz */
+      latency = HRMP_LATENCY_BALANCED;
+      buffer_time = 750000;
+      period_time = 93750;
+   }
+   else if (!strcasecmp(value, "robust"))
+   {
+      latency = HRMP_LATENCY_ROBUST;
+      buffer_time = 2000000;
+      period_time = 250000;
+   }
+   else
+   {
+      buffer_time = strtoul(value, &end, 10);
+      if (end == value)
+      {
+         goto error;
+      }
+
+      if (*end == '/')
+      {
+         char* p = end + 1;
+
+         period_time = strtoul(p, &end, 10);
+         if (end == p)
+         {
+            goto error;
+         }
+      }
+
+      if (*end != '\0')
+      {
+         goto error;
+      }
+
+      if (period_time == 0)
+      {
+         period_time = buffer_time / 4;
+      }
+
+      if (buffer_time < 1000 || buffer_time > 10000000 || period_time == 0 || period_time * 2 > buffer_time)
+      {
+         goto error;
+      }
+   }
+
+   device->latency = latency;
+   device->buffer_time = (unsigned int)buffer_time;
+   device->period_time = (unsigned int)period_time;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
 int
 hrmp_create_active_device(char* device_name)
 {
@@ -239,6 +332,17 @@ hrmp_print_device(struct device* device)
    printf("  Active:    %s\n", device->active ? "Yes" : "No");
    printf("  Volume:    %d\n", device->volume < 0 ? config->volume : device->volume);
    printf("  Paused:    %s\n", device->is_paused ? "Yes" : "No");
+   printf("  Latency:   %s (%u/%u us)\n", latency_name(device->latency), device->buffer_time, device->period_time);
+   if (device->rate > 0)
+   {
+      printf("  Buffer:    %lu frames at %u Hz\n", device->buffer_size, device->rate);
+      printf("  Period:    %lu frames at %u Hz\n", device->period_size, device->rate);
+   }
+   else if (device->busy)
+   {
+      printf("  Buffer:    Device busy\n");
+      printf("  Period:    Device busy\n");
+   }
 
    if (device->active || has_capabilities(device->capabilities))
    {
@@ -930,6 +1034,94 @@ copy_device_index(int i)
    config->active_device.active = config->devices[i].active;
    config->active_device.volume = config->devices[i].volume;
    config->active_device.is_paused = config->devices[i].is_paused;
+   config->active_device.latency = config->devices[i].latency;
+   config->active_device.buffer_time = config->devices[i].buffer_time;
+   config->active_device.period_time = config->devices[i].period_time;
+   config->active_device.rate = config->devices[i].rate;
+   config->active_device.buffer_size = config->devices[i].buffer_size;
+   config->active_device.period_size = config->devices[i].period_size;
+   config->active_device.busy = config->devices[i].busy;
 
    return 0;
 }
+
+static void
+check_latency(struct device* device)
+{
+   int err;
+   snd_pcm_t* h = NULL;
+   snd_pcm_hw_params_t* hw = NULL;
+   snd_pcm_uframes_t buffer_size = 0;
+   snd_pcm_uframes_t period_size = 0;
+   unsigned int rate = LATENCY_PROBE_RATE;
+
+   device->rate = 0;
+   device->buffer_size = 0;
+   device->period_size = 0;
+   device->busy = false;
+
+   /* A device that is playing elsewhere is reported instead of waited for */
+   if ((err = snd_pcm_open(&h, device->device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK)) < 0)
+   {
+      if (err == -EBUSY || err == -EAGAIN)
+      {
+         hrmp_log_debug("%s is busy, the buffer sizes are not known", device->device);
+         device->busy = true;
+      }
+      goto done;
+   }
+
+   if (snd_pcm_hw_params_malloc(&hw) < 0 ||
+       snd_pcm_hw_params_any(h, hw) < 0 ||
+       snd_pcm_hw_params_set_rate_resample(h, hw, 0) < 0 ||
+       snd_pcm_hw_params_set_access(h, hw, SND_PCM_ACCESS_RW_INTERLEAVED) < 0 ||
+       snd_pcm_hw_params_set_channels(h, hw, 2) < 0 ||
+       snd_pcm_hw_params_set_rate_near(h, hw, &rate, NULL) < 0)
+   {
+      goto done;
+   }
+
+   if (hrmp_alsa_set_latency(h, hw, device, rate))
+   {
+      goto done;
+   }
+
+   if (snd_pcm_hw_params(h, hw) < 0 || snd_pcm_get_params(h, &buffer_size, &period_size) < 0)
+   {
+      goto done;
+   }
+
+   device->rate = rate;
+   device->buffer_size = (unsigned long)buffer_size;
+   device->period_size = (unsigned long)period_size;
+
+done:
+
+   if (hw != NULL)
+   {
+      snd_pcm_hw_params_free(hw);
+   }
+
+   if (h != NULL)
+   {
+      snd_pcm_close(h);
+   }
+}
+
+static char*
+latency_name(int latency)
+{
+   switch (latency)
+   {
+      case HRMP_LATENCY_LOW:
+         return "low";
+      case HRMP_LATENCY_BALANCED:
+         return "balanced";
+      case HRMP_LATENCY_ROBUST:
+         return "robust";
+      default:
+         break;
+   }
+
+   return "custom";
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <event.h>
+#include <logging.h>
+
+/* system */
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <alsa/asoundlib.h>
+
+int
+hrmp_event_create(snd_pcm_t* pcm, struct event** out)
+{
+   int count = 0;
+   struct event* ev = NULL;
+
+   *out = NULL;
+
+   ev = (struct event*)malloc(sizeof(struct event));
+   if (ev == NULL)
+   {
+      goto error;
+   }
+
+   memset(ev, 0, sizeof(struct event));
+
+   ev->pcm = pcm;
+
+   /* Only a terminal is a keyboard, /dev/null or a file is always readable */
+   ev->fds[HRMP_EVENT_FD_STDIN].fd = isatty(STDIN_FILENO) ? STDIN_FILENO : -1;
+   ev->fds[HRMP_EVENT_FD_STDIN].events = POLLIN;
+
+   /* poll() skips a negative descriptor */
+   ev->fds[HRMP_EVENT_FD_CONTROL].fd = -1;
+   ev->fds[HRMP_EVENT_FD_CONTROL].events = POLLIN;
+
+   if (pcm != NULL)
+   {
+      count = snd_pcm_poll_descriptors_count(pcm);
+      if (count < 0 || count > HRMP_EVENT_MAX_FDS - HRMP_EVENT_FD_PCM)
+      {
+         hrmp_log_error("Unsupported number of PCM descriptors (%d)", count);
+         goto error;
+      }
+
+      if (count > 0 && snd_pcm_poll_descriptors(pcm, &ev->fds[HRMP_EVENT_FD_PCM], (unsigned int)count) != count)
+      {
+         hrmp_log_error("Could not get PCM descriptors");
+         goto error;
+      }
+   }
+
+   ev->pcm_count = (unsigned int)count;
+
+   *out = ev;
+
+   return 0;
+
+error:
+
+   free(ev);
+
+   return 1;
+}
+
+void
+hrmp_event_destroy(struct event* ev)
+{
+   free(ev);
+}
+
+void
+hrmp_event_set_control(struct event* ev, int fd)
+{
+   if (ev != NULL)
+   {
+      ev->fds[HRMP_EVENT_FD_CONTROL].fd = fd;
+   }
+}
+
+void
+hrmp_event_close_input(struct event* ev)
+{
+   if (ev != NULL)
+   {
+      ev->fds[HRMP_EVENT_FD_STDIN].fd = -1;
+      ev->input = false;
+   }
+}
+
+int
+hrmp_event_wait(struct event* ev, bool device, int timeout)
+{
+   int ready = HRMP_EVENT_NONE;
+   nfds_t n = HRMP_EVENT_FD_PCM;
+
+   if (ev == NULL)
+   {
+      return HRMP_EVENT_NONE;
+   }
+
+   if (device)
+   {
+      n += ev->pcm_count;
+   }
+
+   if (poll(ev->fds, n, timeout) < 0)
+   {
+      if (errno != EINTR)
+      {
+         hrmp_log_debug("poll failed (%s)", strerror(errno));
+      }
+      return HRMP_EVENT_NONE;
+   }
+
+   if (ev->fds[HRMP_EVENT_FD_STDIN].revents & POLLIN)
+   {
+      ev->input = true;
+      ready |= HRMP_EVENT_INPUT;
+   }
+   else if (ev->fds[HRMP_EVENT_FD_STDIN].revents & (POLLHUP | POLLERR | POLLNVAL))
+   {
+      /* A hung up terminal stays ready, so stop polling it */
+      ev->fds[HRMP_EVENT_FD_STDIN].fd = -1;
+   }
+
+   if (ev->fds[HRMP_EVENT_FD_CONTROL].revents & (POLLIN | POLLHUP | POLLERR))
+   {
+      ready |= HRMP_EVENT_CONTROL;
+   }
+
+   if (device && ev->pcm_count > 0)
+   {
+      unsigned short revents = 0;
+
+      if (snd_pcm_poll_descriptors_revents(ev->pcm, &ev->fds[HRMP_EVENT_FD_PCM], ev->pcm_count, &revents) < 0 ||
+          (revents & (POLLOUT | POLLERR)))
+      {
+         ready |= HRMP_EVENT_DEVICE;
+      }
+   }
+
+   return ready;
+}
+
+bool
+hrmp_event_input(struct event* ev)
+{
+   bool input;
+
+   if (ev == NULL)
+   {
+      /* Without an event loop every call reads the keyboard */
+      return true;
+   }
+
+   input = ev->input;
+   ev->input = false;
+
+   return input;
+}
@@ -20,25 +20,44 @@
 #include <devices.h>
 #include <files.h>
 #include <logging.h>
+#include <metacache.h>
 #include <mkv.h>
 #include <utils.h>
+#include <wav.h>
 
 /* system */
+#include <fcntl.h>
 #include <sndfile.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <inttypes.h>
+#include <unistd.h>
 #include <alsa/asoundlib.h>
 
+/* The head of a file read by a probe */
+#define PROBE_SIZE 16384
+
+/* The largest VORBIS_COMMENT block read */
+#define PROBE_COMMENT_MAX 65536
+
 static uint32_t id3_synchsafe32(const unsigned char b[4]);
 static uint32_t id3_be_u32(const unsigned char b[4]);
 static void id3_copy_text_utf8(char* dst, size_t dstsz, const unsigned char* data, size_t len);
 static void id3_assign_text_frame(struct file_metadata* fm, const char id[4], const unsigned char* payload, uint32_t size);
 static void parse_id3v2(FILE* f, uint64_t offset, struct file_metadata* fm);
+static void parse_id3v2_buffer(const unsigned char* data, size_t size, struct file_metadata* fm);
 static bool metadata_supported(struct file_metadata* fm);
 static int init_metadata(char* filename, int type, struct file_metadata** file_metadata);
 static int get_metadata(char* filename, int type, struct file_metadata** file_metadata);
+static int probe_bytes(int fd, unsigned char* head, size_t head_size, uint64_t offset, unsigned char* dst, size_t size);
+static void probe_assign_tag(struct file_metadata* fm, const char* key, const char* value, size_t value_size);
+static void probe_wav_tags(unsigned char* head, size_t size, struct file_metadata* fm);
+static void probe_vorbis_comment(const unsigned char* data, size_t size, struct file_metadata* fm);
+static int get_metadata_wav(char* filename, struct file_metadata** file_metadata);
+static int get_metadata_flac(char* filename, struct file_metadata** file_metadata);
+static int get_metadata_mp3(char* filename, struct file_metadata** file_metadata);
 static int get_metadata_dsf(char* filename, struct file_metadata** file_metadata);
 static int get_metadata_dff(char* filename, struct file_metadata** file_metadata);
 static int get_metadata_mkv(char* filename, struct file_metadata** file_metadata);
@@ -65,6 +84,7 @@ int
 hrmp_file_metadata(char* f, struct file_metadata** fm)
 {
    int type = TYPE_UNKNOWN;
+   bool cached = false;
    struct file_metadata* m = NULL;
    struct configuration* config = NULL;
 
@@ -102,9 +122,29 @@ hrmp_file_metadata(char* f, struct file_metadata** fm)
       type = TYPE_MKV;
    }
 
-   if (type == TYPE_WAV || type == TYPE_FLAC || type == TYPE_MP3)
+   if (type != TYPE_UNKNOWN && !hrmp_metacache_lookup(f, &m))
    {
-      if (get_metadata(f, type, &m))
+      cached = true;
+   }
+   else if (type == TYPE_WAV || type == TYPE_FLAC || type == TYPE_MP3)
+   {
+      int probed = 1;
+
+      /* The header probes only read the head of the file, libsndfile is the fallback */
+      if (type == TYPE_WAV)
+      {
+         probed = get_metadata_wav(f, &m);
+      }
+      else if (type == TYPE_FLAC)
+      {
+         probed = get_metadata_flac(f, &m);
+      }
+      else
+      {
+         probed = get_metadata_mp3(f, &m);
+      }
+
+      if (probed && get_metadata(f, type, &m))
       {
          if (!config->quiet)
          {
@@ -155,6 +195,12 @@ hrmp_file_metadata(char* f, struct file_metadata** fm)
       goto error;
    }
 
+   /* What the device supports is checked on every run */
+   if (!cached)
+   {
+      hrmp_metacache_insert(f, m);
+   }
+
    if (!metadata_supported(m))
    {
       if (!config->quiet)
@@ -505,6 +551,11 @@ id3_assign_text_frame(struct file_metadata* fm, const char id[4], const unsigned
 static void
 parse_id3v2(FILE* f, uint64_t offset, struct file_metadata* fm)
 {
+   unsigned char hdr[10];
+   unsigned char* tag = NULL;
+   uint32_t tag_size = 0;
+   size_t got = 0;
+
    if (f == NULL || fm == NULL)
    {
       return;
@@ -516,7 +567,6 @@ parse_id3v2(FILE* f, uint64_t offset, struct file_metadata* fm)
       return;
    }
 
-   unsigned char hdr[10];
    if (fread(hdr, 1, 10, f) != 10)
    {
       goto done;
@@ -527,45 +577,77 @@ parse_id3v2(FILE* f, uint64_t offset, struct file_metadata* fm)
       goto done;
    }
 
-   unsigned ver_major = hdr[3];
-   unsigned flags = hdr[5];
-   uint32_t tag_size = id3_synchsafe32(&hdr[6]);
+   tag_size = id3_synchsafe32(&hdr[6]);
+
+   tag = (unsigned char*)malloc(10 + (size_t)tag_size);
+   if (tag == NULL)
+   {
+      goto done;
+   }
+
+   memcpy(tag, hdr, 10);
+   got = fread(tag + 10, 1, tag_size, f);
+
+   parse_id3v2_buffer(tag, 10 + got, fm);
+
+done:
+   free(tag);
+   if (save_pos >= 0)
+   {
+      fseek(f, save_pos, SEEK_SET);
+   }
+}
+
+static void
+parse_id3v2_buffer(const unsigned char* data, size_t size, struct file_metadata* fm)
+{
+   if (data == NULL || fm == NULL || size < 10)
+   {
+      return;
+   }
+
+   if (!(data[0] == 'I' && data[1] == 'D' && data[2] == '3'))
+   {
+      return;
+   }
+
+   unsigned ver_major = data[3];
+   unsigned flags = data[5];
+   uint32_t tag_size = id3_synchsafe32(&data[6]);
    uint32_t bytes_read = 0;
+   size_t pos = 10;
+
+   /* A tag cut short by the buffer yields the frames that fit */
+   if ((uint64_t)tag_size + 10 > size)
+   {
+      tag_size = (uint32_t)(size - 10);
+   }
 
    if (flags & 0x40)
    {
-      unsigned char ex[4];
-      if (fread(ex, 1, 4, f) != 4)
+      if (tag_size < 4)
       {
-         goto done;
+         return;
       }
-      uint32_t ex_size = (ver_major >= 4) ? id3_synchsafe32(ex) : id3_be_u32(ex);
+      uint32_t ex_size = (ver_major >= 4) ? id3_synchsafe32(&data[pos]) : id3_be_u32(&data[pos]);
       if (ver_major >= 4)
       {
-         if (fseek(f, (long)ex_size, SEEK_CUR) != 0)
-         {
-            goto done;
-         }
          bytes_read += 4 + ex_size;
       }
       else
       {
-         uint32_t remaining = (ex_size >= 4) ? (ex_size - 4) : 0;
-         if (fseek(f, (long)remaining, SEEK_CUR) != 0)
-         {
-            goto done;
-         }
-         bytes_read += ex_size;
+         bytes_read += (ex_size >= 4) ? ex_size : 4;
+      }
+      if (bytes_read > tag_size)
+      {
+         return;
       }
+      pos = 10 + bytes_read;
    }
 
    while (bytes_read + 10 <= tag_size)
    {
-      unsigned char fh[10];
-      if (fread(fh, 1, 10, f) != 10)
-      {
-         break;
-      }
+      const unsigned char* fh = &data[pos];
 
       char frame_id[5] = {0};
       memcpy(frame_id, fh, 4);
@@ -581,32 +663,13 @@ parse_id3v2(FILE* f, uint64_t offset, struct file_metadata* fm)
          break;
       }
 
-      unsigned char* payload = (unsigned char*)malloc(frame_size);
-      if (payload == NULL)
-      {
-         break;
-      }
-
-      size_t got = fread(payload, 1, frame_size, f);
-      if (got != frame_size)
-      {
-         free(payload);
-         break;
-      }
-
       if (frame_id[0] == 'T')
       {
-         id3_assign_text_frame(fm, frame_id, payload, frame_size);
+         id3_assign_text_frame(fm, frame_id, fh + 10, frame_size);
       }
 
-      free(payload);
       bytes_read += frame_size;
-   }
-
-done:
-   if (save_pos >= 0)
-   {
-      fseek(f, save_pos, SEEK_SET);
+      pos = 10 + bytes_read;
    }
 }
 
@@ -988,6 +1051,582 @@ error:
    return 1;
 }
 
+static int
+probe_bytes(int fd, unsigned char* head, size_t head_size, uint64_t offset, unsigned char* dst, size_t size)
+{
+   ssize_t n;
+
+   if (offset + size <= head_size)
+   {
+      memcpy(dst, head + offset, size);
+      return 0;
+   }
+
+   n = pread(fd, dst, size, (off_t)offset);
+   if (n < 0 || (size_t)n != size)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static void
+probe_assign_tag(struct file_metadata* fm, const char* key, const char* value, size_t value_size)
+{
+   char buf[MISC_LENGTH] = {0};
+   size_t n = value_size < sizeof(buf) - 1 ? value_size : sizeof(buf) - 1;
+
+   memcpy(buf, value, n);
+
+   if (strlen(buf) == 0)
+   {
+      return;
+   }
+
+   if (!strcasecmp(key, "TITLE"))
+   {
+      hrmp_snprintf(fm->title, sizeof(fm->title), "%s", buf);
+   }
+   else if (!strcasecmp(key, "ARTIST"))
+   {
+      hrmp_snprintf(fm->artist, sizeof(fm->artist), "%s", buf);
+   }
+   else if (!strcasecmp(key, "ALBUM"))
+   {
+      hrmp_snprintf(fm->album, sizeof(fm->album), "%s", buf);
+   }
+   else if (!strcasecmp(key, "GENRE"))
+   {
+      hrmp_snprintf(fm->genre, sizeof(fm->genre), "%s", buf);
+   }
+   else if (!strcasecmp(key, "DATE"))
+   {
+      hrmp_snprintf(fm->date, sizeof(fm->date), "%s", buf);
+   }
+   else if (!strcasecmp(key, "TRACKNUMBER"))
+   {
+      int track = 0;
+      if (sscanf(buf, "%d", &track) == 1 && track > 0)
+      {
+         fm->track = track;
+      }
+   }
+   else if (!strcasecmp(key, "DISCNUMBER"))
+   {
+      int disc = 0;
+      if (sscanf(buf, "%d", &disc) == 1 && disc > 0)
+      {
+         fm->disc = disc;
+      }
+   }
+}
+
+static void
+probe_wav_tags(unsigned char* head, size_t size, struct file_metadata* fm)
+{
+   static const char* info[][2] = {
+      {"INAM", "TITLE"},
+      {"IART", "ARTIST"},
+      {"IPRD", "ALBUM"},
+      {"IGNR", "GENRE"},
+      {"ICRD", "DATE"},
+      {"ITRK", "TRACKNUMBER"},
+   };
+   size_t pos = 12;
+
+   /* Only the chunks inside the head are looked at */
+   while (pos + 8 <= size)
+   {
+      uint32_t chunk = hrmp_read_le_u32_buffer(&head[pos + 4]);
+      size_t start = pos + 8;
+      size_t end = (uint64_t)chunk > size - start ? size : start + chunk;
+
+      if (!memcmp(&head[pos], "LIST", 4) && end - start >= 4 && !memcmp(&head[start], "INFO", 4))
+      {
+         size_t p = start + 4;
+
+         while (p + 8 <= end)
+         {
+            uint32_t sub = hrmp_read_le_u32_buffer(&head[p + 4]);
+
+            if ((uint64_t)sub > end - (p + 8))
+            {
+               break;
+            }
+
+            for (size_t i = 0; i < sizeof(info) / sizeof(info[0]); i++)
+            {
+               if (!memcmp(&head[p], info[i][0], 4))
+               {
+                  probe_assign_tag(fm, info[i][1], (const char*)&head[p + 8], sub);
+               }
+            }
+
+            p += 8 + sub + (sub & 1);
+         }
+      }
+      else if (!memcmp(&head[pos], "id3 ", 4) || !memcmp(&head[pos], "ID3 ", 4))
+      {
+         parse_id3v2_buffer(&head[start], end - start, fm);
+      }
+      else if (!memcmp(&head[pos], "data", 4))
+      {
+         break;
+      }
+
+      if ((uint64_t)chunk + (chunk & 1) > size - start)
+      {
+         break;
+      }
+      pos = start + chunk + (chunk & 1);
+   }
+}
+
+static void
+probe_vorbis_comment(const unsigned char* data, size_t size, struct file_metadata* fm)
+{
+   size_t pos = 0;
+   uint32_t vendor;
+   uint32_t count;
+
+   if (size < 8)
+   {
+      return;
+   }
+
+   vendor = hrmp_read_le_u32_buffer((uint8_t*)data);
+   if ((uint64_t)vendor + 8 > size)
+   {
+      return;
+   }
+   pos = 4 + vendor;
+
+   count = hrmp_read_le_u32_buffer((uint8_t*)&data[pos]);
+   pos += 4;
+
+   for (uint32_t i = 0; i < count && pos + 4 <= size; i++)
+   {
+      uint32_t len = hrmp_read_le_u32_buffer((uint8_t*)&data[pos]);
+      const char* comment = (const char*)&data[pos + 4];
+      const char* eq;
+      char key[32] = {0};
+
+      pos += 4;
+      if ((uint64_t)len > size - pos)
+      {
+         break;
+      }
+
+      eq = memchr(comment, '=', len);
+      if (eq != NULL && (size_t)(eq - comment) < sizeof(key))
+      {
+         memcpy(key, comment, (size_t)(eq - comment));
+         probe_assign_tag(fm, key, eq + 1, len - (size_t)(eq - comment) - 1);
+      }
+
+      pos += len;
+   }
+}
+
+static int
+get_metadata_wav(char* filename, struct file_metadata** file_metadata)
+{
+   int fd = -1;
+   ssize_t got = 0;
+   unsigned char head[HRMP_WAV_HEAD_BYTES];
+   struct wav wav;
+   struct file_metadata* fm = NULL;
+
+   *file_metadata = NULL;
+
+   if (init_metadata(filename, TYPE_WAV, &fm))
+   {
+      goto error;
+   }
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      goto error;
+   }
+
+   got = pread(fd, head, sizeof(head), 0);
+   if (got <= 0)
+   {
+      goto error;
+   }
+
+   if (hrmp_wav_parse_header(head, (size_t)got, fm->file_size, &wav) || wav.block_align == 0)
+   {
+      goto error;
+   }
+
+   fm->sample_rate = wav.sample_rate;
+   fm->pcm_rate = wav.sample_rate;
+   fm->channels = wav.channels;
+
+   /* Anything but integer PCM is left without a format, as libsndfile did */
+   if (wav.format == HRMP_WAV_FORMAT_PCM)
+   {
+      if (wav.bits_per_sample == 16)
+      {
+         fm->format = FORMAT_16;
+         fm->bits_per_sample = 16;
+      }
+      else if (wav.bits_per_sample == 24)
+      {
+         fm->format = FORMAT_24;
+         fm->bits_per_sample = 24;
+      }
+      else if (wav.bits_per_sample == 32)
+      {
+         fm->format = FORMAT_32;
+         fm->bits_per_sample = 32;
+      }
+   }
+
+   fm->total_samples = (unsigned long)(wav.data_size / wav.block_align);
+   fm->duration = fm->sample_rate > 0 ? (double)fm->total_samples / fm->sample_rate : 0.0;
+   fm->data_size = (unsigned long)wav.data_size;
+
+   probe_wav_tags(head, (size_t)got, fm);
+
+   close(fd);
+
+   *file_metadata = fm;
+
+   return 0;
+
+error:
+
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+
+   free(fm);
+
+   return 1;
+}
+
+static int
+get_metadata_flac(char* filename, struct file_metadata** file_metadata)
+{
+   int fd = -1;
+   ssize_t got = 0;
+   uint64_t pos = 0;
+   bool has_info = false;
+   bool last = false;
+   unsigned char head[PROBE_SIZE];
+   unsigned char block[4];
+   unsigned char si[34];
+   unsigned char* comment = NULL;
+   unsigned int bits = 0;
+   struct file_metadata* fm = NULL;
+
+   *file_metadata = NULL;
+
+   if (init_metadata(filename, TYPE_FLAC, &fm))
+   {
+      goto error;
+   }
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      goto error;
+   }
+
+   got = pread(fd, head, sizeof(head), 0);
+   if (got < 4)
+   {
+      goto error;
+   }
+
+   /* Some taggers put an ID3v2 tag in front of the stream */
+   if (got >= 10 && !memcmp(head, "ID3", 3))
+   {
+      pos = 10 + (uint64_t)id3_synchsafe32(&head[6]) + ((head[5] & 0x10) ? 10 : 0);
+   }
+
+   if (probe_bytes(fd, head, (size_t)got, pos, block, 4) || memcmp(block, "fLaC", 4))
+   {
+      goto error;
+   }
+   pos += 4;
+
+   while (!last)
+   {
+      uint32_t type;
+      uint32_t len;
+
+      if (probe_bytes(fd, head, (size_t)got, pos, block, 4))
+      {
+         break;
+      }
+
+      last = (block[0] & 0x80) != 0;
+      type = block[0] & 0x7F;
+      len = ((uint32_t)block[1] << 16) | ((uint32_t)block[2] << 8) | (uint32_t)block[3];
+      pos += 4;
+
+      if (type == 0 && len >= sizeof(si))
+      {
+         if (probe_bytes(fd, head, (size_t)got, pos, si, sizeof(si)))
+         {
+            goto error;
+         }
+         has_info = true;
+      }
+      else if (type == 4)
+      {
+         size_t n = len < PROBE_COMMENT_MAX ? len : PROBE_COMMENT_MAX;
+
+         comment = (unsigned char*)malloc(n);
+         if (comment != NULL)
+         {
+            if (!probe_bytes(fd, head, (size_t)got, pos, comment, n))
+            {
+               probe_vorbis_comment(comment, n, fm);
+            }
+            free(comment);
+            comment = NULL;
+         }
+         break;
+      }
+      else if (type == 127)
+      {
+         break;
+      }
+
+      pos += len;
+   }
+
+   if (!has_info)
+   {
+      goto error;
+   }
+
+   /* STREAMINFO: 20 bits rate, 3 bits channels - 1, 5 bits bits - 1, 36 bits samples */
+   fm->sample_rate = ((uint32_t)si[10] << 12) | ((uint32_t)si[11] << 4) | ((uint32_t)si[12] >> 4);
+   fm->pcm_rate = fm->sample_rate;
+   fm->channels = ((si[12] >> 1) & 0x07) + 1;
+
+   bits = (((si[12] & 0x01) << 4) | (si[13] >> 4)) + 1;
+   if (bits == 16)
+   {
+      fm->format = FORMAT_16;
+      fm->bits_per_sample = 16;
+   }
+   else if (bits == 24)
+   {
+      fm->format = FORMAT_24;
+      fm->bits_per_sample = 24;
+   }
+   else if (bits == 32)
+   {
+      fm->format = FORMAT_32;
+      fm->bits_per_sample = 32;
+   }
+
+   fm->total_samples = (unsigned long)(((uint64_t)(si[13] & 0x0F) << 32) | id3_be_u32(&si[14]));
+   fm->duration = fm->sample_rate > 0 ? (double)fm->total_samples / fm->sample_rate : 0.0;
+
+   close(fd);
+
+   *file_metadata = fm;
+
+   return 0;
+
+error:
+
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+
+   free(comment);
+   free(fm);
+
+   return 1;
+}
+
+static int
+get_metadata_mp3(char* filename, struct file_metadata** file_metadata)
+{
+   static const unsigned int bitrates[2][16] = {
+      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+   };
+   static const unsigned int rates[3] = {44100, 48000, 32000};
+   int fd = -1;
+   ssize_t got = 0;
+   uint64_t base = 0;
+   uint64_t audio = 0;
+   size_t i = 0;
+   bool found = false;
+   unsigned char head[PROBE_SIZE];
+   unsigned char* frame = NULL;
+   bool mpeg1 = false;
+   unsigned int bitrate = 0;
+   unsigned int rate = 0;
+   unsigned int channels = 0;
+   unsigned int spf = 0;
+   size_t frame_size = 0;
+   size_t side = 0;
+   size_t avail = 0;
+   size_t x = 0;
+   uint64_t frames = 0;
+   uint64_t skip = 0;
+   struct file_metadata* fm = NULL;
+
+   *file_metadata = NULL;
+
+   if (init_metadata(filename, TYPE_MP3, &fm))
+   {
+      goto error;
+   }
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      goto error;
+   }
+
+   got = pread(fd, head, sizeof(head), 0);
+   if (got < 4)
+   {
+      goto error;
+   }
+
+   if (got >= 10 && !memcmp(head, "ID3", 3))
+   {
+      audio = 10 + (uint64_t)id3_synchsafe32(&head[6]) + ((head[5] & 0x10) ? 10 : 0);
+      parse_id3v2_buffer(head, (size_t)got, fm);
+   }
+
+   /* A large tag, say with cover art, pushes the first frame out of the head */
+   if (audio + PROBE_SIZE / 4 > (uint64_t)got && got == (ssize_t)sizeof(head))
+   {
+      got = pread(fd, head, sizeof(head), (off_t)audio);
+      if (got < 4)
+      {
+         goto error;
+      }
+      base = audio;
+   }
+
+   for (i = (size_t)(audio - base); i + 4 <= (size_t)got; i++)
+   {
+      unsigned char* h = &head[i];
+      unsigned int version;
+
+      /* Layer III with a valid bitrate and sample rate */
+      if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0 || ((h[1] >> 1) & 0x03) != 0x01)
+      {
+         continue;
+      }
+
+      version = (h[1] >> 3) & 0x03;
+      if (version == 1 || ((h[2] >> 4) & 0x0F) == 0 || ((h[2] >> 4) & 0x0F) == 0x0F || ((h[2] >> 2) & 0x03) == 0x03)
+      {
+         continue;
+      }
+
+      mpeg1 = version == 3;
+      bitrate = bitrates[mpeg1 ? 1 : 0][(h[2] >> 4) & 0x0F];
+      rate = rates[(h[2] >> 2) & 0x03] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+      channels = ((h[3] >> 6) & 0x03) == 0x03 ? 1 : 2;
+      spf = mpeg1 ? 1152 : 576;
+      frame_size = (size_t)((mpeg1 ? 144 : 72) * bitrate * 1000 / rate) + ((h[2] >> 1) & 0x01);
+
+      /* The next frame has to follow when it is inside the head */
+      if (i + frame_size + 2 <= (size_t)got &&
+          (head[i + frame_size] != 0xFF || (head[i + frame_size + 1] & 0xE0) != 0xE0))
+      {
+         continue;
+      }
+
+      found = true;
+      break;
+   }
+
+   if (!found)
+   {
+      goto error;
+   }
+
+   frame = &head[i];
+
+   side = mpeg1 ? (channels == 1 ? 17 : 32) : (channels == 1 ? 9 : 17);
+   avail = (size_t)got - i;
+   x = 4 + side;
+
+   if (x + 8 <= avail && (!memcmp(&frame[x], "Xing", 4) || !memcmp(&frame[x], "Info", 4)))
+   {
+      uint32_t flags = id3_be_u32(&frame[x + 4]);
+      size_t p = x + 8;
+
+      if ((flags & 0x01) && p + 4 <= avail)
+      {
+         frames = id3_be_u32(&frame[p]);
+         p += 4;
+      }
+      p += (flags & 0x02) ? 4 : 0;
+      p += (flags & 0x04) ? 100 : 0;
+      p += (flags & 0x08) ? 4 : 0;
+
+      /* The LAME tag carries the encoder delay and padding */
+      if (p + 24 <= avail &&
+          (!memcmp(&frame[p], "LAME", 4) || !memcmp(&frame[p], "Lavf", 4) || !memcmp(&frame[p], "Lavc", 4)))
+      {
+         skip = ((uint64_t)frame[p + 21] << 4) | (frame[p + 22] >> 4);
+         skip += ((uint64_t)(frame[p + 22] & 0x0F) << 8) | frame[p + 23];
+      }
+   }
+   else if (36 + 18 <= avail && !memcmp(&frame[36], "VBRI", 4))
+   {
+      frames = id3_be_u32(&frame[36 + 14]);
+   }
+
+   fm->format = FORMAT_16;
+   fm->bits_per_sample = 16;
+   fm->sample_rate = rate;
+   fm->pcm_rate = rate;
+   fm->channels = channels;
+
+   if (frames > 0)
+   {
+      uint64_t samples = frames * spf;
+      fm->total_samples = (unsigned long)(samples > skip ? samples - skip : samples);
+   }
+   else if (fm->file_size > base + i)
+   {
+      /* Constant bitrate */
+      double seconds = (double)(fm->file_size - (base + i)) * 8.0 / ((double)bitrate * 1000.0);
+      fm->total_samples = (unsigned long)(seconds * rate);
+   }
+   fm->duration = (double)fm->total_samples / rate;
+
+   close(fd);
+
+   *file_metadata = fm;
+
+   return 0;
+
+error:
+
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+
+   free(fm);
+
+   return 1;
+}
+
 static int
 get_metadata_dsf(char* filename, struct file_metadata** file_metadata)
 {
@@ -1390,7 +2029,7 @@ get_metadata_mkv(char* filename, struct file_metadata** file_metadata)
    struct file_metadata* fm = NULL;
    MkvDemuxer* demux = NULL;
    MkvAudioInfo ai;
-   uint64_t total_bytes = 0;
+   uint64_t duration_ns = 0;
 
    *file_metadata = NULL;
 
@@ -1464,22 +2103,11 @@ get_metadata_mkv(char* filename, struct file_metadata** file_metadata)
 
    fm->pcm_rate = fm->sample_rate;
 
-   /* Pre-scan to compute duration and total samples (post-decode for Opus/AAC). */
-   while (1)
+   /* Duration from the container, the packets are never decoded here */
+   if (hrmp_mkv_get_duration(demux, &duration_ns) < 0)
    {
-      MkvPacket pkt = {0};
-      int got = hrmp_mkv_read_packet(demux, &pkt);
-      if (got < 0)
-      {
-         hrmp_log_error("MKV: error during metadata scan");
-         goto error;
-      }
-      if (got == 0)
-      {
-         break; /* end */
-      }
-      total_bytes += (uint64_t)pkt.size;
-      hrmp_mkv_free_packet(&pkt);
+      hrmp_log_error("MKV: could not determine duration '%s'", filename);
+      goto error;
    }
 
    if (fm->channels > 0 && fm->bits_per_sample > 0)
@@ -1490,11 +2118,11 @@ get_metadata_mkv(char* filename, struct file_metadata** file_metadata)
       {
          goto error;
       }
-      fm->total_samples = (unsigned long)(total_bytes / bytes_per_frame);
+      fm->total_samples = (unsigned long)(((double)duration_ns * (double)fm->sample_rate) / 1000000000.0 + 0.5);
       fm->duration = (fm->sample_rate > 0)
                         ? (double)((double)fm->total_samples / (double)fm->sample_rate)
                         : 0.0;
-      fm->data_size = (unsigned long)total_bytes;
+      fm->data_size = (unsigned long)((uint64_t)fm->total_samples * bytes_per_frame);
    }
 
    fm->file_size = hrmp_get_file_size(filename);
@@ -0,0 +1,627 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <files.h>
+#include <logging.h>
+#include <metacache.h>
+#include <utils.h>
+
+/* system */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define METACACHE_MAGIC   "HRMPMETA"
+#define METACACHE_VERSION 1
+#define METACACHE_STRINGS 6
+
+/* The file starts with a header followed by each record and its strings:
+ * the path, title, artist, album, genre and date, each NUL terminated */
+struct header
+{
+   char magic[8];        /**< METACACHE_MAGIC */
+   uint32_t version;     /**< METACACHE_VERSION */
+   uint32_t record_size; /**< The size of a record */
+   uint64_t count;       /**< The number of records */
+};
+
+struct record
+{
+   uint64_t ino;             /**< The inode */
+   uint64_t size;            /**< The file size */
+   int64_t mtime;            /**< The modification time in nanoseconds */
+   uint64_t file_size;       /**< The file size seen by the parser */
+   uint64_t total_samples;   /**< The total number of samples */
+   uint64_t data_size;       /**< The data size */
+   double duration;          /**< The number of seconds */
+   int32_t type;             /**< The type of file */
+   int32_t format;           /**< The format of the file */
+   uint32_t sample_rate;     /**< The sample rate */
+   uint32_t pcm_rate;        /**< The PCM rate */
+   uint32_t channels;        /**< The number of channels */
+   uint32_t bits_per_sample; /**< The bits per sample */
+   int32_t alsa_snd;         /**< The ALSA sound identifier */
+   int32_t container;        /**< The container size */
+   uint32_t block_size;      /**< The block size */
+   int32_t track;            /**< The track number */
+   int32_t disc;             /**< The disc number */
+   uint32_t dop;             /**< Was the PCM rate of a DSD file derived for DoP */
+   uint32_t age;             /**< The number of updates of the cache since the record was used */
+   uint32_t length;          /**< The number of bytes of strings */
+};
+
+struct entry
+{
+   struct entry* chain;  /**< The next entry in the bucket */
+   uint32_t hash;        /**< The hash of the path */
+   bool used;            /**< Was the entry used in this run */
+   struct record record; /**< The record */
+   char strings[];       /**< The strings, the path first */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct entry** buckets = NULL;
+static bool dirty = false;
+static uint64_t hits = 0;
+static uint64_t misses = 0;
+
+static uint32_t hash_path(char* path);
+static struct entry** find(char* path, uint32_t hash);
+static bool dop_rate(void);
+static char* cache_path(void);
+static int load(char* path);
+static int count_strings(char* strings, uint32_t length);
+static int save(char* path);
+static void clear(void);
+
+int
+hrmp_metacache_open(void)
+{
+   char* path = NULL;
+
+   pthread_mutex_lock(&lock);
+
+   if (buckets == NULL)
+   {
+      buckets = (struct entry**)calloc(HRMP_METACACHE_BUCKETS, sizeof(struct entry*));
+      if (buckets == NULL)
+      {
+         pthread_mutex_unlock(&lock);
+         return 1;
+      }
+
+      path = cache_path();
+      if (path != NULL && load(path))
+      {
+         hrmp_log_debug("Metadata cache %s not loaded", path);
+         clear();
+      }
+      free(path);
+   }
+
+   dirty = false;
+   hits = 0;
+   misses = 0;
+
+   pthread_mutex_unlock(&lock);
+
+   return 0;
+}
+
+int
+hrmp_metacache_close(void)
+{
+   int ret = 0;
+   char* path = NULL;
+
+   pthread_mutex_lock(&lock);
+
+   if (buckets == NULL)
+   {
+      pthread_mutex_unlock(&lock);
+      return 0;
+   }
+
+   if (dirty)
+   {
+      path = cache_path();
+      if (path == NULL || save(path))
+      {
+         hrmp_log_debug("Metadata cache %s not written", path != NULL ? path : "");
+         ret = 1;
+      }
+      free(path);
+   }
+
+   clear();
+   free(buckets);
+   buckets = NULL;
+   dirty = false;
+
+   pthread_mutex_unlock(&lock);
+
+   return ret;
+}
+
+int
+hrmp_metacache_lookup(char* path, struct file_metadata** fm)
+{
+   struct stat st;
+   bool exists = false;
+   struct entry* e = NULL;
+   struct entry** link = NULL;
+   struct file_metadata* m = NULL;
+   char* s = NULL;
+
+   *fm = NULL;
+
+   /* The scan workers share the lock, so the file system is asked first */
+   exists = stat(path, &st) == 0;
+
+   m = (struct file_metadata*)malloc(sizeof(struct file_metadata));
+
+   pthread_mutex_lock(&lock);
+
+   if (buckets == NULL)
+   {
+      goto error;
+   }
+
+   if (!exists)
+   {
+      goto miss;
+   }
+
+   link = find(path, hash_path(path));
+   e = *link;
+   if (e == NULL)
+   {
+      goto miss;
+   }
+
+   if (e->record.ino != (uint64_t)st.st_ino ||
+       e->record.size != (uint64_t)st.st_size ||
+       e->record.mtime != (int64_t)st.st_mtim.tv_sec * 1000000000LL + (int64_t)st.st_mtim.tv_nsec ||
+       ((e->record.type == TYPE_DSF || e->record.type == TYPE_DFF) && e->record.dop != (uint32_t)dop_rate()))
+   {
+      /* The file changed, or the DSD rate depends on another device */
+      *link = e->chain;
+      free(e);
+      dirty = true;
+      goto miss;
+   }
+
+   if (m == NULL)
+   {
+      goto miss;
+   }
+   memset(m, 0, sizeof(struct file_metadata));
+
+   m->type = e->record.type;
+   m->format = e->record.format;
+   m->file_size = (size_t)e->record.file_size;
+   m->sample_rate = e->record.sample_rate;
+   m->pcm_rate = e->record.pcm_rate;
+   m->channels = e->record.channels;
+   m->bits_per_sample = e->record.bits_per_sample;
+   m->total_samples = (unsigned long)e->record.total_samples;
+   m->duration = e->record.duration;
+   m->alsa_snd = e->record.alsa_snd;
+   m->container = e->record.container;
+   m->block_size = e->record.block_size;
+   m->data_size = (unsigned long)e->record.data_size;
+   m->track = e->record.track;
+   m->disc = e->record.disc;
+
+   s = e->strings;
+   hrmp_snprintf(m->name, sizeof(m->name), "%s", s);
+   s += strlen(s) + 1;
+   hrmp_snprintf(m->title, sizeof(m->title), "%s", s);
+   s += strlen(s) + 1;
+   hrmp_snprintf(m->artist, sizeof(m->artist), "%s", s);
+   s += strlen(s) + 1;
+   hrmp_snprintf(m->album, sizeof(m->album), "%s", s);
+   s += strlen(s) + 1;
+   hrmp_snprintf(m->genre, sizeof(m->genre), "%s", s);
+   s += strlen(s) + 1;
+   hrmp_snprintf(m->date, sizeof(m->date), "%s", s);
+
+   e->used = true;
+   hits++;
+
+   pthread_mutex_unlock(&lock);
+
+   *fm = m;
+
+   return 0;
+
+miss:
+
+   misses++;
+
+error:
+
+   pthread_mutex_unlock(&lock);
+
+   free(m);
+
+   return 1;
+}
+
+void
+hrmp_metacache_insert(char* path, struct file_metadata* fm)
+{
+   struct stat st;
+   size_t lengths[METACACHE_STRINGS];
+   char* strings[METACACHE_STRINGS];
+   size_t length = 0;
+   uint32_t hash;
+   struct entry* e = NULL;
+   struct entry** link = NULL;
+   char* s = NULL;
+
+   if (fm == NULL || stat(path, &st) != 0)
+   {
+      return;
+   }
+
+   strings[0] = path;
+   strings[1] = fm->title;
+   strings[2] = fm->artist;
+   strings[3] = fm->album;
+   strings[4] = fm->genre;
+   strings[5] = fm->date;
+
+   for (int i = 0; i < METACACHE_STRINGS; i++)
+   {
+      lengths[i] = strnlen(strings[i], i == 0 ? MAX_PATH - 1 : MISC_LENGTH - 1);
+      length += lengths[i] + 1;
+   }
+
+   e = (struct entry*)malloc(sizeof(struct entry) + length);
+   if (e == NULL)
+   {
+      return;
+   }
+   memset(e, 0, sizeof(struct entry));
+
+   e->record.ino = (uint64_t)st.st_ino;
+   e->record.size = (uint64_t)st.st_size;
+   e->record.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + (int64_t)st.st_mtim.tv_nsec;
+   e->record.file_size = (uint64_t)fm->file_size;
+   e->record.total_samples = (uint64_t)fm->total_samples;
+   e->record.data_size = (uint64_t)fm->data_size;
+   e->record.duration = fm->duration;
+   e->record.type = fm->type;
+   e->record.format = fm->format;
+   e->record.sample_rate = fm->sample_rate;
+   e->record.pcm_rate = fm->pcm_rate;
+   e->record.channels = fm->channels;
+   e->record.bits_per_sample = fm->bits_per_sample;
+   e->record.alsa_snd = fm->alsa_snd;
+   e->record.container = fm->container;
+   e->record.block_size = fm->block_size;
+   e->record.track = fm->track;
+   e->record.disc = fm->disc;
+   e->record.length = (uint32_t)length;
+   e->used = true;
+
+   s = e->strings;
+   for (int i = 0; i < METACACHE_STRINGS; i++)
+   {
+      memcpy(s, strings[i], lengths[i]);
+      s[lengths[i]] = '\0';
+      s += lengths[i] + 1;
+   }
+
+   hash = hash_path(e->strings);
+   e->hash = hash;
+
+   pthread_mutex_lock(&lock);
+
+   if (buckets == NULL)
+   {
+      pthread_mutex_unlock(&lock);
+      free(e);
+      return;
+   }
+
+   e->record.dop = (uint32_t)dop_rate();
+
+   link = find(e->strings, hash);
+   if (*link != NULL)
+   {
+      struct entry* old = *link;
+
+      *link = old->chain;
+      free(old);
+   }
+
+   e->chain = buckets[hash % HRMP_METACACHE_BUCKETS];
+   buckets[hash % HRMP_METACACHE_BUCKETS] = e;
+   dirty = true;
+
+   pthread_mutex_unlock(&lock);
+}
+
+void
+hrmp_metacache_counters(uint64_t* hits_out, uint64_t* misses_out)
+{
+   pthread_mutex_lock(&lock);
+
+   *hits_out = hits;
+   *misses_out = misses;
+
+   pthread_mutex_unlock(&lock);
+}
+
+/* FNV-1a */
+static uint32_t
+hash_path(char* path)
+{
+   uint32_t h = 2166136261u;
+
+   for (unsigned char* p = (unsigned char*)path; *p != '\0'; p++)
+   {
+      h ^= *p;
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+/* The link that points to the entry of a path, or to NULL at the end of
+ * its bucket */
+static struct entry**
+find(char* path, uint32_t hash)
+{
+   struct entry** link = &buckets[hash % HRMP_METACACHE_BUCKETS];
+
+   while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->strings, path) != 0))
+   {
+      link = &(*link)->chain;
+   }
+
+   return link;
+}
+
+/* The PCM rate of a DSD file depends on DoP and on the active device */
+static bool
+dop_rate(void)
+{
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   return config->dop && (config->active_device.capabilities.s32 || config->active_device.capabilities.s32_le);
+}
+
+static char*
+cache_path(void)
+{
+   char* home = hrmp_get_home_directory();
+   char* path = NULL;
+
+   if (home == NULL)
+   {
+      return NULL;
+   }
+
+   path = hrmp_append(path, home);
+   path = hrmp_append(path, HRMP_METACACHE_FILE);
+
+   return path;
+}
+
+static int
+load(char* path)
+{
+   FILE* f = NULL;
+   struct header h;
+   struct record r;
+   struct entry* e = NULL;
+
+   f = fopen(path, "rb");
+   if (f == NULL)
+   {
+      /* No cache yet */
+      return errno == ENOENT ? 0 : 1;
+   }
+
+   if (fread(&h, sizeof(struct header), 1, f) != 1 ||
+       memcmp(h.magic, METACACHE_MAGIC, sizeof(h.magic)) != 0 ||
+       h.version != METACACHE_VERSION ||
+       h.record_size != sizeof(struct record))
+   {
+      goto error;
+   }
+
+   for (uint64_t i = 0; i < h.count; i++)
+   {
+      if (fread(&r, sizeof(struct record), 1, f) != 1 ||
+          r.length < METACACHE_STRINGS || r.length > MAX_PATH + (METACACHE_STRINGS - 1) * MISC_LENGTH)
+      {
+         goto error;
+      }
+
+      e = (struct entry*)malloc(sizeof(struct entry) + r.length);
+      if (e == NULL)
+      {
+         goto error;
+      }
+
+      e->record = r;
+      e->used = false;
+      if (fread(e->strings, 1, r.length, f) != r.length || e->strings[r.length - 1] != '\0')
+      {
+         goto error;
+      }
+
+      /* A lookup walks over exactly METACACHE_STRINGS strings */
+      if (count_strings(e->strings, r.length) != METACACHE_STRINGS)
+      {
+         goto error;
+      }
+
+      e->hash = hash_path(e->strings);
+      e->chain = buckets[e->hash % HRMP_METACACHE_BUCKETS];
+      buckets[e->hash % HRMP_METACACHE_BUCKETS] = e;
+      e = NULL;
+   }
+
+   fclose(f);
+
+   return 0;
+
+error:
+
+   free(e);
+   fclose(f);
+
+   return 1;
+}
+
+static int
+count_strings(char* strings, uint32_t length)
+{
+   int count = 0;
+
+   for (uint32_t i = 0; i < length; i++)
+   {
+      if (strings[i] == '\0')
+      {
+         count++;
+      }
+   }
+
+   return count;
+}
+
+/* Write to a temporary file that replaces the cache, so a reader never sees
+ * a partial cache */
+static int
+save(char* path)
+{
+   FILE* f = NULL;
+   char* dir = NULL;
+   char* tmp = NULL;
+   char* slash = NULL;
+   struct header h;
+   bool ok = true;
+
+   dir = hrmp_append(dir, path);
+   tmp = hrmp_append(tmp, path);
+   tmp = hrmp_append(tmp, ".tmp");
+   if (dir == NULL || tmp == NULL)
+   {
+      goto error;
+   }
+
+   slash = strrchr(dir, '/');
+   if (slash != NULL && slash != dir)
+   {
+      *slash = '\0';
+      if (hrmp_mkdir(dir))
+      {
+         goto error;
+      }
+   }
+
+   memset(&h, 0, sizeof(struct header));
+   memcpy(h.magic, METACACHE_MAGIC, sizeof(h.magic));
+   h.version = METACACHE_VERSION;
+   h.record_size = sizeof(struct record);
+
+   for (size_t i = 0; i < HRMP_METACACHE_BUCKETS; i++)
+   {
+      for (struct entry* e = buckets[i]; e != NULL; e = e->chain)
+      {
+         if (e->used || e->record.age < HRMP_METACACHE_MAX_AGE)
+         {
+            h.count++;
+         }
+      }
+   }
+
+   f = fopen(tmp, "wb");
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   ok = fwrite(&h, sizeof(struct header), 1, f) == 1;
+
+   for (size_t i = 0; ok && i < HRMP_METACACHE_BUCKETS; i++)
+   {
+      for (struct entry* e = buckets[i]; ok && e != NULL; e = e->chain)
+      {
+         struct record r = e->record;
+
+         if (!e->used && r.age >= HRMP_METACACHE_MAX_AGE)
+         {
+            continue;
+         }
+
+         r.age = e->used ? 0 : r.age + 1;
+
+         ok = fwrite(&r, sizeof(struct record), 1, f) == 1 &&
+              fwrite(e->strings, 1, r.length, f) == r.length;
+      }
+   }
+
+   if (fclose(f) != 0 || !ok || rename(tmp, path) != 0)
+   {
+      unlink(tmp);
+      goto error;
+   }
+
+   free(dir);
+   free(tmp);
+
+   return 0;
+
+error:
+
+   free(dir);
+   free(tmp);
+
+   return 1;
+}
+
+static void
+clear(void)
+{
+   for (size_t i = 0; i < HRMP_METACACHE_BUCKETS; i++)
+   {
+      while (buckets[i] != NULL)
+      {
+         struct entry* e = buckets[i];
+
+         buckets[i] = e->chain;
+         free(e);
+      }
+   }
+}
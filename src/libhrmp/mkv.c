@@ -18,7 +18,7 @@
 /* hrmp */
 #include <hrmp.h>
 #include <mkv.h>
-#include <ringbuffer.h>
+#include <prefetch.h>
 #include <utils.h>
 
 /* system */
@@ -35,7 +35,7 @@
 typedef struct
 {
    FILE* fp;
-   struct ringbuffer* rb;
+   struct prefetch* pf;
    uint64_t pos;
    uint64_t file_size;
    uint64_t* bytes_left;
@@ -43,8 +43,7 @@ typedef struct
 
 typedef struct PacketQueue PacketQueue;
 
-static void ebml_reader_init(EbmlReader* r, FILE* fp, struct ringbuffer* rb, uint64_t file_size, uint64_t* bytes_left);
-static void mkv_prefill_ringbuffer(EbmlReader* r);
+static void ebml_reader_init(EbmlReader* r, FILE* fp, struct prefetch* pf, uint64_t file_size, uint64_t* bytes_left);
 static uint64_t ebml_tell(EbmlReader* r);
 static int ebml_seek(EbmlReader* r, uint64_t pos);
 static long ebml_read(EbmlReader* r, void* dst, size_t size);
@@ -70,6 +69,9 @@ static int init_aac_decoder(MkvDemuxer* m);
 static int init_aac_from_codec_private(MkvDemuxer* m, const uint8_t* cp, size_t cpsize);
 static int aac_decode_packet(MkvDemuxer* m, const uint8_t* pkt, size_t pkt_sz, uint8_t** out, size_t* out_bytes);
 static int parse_info(MkvDemuxer* m, uint64_t elem_end);
+static int parse_seekhead(MkvDemuxer* m, uint64_t elem_end);
+static int read_cues(MkvDemuxer* m, uint64_t* cluster_pos, uint64_t* cue_time);
+static int skim_clusters(MkvDemuxer* m, uint64_t start, int64_t* end_ticks);
 static int read_vint_from_mem(const uint8_t* p, const uint8_t* end, uint64_t* val, int allow_unknown, int* length);
 static int64_t clamp_i128_to_i64(__int128 v);
 static int enqueue_pcm_bytes(MkvDemuxer* m, const uint8_t* pcm, size_t bytes, int64_t pts_ns, int keyframe);
@@ -86,6 +88,17 @@ static int parse_header_and_segment(MkvDemuxer* m);
 #define ID_SEGMENT         0x18538067u
 #define ID_INFO            0x1549A966u
 #define ID_TIMECODESCALE   0x2AD7B1u
+#define ID_DURATION        0x4489u
+#define ID_SEEKHEAD        0x114D9B74u
+#define ID_SEEK            0x4DBBu
+#define ID_SEEKID          0x53ABu
+#define ID_SEEKPOSITION    0x53ACu
+#define ID_CUES            0x1C53BB6Bu
+#define ID_CUEPOINT        0xBBu
+#define ID_CUETIME         0xB3u
+#define ID_CUETRACKPOS     0xB7u
+#define ID_CUETRACK        0xF7u
+#define ID_CUECLUSTERPOS   0xF1u
 #define ID_TRACKS          0x1654AE6Bu
 #define ID_TRACKENTRY      0xAEu
 #define ID_TRACKNUMBER     0xD7u
@@ -102,6 +115,7 @@ static int parse_header_and_segment(MkvDemuxer* m);
 #define ID_SIMPLEBLOCK     0xA3u
 #define ID_BLOCKGROUP      0xA0u
 #define ID_BLOCK           0xA1u
+#define ID_BLOCKDURATION   0x9Bu
 
 #define TRACK_TYPE_VIDEO   1
 #define TRACK_TYPE_AUDIO   2
@@ -158,9 +172,12 @@ struct MkvDemuxer
    /* Segment parsing */
    uint64_t segment_start;
    uint64_t segment_size; /* may be (uint64_t)-1 (unknown) */
+   uint64_t data_start;   /* first element after Info and Tracks */
+   uint64_t cues_pos;     /* relative to segment_start, 0 if unknown */
 
    /* Info */
    uint64_t timecode_scale_ns; /* default 1ms = 1,000,000 ns */
+   double duration;            /* in ticks, 0 if absent */
 
    /* Selected audio track */
    uint64_t track_number; /* match against Block track number */
@@ -236,33 +253,37 @@ hrmp_mkv_open_path(const char* path, MkvDemuxer** out)
 }
 
 int
-hrmp_mkv_open_path_rb(const char* path, struct ringbuffer* rb, uint64_t file_size, uint64_t* bytes_left, MkvDemuxer** out)
+hrmp_mkv_open_path_prefetch(const char* path, struct prefetch* pf, uint64_t file_size, uint64_t* bytes_left, MkvDemuxer** out)
 {
+   FILE* fp = NULL;
+
    if (!path || !out)
    {
       return -1;
    }
-   FILE* fp = fopen(path, "rb");
-   if (!fp)
-   {
-      return -1;
-   }
-   if (rb != NULL)
+   if (pf == NULL)
    {
-      hrmp_ringbuffer_reset(rb);
+      fp = fopen(path, "rb");
+      if (!fp)
+      {
+         return -1;
+      }
    }
 
    MkvDemuxer* m = (MkvDemuxer*)calloc(1, sizeof(*m));
    if (!m)
    {
-      fclose(fp);
+      if (fp)
+      {
+         fclose(fp);
+      }
       return -1;
    }
 
-   ebml_reader_init(&m->r, fp, rb, file_size, bytes_left);
+   ebml_reader_init(&m->r, fp, pf, file_size, bytes_left);
    m->timecode_scale_ns = 1000000ULL;
    pq_init(&m->q);
-   m->own_fp = 1;
+   m->own_fp = fp != NULL;
 
    if (parse_header_and_segment(m) < 0 || m->track_number == 0)
    {
@@ -388,75 +409,86 @@ hrmp_mkv_read_packet(MkvDemuxer* m, MkvPacket* packet)
    }
 }
 
-static void
-ebml_reader_init(EbmlReader* r, FILE* fp, struct ringbuffer* rb, uint64_t file_size, uint64_t* bytes_left)
+int
+hrmp_mkv_get_duration(MkvDemuxer* m, uint64_t* duration_ns)
 {
-   r->fp = fp;
-   r->rb = rb;
-#if defined(_WIN32) || defined(_WIN64)
-   r->pos = (uint64_t)_ftelli64(fp);
-#else
-   r->pos = (uint64_t)ftello(fp);
-#endif
-   r->file_size = file_size;
-   r->bytes_left = bytes_left;
-   if (r->bytes_left != NULL && r->file_size > 0)
+   if (!m || !m->opened || !duration_ns)
    {
-      *r->bytes_left = (r->pos <= r->file_size) ? (r->file_size - r->pos) : 0;
+      return -1;
    }
-}
 
-static void
-mkv_prefill_ringbuffer(EbmlReader* r)
-{
-   if (!r || !r->rb || !r->fp)
+   uint64_t pos = ebml_tell(&m->r);
+   int64_t ticks = 0;
+
+   *duration_ns = 0;
+
+   if (m->duration > 0.0)
    {
-      return;
+      /* Segment Info/Duration */
+      *duration_ns = (uint64_t)(m->duration * (double)m->timecode_scale_ns + 0.5);
+      return 0;
    }
 
-   size_t target = r->rb->max;
-   if (r->file_size > 0)
+   uint64_t cluster_pos = 0;
+   uint64_t cue_time = 0;
+   if (m->cues_pos > 0 && read_cues(m, &cluster_pos, &cue_time) == 0)
    {
-      off_t pos = ftello(r->fp);
-      if (pos >= 0 && (uint64_t)pos <= r->file_size)
+      /* Only the cluster holding the last cue point is left to skim */
+      ticks = (int64_t)cue_time;
+      if (cluster_pos > 0)
       {
-         uint64_t remaining = r->file_size - (uint64_t)pos;
-         if (remaining < target)
+         int64_t end = 0;
+         if (skim_clusters(m, m->segment_start + cluster_pos, &end) == 0 && end > ticks)
          {
-            target = (size_t)remaining;
+            ticks = end;
          }
       }
    }
-   if (target < r->rb->min)
+
+   if (ticks <= 0)
    {
-      target = r->rb->min;
+      if (skim_clusters(m, m->data_start, &ticks) < 0)
+      {
+         ticks = 0;
+      }
    }
 
-   size_t cur = hrmp_ringbuffer_size(r->rb);
-   if (target > cur)
+   if (ebml_seek(&m->r, pos) < 0)
    {
-      (void)hrmp_ringbuffer_ensure_write(r->rb, target - cur);
+      return -1;
    }
 
-   while (hrmp_ringbuffer_size(r->rb) < hrmp_ringbuffer_capacity(r->rb))
+   if (ticks <= 0)
    {
-      void* wp = NULL;
-      size_t span = hrmp_ringbuffer_get_write_span(r->rb, &wp);
-      if (span == 0)
-      {
-         break;
-      }
+      return -1;
+   }
 
-      size_t got = fread(wp, 1, span, r->fp);
-      if (got == 0)
-      {
-         break;
-      }
+   *duration_ns = (uint64_t)clamp_i128_to_i64((__int128)ticks * (__int128)m->timecode_scale_ns);
+   return 0;
+}
 
-      if (hrmp_ringbuffer_produce(r->rb, got))
-      {
-         break;
-      }
+static void
+ebml_reader_init(EbmlReader* r, FILE* fp, struct prefetch* pf, uint64_t file_size, uint64_t* bytes_left)
+{
+   r->fp = fp;
+   r->pf = pf;
+   if (pf != NULL)
+   {
+      r->pos = hrmp_prefetch_tell(pf);
+   }
+   else
+   {
+#if defined(_WIN32) || defined(_WIN64)
+      r->pos = (uint64_t)_ftelli64(fp);
+#else
+      r->pos = (uint64_t)ftello(fp);
+#endif
+   }
+   r->file_size = file_size;
+   r->bytes_left = bytes_left;
+   if (r->bytes_left != NULL && r->file_size > 0)
+   {
+      *r->bytes_left = (r->pos <= r->file_size) ? (r->file_size - r->pos) : 0;
    }
 }
 
@@ -469,23 +501,29 @@ ebml_tell(EbmlReader* r)
 static int
 ebml_seek(EbmlReader* r, uint64_t pos)
 {
-#if defined(_WIN32) || defined(_WIN64)
-   if (_fseeki64(r->fp, (long long)pos, SEEK_SET) != 0)
+   if (r->pf != NULL)
    {
-      return -1;
+      if (hrmp_prefetch_seek(r->pf, pos))
+      {
+         return -1;
+      }
    }
-#else
-   if (fseeko(r->fp, (off_t)pos, SEEK_SET) != 0)
+   else
    {
-      return -1;
-   }
+#if defined(_WIN32) || defined(_WIN64)
+      if (_fseeki64(r->fp, (long long)pos, SEEK_SET) != 0)
+      {
+         return -1;
+      }
+#else
+      if (fseeko(r->fp, (off_t)pos, SEEK_SET) != 0)
+      {
+         return -1;
+      }
 #endif
+   }
 
    r->pos = pos;
-   if (r->rb != NULL)
-   {
-      hrmp_ringbuffer_reset(r->rb);
-   }
    if (r->bytes_left != NULL && r->file_size > 0)
    {
       *r->bytes_left = (r->pos <= r->file_size) ? (r->file_size - r->pos) : 0;
@@ -504,7 +542,7 @@ ebml_read(EbmlReader* r, void* dst, size_t size)
 
    size_t n = 0;
 
-   if (r->rb == NULL)
+   if (r->pf == NULL)
    {
       n = fread(dst, 1, size, r->fp);
       if (n != size && ferror(r->fp))
@@ -514,52 +552,7 @@ ebml_read(EbmlReader* r, void* dst, size_t size)
    }
    else
    {
-      mkv_prefill_ringbuffer(r);
-      uint8_t* out = (uint8_t*)dst;
-      while (n < size)
-      {
-         void* rp = NULL;
-         size_t have = hrmp_ringbuffer_peek(r->rb, &rp);
-         if (have > 0)
-         {
-            size_t take = (size - n) < have ? (size - n) : have;
-            memcpy(out + n, rp, take);
-            hrmp_ringbuffer_consume(r->rb, take);
-            n += take;
-            mkv_prefill_ringbuffer(r);
-            continue;
-         }
-
-         if (hrmp_ringbuffer_ensure_write(r->rb, 1))
-         {
-            return -1;
-         }
-
-         void* wp = NULL;
-         size_t span = hrmp_ringbuffer_get_write_span(r->rb, &wp);
-         if (span == 0)
-         {
-            if (hrmp_ringbuffer_ensure_write(r->rb, hrmp_ringbuffer_capacity(r->rb) / 2u))
-            {
-               return -1;
-            }
-            continue;
-         }
-
-         size_t got = fread(wp, 1, span, r->fp);
-         if (got == 0)
-         {
-            if (ferror(r->fp))
-            {
-               return -1;
-            }
-            break;
-         }
-         if (hrmp_ringbuffer_produce(r->rb, got))
-         {
-            return -1;
-         }
-      }
+      n = hrmp_prefetch_read(r->pf, dst, size);
    }
 
    r->pos += (uint64_t)n;
@@ -1255,6 +1248,18 @@ parse_info(MkvDemuxer* m, uint64_t elem_end)
             m->timecode_scale_ns = scale;
          }
       }
+      else if (id == ID_DURATION)
+      {
+         double d = 0.0;
+         if (ebml_read_float(&m->r, size, &d) < 0)
+         {
+            return -1;
+         }
+         if (d > 0.0)
+         {
+            m->duration = d;
+         }
+      }
       else
       {
          if (size == (uint64_t)-1)
@@ -1270,6 +1275,285 @@ parse_info(MkvDemuxer* m, uint64_t elem_end)
    return 0;
 }
 
+static int
+parse_seekhead(MkvDemuxer* m, uint64_t elem_end)
+{
+   while (1)
+   {
+      if (elem_end && ebml_tell(&m->r) >= elem_end)
+      {
+         break;
+      }
+      uint32_t id;
+      uint64_t size;
+      if (ebml_read_element_header(&m->r, &id, &size) < 0)
+      {
+         return -1;
+      }
+      if (size == (uint64_t)-1)
+      {
+         return 0;
+      }
+      if (id != ID_SEEK)
+      {
+         if (ebml_skip(&m->r, size) < 0)
+         {
+            return -1;
+         }
+         continue;
+      }
+
+      uint64_t seek_end = ebml_tell(&m->r) + size;
+      uint64_t seek_id = 0;
+      uint64_t seek_pos = 0;
+      while (ebml_tell(&m->r) < seek_end)
+      {
+         uint32_t sid;
+         uint64_t ssz;
+         if (ebml_read_element_header(&m->r, &sid, &ssz) < 0 || ssz == (uint64_t)-1)
+         {
+            return -1;
+         }
+         if (sid == ID_SEEKID)
+         {
+            if (ebml_read_uint(&m->r, ssz, &seek_id) < 0)
+            {
+               return -1;
+            }
+         }
+         else if (sid == ID_SEEKPOSITION)
+         {
+            if (ebml_read_uint(&m->r, ssz, &seek_pos) < 0)
+            {
+               return -1;
+            }
+         }
+         else if (ebml_skip(&m->r, ssz) < 0)
+         {
+            return -1;
+         }
+      }
+
+      if (seek_id == ID_CUES && seek_pos > 0)
+      {
+         m->cues_pos = seek_pos;
+      }
+   }
+   return 0;
+}
+
+static int
+read_cues(MkvDemuxer* m, uint64_t* cluster_pos, uint64_t* cue_time)
+{
+   uint32_t id;
+   uint64_t size;
+
+   *cluster_pos = 0;
+   *cue_time = 0;
+
+   if (ebml_seek(&m->r, m->segment_start + m->cues_pos) < 0)
+   {
+      return -1;
+   }
+   if (ebml_read_element_header(&m->r, &id, &size) < 0 || id != ID_CUES || size == (uint64_t)-1)
+   {
+      return -1;
+   }
+
+   uint64_t cues_end = ebml_tell(&m->r) + size;
+   int found = 0;
+   while (ebml_tell(&m->r) < cues_end)
+   {
+      if (ebml_read_element_header(&m->r, &id, &size) < 0 || size == (uint64_t)-1)
+      {
+         return -1;
+      }
+      if (id != ID_CUEPOINT)
+      {
+         if (ebml_skip(&m->r, size) < 0)
+         {
+            return -1;
+         }
+         continue;
+      }
+
+      uint64_t point_end = ebml_tell(&m->r) + size;
+      uint64_t time = 0;
+      uint64_t pos = 0;
+      int ours = 0;
+      while (ebml_tell(&m->r) < point_end)
+      {
+         uint32_t pid;
+         uint64_t psz;
+         if (ebml_read_element_header(&m->r, &pid, &psz) < 0 || psz == (uint64_t)-1)
+         {
+            return -1;
+         }
+         if (pid == ID_CUETIME)
+         {
+            if (ebml_read_uint(&m->r, psz, &time) < 0)
+            {
+               return -1;
+            }
+         }
+         else if (pid == ID_CUETRACKPOS)
+         {
+            uint64_t tp_end = ebml_tell(&m->r) + psz;
+            uint64_t track = 0;
+            uint64_t cpos = 0;
+            while (ebml_tell(&m->r) < tp_end)
+            {
+               uint32_t tid;
+               uint64_t tsz;
+               if (ebml_read_element_header(&m->r, &tid, &tsz) < 0 || tsz == (uint64_t)-1)
+               {
+                  return -1;
+               }
+               if (tid == ID_CUETRACK)
+               {
+                  if (ebml_read_uint(&m->r, tsz, &track) < 0)
+                  {
+                     return -1;
+                  }
+               }
+               else if (tid == ID_CUECLUSTERPOS)
+               {
+                  if (ebml_read_uint(&m->r, tsz, &cpos) < 0)
+                  {
+                     return -1;
+                  }
+               }
+               else if (ebml_skip(&m->r, tsz) < 0)
+               {
+                  return -1;
+               }
+            }
+            if (track == m->track_number)
+            {
+               ours = 1;
+               pos = cpos;
+            }
+         }
+         else if (ebml_skip(&m->r, psz) < 0)
+         {
+            return -1;
+         }
+      }
+
+      if (ours && time >= *cue_time)
+      {
+         *cue_time = time;
+         *cluster_pos = pos;
+         found = 1;
+      }
+   }
+
+   return found ? 0 : -1;
+}
+
+static int
+skim_clusters(MkvDemuxer* m, uint64_t start, int64_t* end_ticks)
+{
+   uint64_t segment_end = (m->segment_size == (uint64_t)-1) ? 0 : m->segment_start + m->segment_size;
+   int64_t cluster_tc = 0;
+   int64_t last_pts = 0;
+   int have_last = 0;
+   int last_ours = 0;
+
+   *end_ticks = 0;
+
+   if (ebml_seek(&m->r, start) < 0)
+   {
+      return -1;
+   }
+
+   /* Walk element headers only; Cluster and BlockGroup are entered, payloads are skipped */
+   while (1)
+   {
+      if (segment_end && ebml_tell(&m->r) >= segment_end)
+      {
+         break;
+      }
+      uint32_t id;
+      uint64_t size;
+      if (ebml_read_element_header(&m->r, &id, &size) < 0)
+      {
+         break;
+      }
+
+      if (id == ID_CLUSTER || id == ID_BLOCKGROUP)
+      {
+         continue;
+      }
+      if (size == (uint64_t)-1)
+      {
+         break;
+      }
+
+      if (id == ID_CLUSTERTIMECODE)
+      {
+         uint64_t tc = 0;
+         if (ebml_read_uint(&m->r, size, &tc) < 0)
+         {
+            break;
+         }
+         cluster_tc = (int64_t)tc;
+      }
+      else if (id == ID_SIMPLEBLOCK || id == ID_BLOCK)
+      {
+         /* Track number (up to 8 bytes) and the relative timecode */
+         uint8_t hdr[10];
+         size_t n = size < sizeof(hdr) ? (size_t)size : sizeof(hdr);
+         uint64_t track_no = 0;
+         int tlen = 0;
+
+         if (ebml_read(&m->r, hdr, n) != (long)n)
+         {
+            break;
+         }
+
+         last_ours = 0;
+         if (read_vint_from_mem(hdr, hdr + n, &track_no, 0, &tlen) == 0 &&
+             (size_t)tlen + 2 <= n && track_no == m->track_number)
+         {
+            int64_t pts = cluster_tc + (int16_t)((hdr[tlen] << 8) | hdr[tlen + 1]);
+
+            /* Without a BlockDuration the last block lasts as long as the one before it */
+            *end_ticks = (have_last && pts > last_pts) ? pts + (pts - last_pts) : pts;
+            last_pts = pts;
+            have_last = 1;
+            last_ours = 1;
+         }
+
+         if (ebml_skip(&m->r, size - n) < 0)
+         {
+            break;
+         }
+      }
+      else if (id == ID_BLOCKDURATION)
+      {
+         uint64_t d = 0;
+         if (ebml_read_uint(&m->r, size, &d) < 0)
+         {
+            break;
+         }
+         if (last_ours)
+         {
+            *end_ticks = last_pts + (int64_t)d;
+         }
+      }
+      else
+      {
+         if (ebml_skip(&m->r, size) < 0)
+         {
+            break;
+         }
+      }
+   }
+
+   return have_last ? 0 : -1;
+}
+
 static int
 read_vint_from_mem(const uint8_t* p, const uint8_t* end, uint64_t* val, int allow_unknown, int* length)
 {
@@ -2102,6 +2386,14 @@ parse_header_and_segment(MkvDemuxer* m)
          }
          got_tracks = 1;
       }
+      else if (id == ID_SEEKHEAD && size != (uint64_t)-1)
+      {
+         /* The SeekHead is only a hint, a broken one is skipped */
+         if (parse_seekhead(m, elem_end) < 0 && ebml_seek(&m->r, elem_end) < 0)
+         {
+            return -1;
+         }
+      }
       else
       {
          if (size == (uint64_t)-1)
@@ -2116,5 +2408,7 @@ parse_header_and_segment(MkvDemuxer* m)
       }
    }
 
+   m->data_start = ebml_tell(&m->r);
+
    return (m->track_number != 0) ? 0 : -1;
 }
@@ -0,0 +1,1286 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <logging.h>
+#include <pack.h>
+
+/* system */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PACK_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define PACK_NEON
+#include <arm_neon.h>
+#endif
+
+/* Kernels are kept per channel layout: mono, stereo and any other count */
+#define PACK_MONO    0
+#define PACK_STEREO  1
+#define PACK_MULTI   2
+#define PACK_LAYOUTS 3
+
+/* Largest self-check: frames, channels and bytes per sample */
+#define VERIFY_FRAMES   259
+#define VERIFY_CHANNELS 3
+#define VERIFY_GUARD    64
+
+struct pack_table
+{
+   char* name;
+   bool (*supported)(void);
+   hrmp_pack_kernel kernels[HRMP_PACK_OPS][PACK_LAYOUTS];
+   hrmp_pack_dsd_kernel dsd[HRMP_PACK_DSD_OPS];
+};
+
+static void pack_init(void);
+static const struct pack_table* table_at(int set);
+static int layout(unsigned int channels);
+static bool verify(int op, unsigned int channels, hrmp_pack_kernel kernel);
+static bool verify_dsd(int op, hrmp_pack_dsd_kernel kernel);
+static size_t in_bytes(int op);
+static size_t out_bytes(int op);
+
+static void scalar_s16(const void* in, unsigned int channels, size_t frames, uint8_t* out);
+static void scalar_s24_3(const void* in, unsigned int channels, size_t frames, uint8_t* out);
+static void scalar_s32(const void* in, unsigned int channels, size_t frames, uint8_t* out);
+static void scalar_s16_le(const void* in, unsigned int channels, size_t frames, uint8_t* out);
+static void scalar_s24_le(const void* in, unsigned int channels, size_t frames, uint8_t* out);
+static void scalar_dsd_dop(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker);
+static void scalar_dsd_u32_be(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker);
+static void scalar_dsd_u32_be_rev(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out,
+                                  uint8_t* marker);
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static hrmp_pack_kernel selected[HRMP_PACK_OPS][PACK_LAYOUTS];
+static char* selected_name[HRMP_PACK_OPS][PACK_LAYOUTS];
+static hrmp_pack_dsd_kernel selected_dsd[HRMP_PACK_DSD_OPS];
+static char* selected_dsd_name[HRMP_PACK_DSD_OPS];
+
+static bool
+always(void)
+{
+   return true;
+}
+
+static const struct pack_table scalar_table = {
+   "scalar", always,
+   {
+      {scalar_s16, scalar_s16, scalar_s16},
+      {scalar_s24_3, scalar_s24_3, scalar_s24_3},
+      {scalar_s32, scalar_s32, scalar_s32},
+      {scalar_s16_le, scalar_s16_le, scalar_s16_le},
+      {scalar_s24_le, scalar_s24_le, scalar_s24_le},
+   },
+   {scalar_dsd_dop, scalar_dsd_u32_be, scalar_dsd_u32_be_rev}
+};
+
+static inline void
+put16(uint8_t* p, int16_t v)
+{
+   p[0] = (uint8_t)(v & 0xFF);
+   p[1] = (uint8_t)((v >> 8) & 0xFF);
+}
+
+static inline void
+put24(uint8_t* p, int32_t v)
+{
+   p[0] = (uint8_t)(v & 0xFF);
+   p[1] = (uint8_t)((v >> 8) & 0xFF);
+   p[2] = (uint8_t)((v >> 16) & 0xFF);
+}
+
+static inline void
+put32(uint8_t* p, int32_t v)
+{
+   p[0] = (uint8_t)(v & 0xFF);
+   p[1] = (uint8_t)((v >> 8) & 0xFF);
+   p[2] = (uint8_t)((v >> 16) & 0xFF);
+   p[3] = (uint8_t)((v >> 24) & 0xFF);
+}
+
+static inline int32_t
+get24(const uint8_t* p)
+{
+   int32_t v = (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16));
+
+   if (p[2] & 0x80)
+   {
+      v |= (int32_t)0xFF000000;
+   }
+
+   return v;
+}
+
+static inline uint8_t
+bitrev8(uint8_t x)
+{
+   x = (x >> 4) | (x << 4);
+   x = ((x & 0xCC) >> 2) | ((x & 0x33) << 2);
+   x = ((x & 0xAA) >> 1) | ((x & 0x55) << 1);
+
+   return x;
+}
+
+static inline uint8_t
+next_marker(uint8_t m)
+{
+   return m == HRMP_PACK_DOP_MARKER_LSB ? HRMP_PACK_DOP_MARKER_MSB : HRMP_PACK_DOP_MARKER_LSB;
+}
+
+static inline int32_t
+mix32(const int32_t* in, unsigned int channels)
+{
+   int64_t acc = 0;
+
+   for (unsigned int ch = 0; ch < channels; ++ch)
+   {
+      acc += (int64_t)in[ch];
+   }
+
+   return (int32_t)(acc / (int64_t)channels);
+}
+
+/* Scalar reference kernels */
+
+static void
+scalar_s16(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+
+   for (size_t i = 0; i < frames; ++i, out += 4)
+   {
+      int32_t l;
+      int32_t r;
+
+      if (channels == 2)
+      {
+         l = src[i * 2];
+         r = src[i * 2 + 1];
+      }
+      else
+      {
+         l = r = mix32(src + i * channels, channels);
+      }
+
+      put16(out, (int16_t)(l >> 16));
+      put16(out + 2, (int16_t)(r >> 16));
+   }
+}
+
+static void
+scalar_s24_3(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+
+   for (size_t i = 0; i < frames; ++i, out += 6)
+   {
+      int32_t l;
+      int32_t r;
+
+      if (channels == 2)
+      {
+         l = src[i * 2];
+         r = src[i * 2 + 1];
+      }
+      else
+      {
+         l = r = mix32(src + i * channels, channels);
+      }
+
+      put24(out, l);
+      put24(out + 3, r);
+   }
+}
+
+static void
+scalar_s32(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+
+   for (size_t i = 0; i < frames; ++i, out += 8)
+   {
+      int32_t l;
+      int32_t r;
+
+      if (channels == 2)
+      {
+         l = src[i * 2];
+         r = src[i * 2 + 1];
+      }
+      else
+      {
+         l = r = mix32(src + i * channels, channels);
+      }
+
+      put32(out, l);
+      put32(out + 4, r);
+   }
+}
+
+static void
+scalar_s16_le(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const uint8_t* src = (const uint8_t*)in;
+
+   if (channels == 2)
+   {
+      memcpy(out, src, frames * 4);
+      return;
+   }
+
+   for (size_t i = 0; i < frames; ++i, out += 4)
+   {
+      int64_t acc = 0;
+
+      for (unsigned int ch = 0; ch < channels; ++ch)
+      {
+         const uint8_t* p = src + (i * channels + ch) * 2;
+         acc += (int64_t)(int16_t)(p[0] | (p[1] << 8));
+      }
+
+      int16_t s = (int16_t)(acc / (int64_t)channels);
+      put16(out, s);
+      put16(out + 2, s);
+   }
+}
+
+static void
+scalar_s24_le(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const uint8_t* src = (const uint8_t*)in;
+
+   if (channels == 2)
+   {
+      memcpy(out, src, frames * 6);
+      return;
+   }
+
+   for (size_t i = 0; i < frames; ++i, out += 6)
+   {
+      int64_t acc = 0;
+
+      for (unsigned int ch = 0; ch < channels; ++ch)
+      {
+         acc += (int64_t)get24(src + (i * channels + ch) * 3);
+      }
+
+      int32_t s = (int32_t)(acc / (int64_t)channels);
+      put24(out, s);
+      put24(out + 3, s);
+   }
+}
+
+static void
+scalar_dsd_dop(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   uint8_t m = *marker;
+
+   for (size_t i = 0; i < frames; ++i, out += 8)
+   {
+      /* Bit reverse and swap the byte pair */
+      out[0] = 0x00;
+      out[1] = bitrev8(left[i * 2 + 1]);
+      out[2] = bitrev8(left[i * 2]);
+      out[3] = m;
+      out[4] = 0x00;
+      out[5] = bitrev8(right[i * 2 + 1]);
+      out[6] = bitrev8(right[i * 2]);
+      out[7] = m;
+
+      m = next_marker(m);
+   }
+
+   *marker = m;
+}
+
+static void
+scalar_dsd_u32_be(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   (void)marker;
+
+   for (size_t i = 0; i < frames; ++i, out += 8)
+   {
+      memcpy(out, left + i * 4, 4);
+      memcpy(out + 4, right + i * 4, 4);
+   }
+}
+
+static void
+scalar_dsd_u32_be_rev(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   (void)marker;
+
+   for (size_t i = 0; i < frames; ++i, out += 8)
+   {
+      for (size_t b = 0; b < 4; b++)
+      {
+         out[b] = bitrev8(left[i * 4 + b]);
+         out[4 + b] = bitrev8(right[i * 4 + b]);
+      }
+   }
+}
+
+/* Little endian hosts only, so 32bit samples are already in device order */
+
+#if defined(PACK_X86) || defined(PACK_NEON)
+static void
+copy_s32(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   (void)channels;
+   memcpy(out, in, frames * 8);
+}
+#endif
+
+#if defined(PACK_X86)
+
+static bool
+has_sse2(void)
+{
+   return __builtin_cpu_supports("sse2");
+}
+
+static bool
+has_ssse3(void)
+{
+   return __builtin_cpu_supports("ssse3");
+}
+
+static bool
+has_avx2(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("sse2"))) static void
+sse2_s16_stereo(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t n = frames * 2;
+   size_t i = 0;
+
+   for (; i + 8 <= n; i += 8)
+   {
+      __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + i)), 16);
+      __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)), 16);
+
+      /* The shifted samples fit in 16 bits, so the saturation never applies */
+      _mm_storeu_si128((__m128i*)(out + i * 2), _mm_packs_epi32(a, b));
+   }
+
+   scalar_s16(src + i, channels, (n - i) / 2, out + i * 2);
+}
+
+__attribute__((target("sse2"))) static void
+sse2_s16_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      __m128i v = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + i)), 16);
+      __m128i p = _mm_packs_epi32(v, v);
+
+      _mm_storeu_si128((__m128i*)(out + i * 4), _mm_unpacklo_epi16(p, p));
+   }
+
+   scalar_s16(src + i, channels, frames - i, out + i * 4);
+}
+
+__attribute__((target("sse2"))) static void
+sse2_s32_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+      _mm_storeu_si128((__m128i*)(out + i * 8), _mm_unpacklo_epi32(v, v));
+      _mm_storeu_si128((__m128i*)(out + i * 8 + 16), _mm_unpackhi_epi32(v, v));
+   }
+
+   scalar_s32(src + i, channels, frames - i, out + i * 8);
+}
+
+__attribute__((target("sse2"))) static void
+sse2_s16_le_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const uint8_t* src = (const uint8_t*)in;
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 8)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+
+      _mm_storeu_si128((__m128i*)(out + i * 4), _mm_unpacklo_epi16(v, v));
+      _mm_storeu_si128((__m128i*)(out + i * 4 + 16), _mm_unpackhi_epi16(v, v));
+   }
+
+   scalar_s16_le(src + i * 2, channels, frames - i, out + i * 4);
+}
+
+/* Each store writes 4 bytes past the 12 that are kept; they are
+ * overwritten by the next store, and the loops stop early enough that
+ * the last one stays inside the output */
+
+__attribute__((target("ssse3"))) static void
+ssse3_s24_3_stereo(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+   size_t n = frames * 2;
+   size_t i = 0;
+
+   for (; i + 8 <= n; i += 4)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+      _mm_storeu_si128((__m128i*)(out + i * 3), _mm_shuffle_epi8(v, mask));
+   }
+
+   scalar_s24_3(src + i, channels, (n - i) / 2, out + i * 3);
+}
+
+__attribute__((target("ssse3"))) static void
+ssse3_s24_3_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 4)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+      _mm_storeu_si128((__m128i*)(out + i * 6), _mm_shuffle_epi8(_mm_unpacklo_epi32(v, v), mask));
+      _mm_storeu_si128((__m128i*)(out + i * 6 + 12), _mm_shuffle_epi8(_mm_unpackhi_epi32(v, v), mask));
+   }
+
+   scalar_s24_3(src + i, channels, frames - i, out + i * 6);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_s16_stereo(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t n = frames * 2;
+   size_t i = 0;
+
+   for (; i + 16 <= n; i += 16)
+   {
+      __m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(src + i)), 16);
+      __m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(src + i + 8)), 16);
+
+      /* packs works per 128bit lane, so put the quarters back in order */
+      __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+
+      _mm256_storeu_si256((__m256i*)(out + i * 2), p);
+   }
+
+   sse2_s16_stereo(src + i, channels, (n - i) / 2, out + i * 2);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_s16_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 8)
+   {
+      __m256i v = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(src + i)), 16);
+      __m256i p = _mm256_packs_epi32(v, v);
+
+      _mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_unpacklo_epi16(p, p));
+   }
+
+   sse2_s16_mono(src + i, channels, frames - i, out + i * 4);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_s32_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 8)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+      __m256i lo = _mm256_unpacklo_epi32(v, v);
+      __m256i hi = _mm256_unpackhi_epi32(v, v);
+
+      _mm256_storeu_si256((__m256i*)(out + i * 8), _mm256_permute2x128_si256(lo, hi, 0x20));
+      _mm256_storeu_si256((__m256i*)(out + i * 8 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+   }
+
+   sse2_s32_mono(src + i, channels, frames - i, out + i * 8);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_s16_le_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const uint8_t* src = (const uint8_t*)in;
+   size_t i = 0;
+
+   for (; i + 16 <= frames; i += 16)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 2));
+      __m256i lo = _mm256_unpacklo_epi16(v, v);
+      __m256i hi = _mm256_unpackhi_epi16(v, v);
+
+      _mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+      _mm256_storeu_si256((__m256i*)(out + i * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+   }
+
+   sse2_s16_le_mono(src + i * 2, channels, frames - i, out + i * 4);
+}
+
+/* DSD bits are reversed with two nibble lookups, and a shuffle swaps
+ * each DoP byte pair and spreads it into a 32bit word before the markers
+ * are or'ed in. A 16 byte store holds two frames, so the markers of
+ * every store alternate the same way */
+
+__attribute__((target("ssse3"))) static inline __m128i
+ssse3_bitrev(__m128i v)
+{
+   const __m128i hi = _mm_setr_epi8(0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF);
+   const __m128i lo = _mm_slli_epi16(hi, 4);
+   const __m128i nibble = _mm_set1_epi8(0x0F);
+
+   return _mm_or_si128(_mm_shuffle_epi8(lo, _mm_and_si128(v, nibble)),
+                       _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+}
+
+__attribute__((target("sse2"))) static void
+sse2_dsd_u32_be(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      __m128i l = _mm_loadu_si128((const __m128i*)(left + i * 4));
+      __m128i r = _mm_loadu_si128((const __m128i*)(right + i * 4));
+
+      _mm_storeu_si128((__m128i*)(out + i * 8), _mm_unpacklo_epi32(l, r));
+      _mm_storeu_si128((__m128i*)(out + i * 8 + 16), _mm_unpackhi_epi32(l, r));
+   }
+
+   scalar_dsd_u32_be(left + i * 4, right + i * 4, frames - i, out + i * 8, marker);
+}
+
+__attribute__((target("ssse3"))) static void
+ssse3_dsd_u32_be_rev(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      __m128i l = ssse3_bitrev(_mm_loadu_si128((const __m128i*)(left + i * 4)));
+      __m128i r = ssse3_bitrev(_mm_loadu_si128((const __m128i*)(right + i * 4)));
+
+      _mm_storeu_si128((__m128i*)(out + i * 8), _mm_unpacklo_epi32(l, r));
+      _mm_storeu_si128((__m128i*)(out + i * 8 + 16), _mm_unpackhi_epi32(l, r));
+   }
+
+   scalar_dsd_u32_be_rev(left + i * 4, right + i * 4, frames - i, out + i * 8, marker);
+}
+
+__attribute__((target("ssse3"))) static void
+ssse3_dsd_dop(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   const __m128i first = _mm_setr_epi8(-1, 1, 0, -1, -1, 3, 2, -1, -1, 5, 4, -1, -1, 7, 6, -1);
+   const __m128i second = _mm_setr_epi8(-1, 9, 8, -1, -1, 11, 10, -1, -1, 13, 12, -1, -1, 15, 14, -1);
+   uint8_t m = *marker;
+   uint8_t n = next_marker(m);
+   const __m128i markers = _mm_setr_epi8(0, 0, 0, (char)m, 0, 0, 0, (char)m, 0, 0, 0, (char)n, 0, 0, 0, (char)n);
+   size_t i = 0;
+
+   /* Whole vectors leave the marker as it was */
+   if (next_marker(n) == m)
+   {
+      for (; i + 8 <= frames; i += 8)
+      {
+         __m128i l = ssse3_bitrev(_mm_loadu_si128((const __m128i*)(left + i * 2)));
+         __m128i r = ssse3_bitrev(_mm_loadu_si128((const __m128i*)(right + i * 2)));
+         __m128i a = _mm_unpacklo_epi16(l, r);
+         __m128i b = _mm_unpackhi_epi16(l, r);
+
+         _mm_storeu_si128((__m128i*)(out + i * 8), _mm_or_si128(_mm_shuffle_epi8(a, first), markers));
+         _mm_storeu_si128((__m128i*)(out + i * 8 + 16), _mm_or_si128(_mm_shuffle_epi8(a, second), markers));
+         _mm_storeu_si128((__m128i*)(out + i * 8 + 32), _mm_or_si128(_mm_shuffle_epi8(b, first), markers));
+         _mm_storeu_si128((__m128i*)(out + i * 8 + 48), _mm_or_si128(_mm_shuffle_epi8(b, second), markers));
+      }
+   }
+
+   scalar_dsd_dop(left + i * 2, right + i * 2, frames - i, out + i * 8, marker);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+avx2_bitrev(__m256i v)
+{
+   const __m256i hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+                                                                0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF));
+   const __m256i lo = _mm256_slli_epi16(hi, 4);
+   const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+   return _mm256_or_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble)),
+                          _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+}
+
+/* The unpacks work per 128bit lane, so the lanes are put back in frame
+ * order when stored */
+
+__attribute__((target("avx2"))) static void
+avx2_dsd_u32_be(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 8)
+   {
+      __m256i l = _mm256_loadu_si256((const __m256i*)(left + i * 4));
+      __m256i r = _mm256_loadu_si256((const __m256i*)(right + i * 4));
+      __m256i a = _mm256_unpacklo_epi32(l, r);
+      __m256i b = _mm256_unpackhi_epi32(l, r);
+
+      _mm256_storeu_si256((__m256i*)(out + i * 8), _mm256_permute2x128_si256(a, b, 0x20));
+      _mm256_storeu_si256((__m256i*)(out + i * 8 + 32), _mm256_permute2x128_si256(a, b, 0x31));
+   }
+
+   scalar_dsd_u32_be(left + i * 4, right + i * 4, frames - i, out + i * 8, marker);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_dsd_u32_be_rev(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 8)
+   {
+      __m256i l = avx2_bitrev(_mm256_loadu_si256((const __m256i*)(left + i * 4)));
+      __m256i r = avx2_bitrev(_mm256_loadu_si256((const __m256i*)(right + i * 4)));
+      __m256i a = _mm256_unpacklo_epi32(l, r);
+      __m256i b = _mm256_unpackhi_epi32(l, r);
+
+      _mm256_storeu_si256((__m256i*)(out + i * 8), _mm256_permute2x128_si256(a, b, 0x20));
+      _mm256_storeu_si256((__m256i*)(out + i * 8 + 32), _mm256_permute2x128_si256(a, b, 0x31));
+   }
+
+   scalar_dsd_u32_be_rev(left + i * 4, right + i * 4, frames - i, out + i * 8, marker);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_dsd_dop(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   const __m256i first = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, 1, 0, -1, -1, 3, 2, -1,
+                                                                   -1, 5, 4, -1, -1, 7, 6, -1));
+   const __m256i second = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, 9, 8, -1, -1, 11, 10, -1,
+                                                                    -1, 13, 12, -1, -1, 15, 14, -1));
+   uint8_t m = *marker;
+   uint8_t n = next_marker(m);
+   const __m256i markers = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 0, 0, (char)m, 0, 0, 0, (char)m,
+                                                                     0, 0, 0, (char)n, 0, 0, 0, (char)n));
+   size_t i = 0;
+
+   if (next_marker(n) == m)
+   {
+      for (; i + 16 <= frames; i += 16)
+      {
+         __m256i l = avx2_bitrev(_mm256_loadu_si256((const __m256i*)(left + i * 2)));
+         __m256i r = avx2_bitrev(_mm256_loadu_si256((const __m256i*)(right + i * 2)));
+         __m256i a = _mm256_unpacklo_epi16(l, r);
+         __m256i b = _mm256_unpackhi_epi16(l, r);
+         __m256i a0 = _mm256_or_si256(_mm256_shuffle_epi8(a, first), markers);
+         __m256i a1 = _mm256_or_si256(_mm256_shuffle_epi8(a, second), markers);
+         __m256i b0 = _mm256_or_si256(_mm256_shuffle_epi8(b, first), markers);
+         __m256i b1 = _mm256_or_si256(_mm256_shuffle_epi8(b, second), markers);
+
+         _mm256_storeu_si256((__m256i*)(out + i * 8), _mm256_permute2x128_si256(a0, a1, 0x20));
+         _mm256_storeu_si256((__m256i*)(out + i * 8 + 32), _mm256_permute2x128_si256(b0, b1, 0x20));
+         _mm256_storeu_si256((__m256i*)(out + i * 8 + 64), _mm256_permute2x128_si256(a0, a1, 0x31));
+         _mm256_storeu_si256((__m256i*)(out + i * 8 + 96), _mm256_permute2x128_si256(b0, b1, 0x31));
+      }
+   }
+
+   scalar_dsd_dop(left + i * 2, right + i * 2, frames - i, out + i * 8, marker);
+}
+
+static const struct pack_table simd_tables[] = {
+   {
+      "avx2", has_avx2,
+      {
+         {avx2_s16_mono, avx2_s16_stereo, NULL},
+         {NULL, NULL, NULL},
+         {avx2_s32_mono, copy_s32, NULL},
+         {avx2_s16_le_mono, NULL, NULL},
+         {NULL, NULL, NULL},
+      },
+      {avx2_dsd_dop, avx2_dsd_u32_be, avx2_dsd_u32_be_rev}
+   },
+   {
+      "ssse3", has_ssse3,
+      {
+         {NULL, NULL, NULL},
+         {ssse3_s24_3_mono, ssse3_s24_3_stereo, NULL},
+         {NULL, NULL, NULL},
+         {NULL, NULL, NULL},
+         {NULL, NULL, NULL},
+      },
+      {ssse3_dsd_dop, NULL, ssse3_dsd_u32_be_rev}
+   },
+   {
+      "sse2", has_sse2,
+      {
+         {sse2_s16_mono, sse2_s16_stereo, NULL},
+         {NULL, NULL, NULL},
+         {sse2_s32_mono, copy_s32, NULL},
+         {sse2_s16_le_mono, NULL, NULL},
+         {NULL, NULL, NULL},
+      },
+      {NULL, sse2_dsd_u32_be, NULL}
+   },
+};
+
+#elif defined(PACK_NEON)
+
+static void
+neon_s16_stereo(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t n = frames * 2;
+   size_t i = 0;
+
+   for (; i + 8 <= n; i += 8)
+   {
+      int16x8_t p = vcombine_s16(vshrn_n_s32(vld1q_s32(src + i), 16),
+                                 vshrn_n_s32(vld1q_s32(src + i + 4), 16));
+
+      vst1q_u8(out + i * 2, vreinterpretq_u8_s16(p));
+   }
+
+   scalar_s16(src + i, channels, (n - i) / 2, out + i * 2);
+}
+
+static void
+neon_s16_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      int16x4_t s = vshrn_n_s32(vld1q_s32(src + i), 16);
+      int16x4x2_t z = vzip_s16(s, s);
+
+      vst1q_u8(out + i * 4, vreinterpretq_u8_s16(vcombine_s16(z.val[0], z.val[1])));
+   }
+
+   scalar_s16(src + i, channels, frames - i, out + i * 4);
+}
+
+/* Each store writes 4 bytes past the 12 that are kept; they are
+ * overwritten by the next store, and the loops stop early enough that
+ * the last one stays inside the output */
+
+static void
+neon_s24_3_stereo(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   static const uint8_t idx[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 255, 255, 255, 255};
+   const int32_t* src = (const int32_t*)in;
+   uint8x16_t mask = vld1q_u8(idx);
+   size_t n = frames * 2;
+   size_t i = 0;
+
+   for (; i + 8 <= n; i += 4)
+   {
+      uint8x16_t v = vreinterpretq_u8_s32(vld1q_s32(src + i));
+
+      vst1q_u8(out + i * 3, vqtbl1q_u8(v, mask));
+   }
+
+   scalar_s24_3(src + i, channels, (n - i) / 2, out + i * 3);
+}
+
+static void
+neon_s24_3_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   static const uint8_t idx[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 255, 255, 255, 255};
+   const int32_t* src = (const int32_t*)in;
+   uint8x16_t mask = vld1q_u8(idx);
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 4)
+   {
+      int32x4_t v = vld1q_s32(src + i);
+      int32x4x2_t z = vzipq_s32(v, v);
+
+      vst1q_u8(out + i * 6, vqtbl1q_u8(vreinterpretq_u8_s32(z.val[0]), mask));
+      vst1q_u8(out + i * 6 + 12, vqtbl1q_u8(vreinterpretq_u8_s32(z.val[1]), mask));
+   }
+
+   scalar_s24_3(src + i, channels, frames - i, out + i * 6);
+}
+
+static void
+neon_s32_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const int32_t* src = (const int32_t*)in;
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      int32x4_t v = vld1q_s32(src + i);
+      int32x4x2_t z = vzipq_s32(v, v);
+
+      vst1q_u8(out + i * 8, vreinterpretq_u8_s32(z.val[0]));
+      vst1q_u8(out + i * 8 + 16, vreinterpretq_u8_s32(z.val[1]));
+   }
+
+   scalar_s32(src + i, channels, frames - i, out + i * 8);
+}
+
+static void
+neon_s16_le_mono(const void* in, unsigned int channels, size_t frames, uint8_t* out)
+{
+   const uint8_t* src = (const uint8_t*)in;
+   size_t i = 0;
+
+   for (; i + 8 <= frames; i += 8)
+   {
+      uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(src + i * 2));
+      uint16x8x2_t z = vzipq_u16(v, v);
+
+      vst1q_u8(out + i * 4, vreinterpretq_u8_u16(z.val[0]));
+      vst1q_u8(out + i * 4 + 16, vreinterpretq_u8_u16(z.val[1]));
+   }
+
+   scalar_s16_le(src + i * 2, channels, frames - i, out + i * 4);
+}
+
+static void
+neon_dsd_u32_be(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      uint32x4x2_t z = vzipq_u32(vreinterpretq_u32_u8(vld1q_u8(left + i * 4)),
+                                 vreinterpretq_u32_u8(vld1q_u8(right + i * 4)));
+
+      vst1q_u8(out + i * 8, vreinterpretq_u8_u32(z.val[0]));
+      vst1q_u8(out + i * 8 + 16, vreinterpretq_u8_u32(z.val[1]));
+   }
+
+   scalar_dsd_u32_be(left + i * 4, right + i * 4, frames - i, out + i * 8, marker);
+}
+
+static void
+neon_dsd_u32_be_rev(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   size_t i = 0;
+
+   for (; i + 4 <= frames; i += 4)
+   {
+      uint32x4x2_t z = vzipq_u32(vreinterpretq_u32_u8(vrbitq_u8(vld1q_u8(left + i * 4))),
+                                 vreinterpretq_u32_u8(vrbitq_u8(vld1q_u8(right + i * 4))));
+
+      vst1q_u8(out + i * 8, vreinterpretq_u8_u32(z.val[0]));
+      vst1q_u8(out + i * 8 + 16, vreinterpretq_u8_u32(z.val[1]));
+   }
+
+   scalar_dsd_u32_be_rev(left + i * 4, right + i * 4, frames - i, out + i * 8, marker);
+}
+
+/* An out of range table index yields a zero byte */
+
+static void
+neon_dsd_dop(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   static const uint8_t first_index[16] = {0xFF, 1, 0, 0xFF, 0xFF, 3, 2, 0xFF, 0xFF, 5, 4, 0xFF, 0xFF, 7, 6, 0xFF};
+   static const uint8_t second_index[16] = {0xFF, 9, 8, 0xFF, 0xFF, 11, 10, 0xFF, 0xFF, 13, 12, 0xFF, 0xFF, 15, 14, 0xFF};
+   const uint8x16_t first = vld1q_u8(first_index);
+   const uint8x16_t second = vld1q_u8(second_index);
+   uint8_t m = *marker;
+   uint8_t n = next_marker(m);
+   uint8_t marker_bytes[16] = {0, 0, 0, m, 0, 0, 0, m, 0, 0, 0, n, 0, 0, 0, n};
+   const uint8x16_t markers = vld1q_u8(marker_bytes);
+   size_t i = 0;
+
+   if (next_marker(n) == m)
+   {
+      for (; i + 8 <= frames; i += 8)
+      {
+         uint16x8x2_t z = vzipq_u16(vreinterpretq_u16_u8(vrbitq_u8(vld1q_u8(left + i * 2))),
+                                    vreinterpretq_u16_u8(vrbitq_u8(vld1q_u8(right + i * 2))));
+         uint8x16_t a = vreinterpretq_u8_u16(z.val[0]);
+         uint8x16_t b = vreinterpretq_u8_u16(z.val[1]);
+
+         vst1q_u8(out + i * 8, vorrq_u8(vqtbl1q_u8(a, first), markers));
+         vst1q_u8(out + i * 8 + 16, vorrq_u8(vqtbl1q_u8(a, second), markers));
+         vst1q_u8(out + i * 8 + 32, vorrq_u8(vqtbl1q_u8(b, first), markers));
+         vst1q_u8(out + i * 8 + 48, vorrq_u8(vqtbl1q_u8(b, second), markers));
+      }
+   }
+
+   scalar_dsd_dop(left + i * 2, right + i * 2, frames - i, out + i * 8, marker);
+}
+
+static const struct pack_table simd_tables[] = {
+   {
+      "neon", always,
+      {
+         {neon_s16_mono, neon_s16_stereo, NULL},
+         {neon_s24_3_mono, neon_s24_3_stereo, NULL},
+         {neon_s32_mono, copy_s32, NULL},
+         {neon_s16_le_mono, NULL, NULL},
+         {NULL, NULL, NULL},
+      },
+      {neon_dsd_dop, neon_dsd_u32_be, neon_dsd_u32_be_rev}
+   },
+};
+
+#endif
+
+hrmp_pack_kernel
+hrmp_pack_select(int op, unsigned int channels)
+{
+   if (op < 0 || op >= HRMP_PACK_OPS || channels == 0)
+   {
+      return NULL;
+   }
+
+   pthread_once(&once, pack_init);
+
+   return selected[op][layout(channels)];
+}
+
+char*
+hrmp_pack_name(int op, unsigned int channels)
+{
+   if (op < 0 || op >= HRMP_PACK_OPS || channels == 0)
+   {
+      return "";
+   }
+
+   pthread_once(&once, pack_init);
+
+   return selected_name[op][layout(channels)];
+}
+
+hrmp_pack_dsd_kernel
+hrmp_pack_dsd_select(int op)
+{
+   if (op < 0 || op >= HRMP_PACK_DSD_OPS)
+   {
+      return NULL;
+   }
+
+   pthread_once(&once, pack_init);
+
+   return selected_dsd[op];
+}
+
+char*
+hrmp_pack_dsd_name(int op)
+{
+   if (op < 0 || op >= HRMP_PACK_DSD_OPS)
+   {
+      return "";
+   }
+
+   pthread_once(&once, pack_init);
+
+   return selected_dsd_name[op];
+}
+
+int
+hrmp_pack_sets(void)
+{
+#if defined(PACK_X86) || defined(PACK_NEON)
+   return 1 + (int)(sizeof(simd_tables) / sizeof(simd_tables[0]));
+#else
+   return 1;
+#endif
+}
+
+hrmp_pack_kernel
+hrmp_pack_get(int set, int op, unsigned int channels, char** name)
+{
+   const struct pack_table* table = table_at(set);
+
+   if (table == NULL || op < 0 || op >= HRMP_PACK_OPS || channels == 0)
+   {
+      return NULL;
+   }
+
+   *name = table->name;
+
+   return table->supported() ? table->kernels[op][layout(channels)] : NULL;
+}
+
+hrmp_pack_dsd_kernel
+hrmp_pack_dsd_get(int set, int op, char** name)
+{
+   const struct pack_table* table = table_at(set);
+
+   if (table == NULL || op < 0 || op >= HRMP_PACK_DSD_OPS)
+   {
+      return NULL;
+   }
+
+   *name = table->name;
+
+   return table->supported() ? table->dsd[op] : NULL;
+}
+
+static void
+pack_init(void)
+{
+   for (int op = 0; op < HRMP_PACK_OPS; op++)
+   {
+      for (int l = 0; l < PACK_LAYOUTS; l++)
+      {
+         selected[op][l] = scalar_table.kernels[op][l];
+         selected_name[op][l] = scalar_table.name;
+
+#if defined(PACK_X86) || defined(PACK_NEON)
+         for (size_t t = 0; t < sizeof(simd_tables) / sizeof(simd_tables[0]); t++)
+         {
+            const struct pack_table* table = &simd_tables[t];
+            hrmp_pack_kernel k = table->kernels[op][l];
+            unsigned int channels = l == PACK_MONO ? 1 : (l == PACK_STEREO ? 2 : VERIFY_CHANNELS);
+
+            if (k == NULL || !table->supported())
+            {
+               continue;
+            }
+
+            if (!verify(op, channels, k))
+            {
+               hrmp_log_warn("Pack: %s kernel %d/%u is not bit-exact, not using it", table->name, op, channels);
+               continue;
+            }
+
+            selected[op][l] = k;
+            selected_name[op][l] = table->name;
+            break;
+         }
+#endif
+      }
+   }
+
+   for (int op = 0; op < HRMP_PACK_DSD_OPS; op++)
+   {
+      selected_dsd[op] = scalar_table.dsd[op];
+      selected_dsd_name[op] = scalar_table.name;
+
+#if defined(PACK_X86) || defined(PACK_NEON)
+      for (size_t t = 0; t < sizeof(simd_tables) / sizeof(simd_tables[0]); t++)
+      {
+         const struct pack_table* table = &simd_tables[t];
+         hrmp_pack_dsd_kernel k = table->dsd[op];
+
+         if (k == NULL || !table->supported())
+         {
+            continue;
+         }
+
+         if (!verify_dsd(op, k))
+         {
+            hrmp_log_warn("Pack: %s DSD kernel %d is not bit-exact, not using it", table->name, op);
+            continue;
+         }
+
+         selected_dsd[op] = k;
+         selected_dsd_name[op] = table->name;
+         break;
+      }
+#endif
+   }
+}
+
+static const struct pack_table*
+table_at(int set)
+{
+   if (set == 0)
+   {
+      return &scalar_table;
+   }
+
+#if defined(PACK_X86) || defined(PACK_NEON)
+   if (set > 0 && set < hrmp_pack_sets())
+   {
+      return &simd_tables[set - 1];
+   }
+#endif
+
+   return NULL;
+}
+
+static int
+layout(unsigned int channels)
+{
+   if (channels == 1)
+   {
+      return PACK_MONO;
+   }
+   else if (channels == 2)
+   {
+      return PACK_STEREO;
+   }
+
+   return PACK_MULTI;
+}
+
+/* Run a kernel on pseudo random input, including the extremes, for a
+ * range of lengths that cover the vector bodies and the scalar tails,
+ * and compare against the scalar kernel. The guard catches stores past
+ * the end of the output */
+static bool
+verify(int op, unsigned int channels, hrmp_pack_kernel kernel)
+{
+   static const size_t lengths[] = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 127, VERIFY_FRAMES};
+   uint8_t in[VERIFY_FRAMES * VERIFY_CHANNELS * 4] __attribute__((aligned(64)));
+   uint8_t expected[VERIFY_FRAMES * 8 + VERIFY_GUARD];
+   uint8_t actual[VERIFY_FRAMES * 8 + VERIFY_GUARD];
+   uint32_t seed = 0x9E3779B9u;
+   size_t in_size = in_bytes(op);
+   size_t out_size = out_bytes(op);
+
+   for (size_t i = 0; i < sizeof(in); i++)
+   {
+      seed = seed * 1664525u + 1013904223u;
+      in[i] = (uint8_t)(seed >> 24);
+   }
+
+   if (in_size == 4)
+   {
+      int32_t extremes[4] = {INT32_MIN, INT32_MAX, -1, 0};
+      memcpy(in, extremes, sizeof(extremes));
+   }
+
+   for (size_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++)
+   {
+      size_t frames = lengths[t];
+      /* Every other run starts one sample in, so the vector loads are not aligned */
+      const uint8_t* src = in + (t % 2 == 0 ? 0 : in_size);
+
+      if ((size_t)(src - in) + frames * channels * in_size > sizeof(in))
+      {
+         src = in;
+      }
+
+      memset(expected, 0xA5, sizeof(expected));
+      memset(actual, 0xA5, sizeof(actual));
+
+      scalar_table.kernels[op][layout(channels)](src, channels, frames, expected);
+      kernel(src, channels, frames, actual);
+
+      if (memcmp(expected, actual, frames * out_size + VERIFY_GUARD) != 0)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+/* As verify(), for both DoP markers. The marker handed on must match too */
+static bool
+verify_dsd(int op, hrmp_pack_dsd_kernel kernel)
+{
+   static const size_t lengths[] = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 127, VERIFY_FRAMES};
+   static const uint8_t markers[] = {HRMP_PACK_DOP_MARKER_LSB, HRMP_PACK_DOP_MARKER_MSB};
+   uint8_t in[VERIFY_FRAMES * 4 * 2 + 8] __attribute__((aligned(64)));
+   uint8_t expected[VERIFY_FRAMES * 8 + VERIFY_GUARD];
+   uint8_t actual[VERIFY_FRAMES * 8 + VERIFY_GUARD];
+   uint32_t seed = 0x7F4A7C15u;
+
+   for (size_t i = 0; i < sizeof(in); i++)
+   {
+      seed = seed * 1664525u + 1013904223u;
+      in[i] = (uint8_t)(seed >> 24);
+   }
+
+   for (size_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++)
+   {
+      for (size_t mk = 0; mk < sizeof(markers); mk++)
+      {
+         size_t frames = lengths[t];
+         /* Every other run starts off the alignment of the vector loads */
+         const uint8_t* left = in + (t % 2 == 0 ? 0 : 3);
+         const uint8_t* right = left + VERIFY_FRAMES * 4 + 1;
+         uint8_t expected_marker = markers[mk];
+         uint8_t actual_marker = markers[mk];
+
+         memset(expected, 0xA5, sizeof(expected));
+         memset(actual, 0xA5, sizeof(actual));
+
+         scalar_table.dsd[op](left, right, frames, expected, &expected_marker);
+         kernel(left, right, frames, actual, &actual_marker);
+
+         if (memcmp(expected, actual, frames * 8 + VERIFY_GUARD) != 0 || expected_marker != actual_marker)
+         {
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+static size_t
+in_bytes(int op)
+{
+   switch (op)
+   {
+      case HRMP_PACK_S16_LE:
+         return 2;
+      case HRMP_PACK_S24_LE:
+         return 3;
+      default:
+         break;
+   }
+
+   return 4;
+}
+
+static size_t
+out_bytes(int op)
+{
+   switch (op)
+   {
+      case HRMP_PACK_S16:
+      case HRMP_PACK_S16_LE:
+         return 4;
+      case HRMP_PACK_S24_3:
+      case HRMP_PACK_S24_LE:
+         return 6;
+      default:
+         break;
+   }
+
+   return 8;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <logging.h>
+#include <pipeline.h>
+#include <realtime.h>
+
+/* system */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void* pipeline_thread(void* arg);
+
+int
+hrmp_pipeline_create(size_t depth, size_t period_frames, size_t bytes_per_frame,
+                     hrmp_pipeline_decode decode, void* user, struct pipeline** out)
+{
+   pthread_attr_t attr;
+   struct pipeline* pl = NULL;
+
+   *out = NULL;
+
+   if (depth < 2 || period_frames == 0 || bytes_per_frame == 0 || decode == NULL)
+   {
+      goto error;
+   }
+
+   pl = (struct pipeline*)malloc(sizeof(struct pipeline));
+   if (pl == NULL)
+   {
+      goto error;
+   }
+
+   memset(pl, 0, sizeof(struct pipeline));
+
+   pl->decode = decode;
+   pl->user = user;
+   pl->depth = depth;
+   pl->period_frames = period_frames;
+   pl->period_bytes = period_frames * bytes_per_frame;
+
+   pl->data = (uint8_t*)malloc(depth * pl->period_bytes);
+   pl->frames = (size_t*)calloc(depth, sizeof(size_t));
+   if (pl->data == NULL || pl->frames == NULL)
+   {
+      goto error;
+   }
+
+   pthread_mutex_init(&pl->lock, NULL);
+   pthread_cond_init(&pl->cond, NULL);
+
+   hrmp_realtime_helper_attr(&attr);
+
+   if (pthread_create(&pl->thread, &attr, pipeline_thread, pl) != 0)
+   {
+      pthread_attr_destroy(&attr);
+      hrmp_log_error("Pipeline: could not start decoder thread");
+      pthread_cond_destroy(&pl->cond);
+      pthread_mutex_destroy(&pl->lock);
+      goto error;
+   }
+
+   pthread_attr_destroy(&attr);
+
+   *out = pl;
+
+   return 0;
+
+error:
+
+   if (pl != NULL)
+   {
+      free(pl->data);
+      free(pl->frames);
+      free(pl);
+   }
+
+   return 1;
+}
+
+void
+hrmp_pipeline_destroy(struct pipeline* pl)
+{
+   if (pl == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&pl->lock);
+   pl->stop = true;
+   pthread_cond_broadcast(&pl->cond);
+   pthread_mutex_unlock(&pl->lock);
+
+   pthread_join(pl->thread, NULL);
+
+   pthread_cond_destroy(&pl->cond);
+   pthread_mutex_destroy(&pl->lock);
+
+   free(pl->data);
+   free(pl->frames);
+   free(pl);
+}
+
+size_t
+hrmp_pipeline_get(struct pipeline* pl, void** buf)
+{
+   size_t n = 0;
+
+   *buf = NULL;
+
+   if (pl == NULL)
+   {
+      return 0;
+   }
+
+   pthread_mutex_lock(&pl->lock);
+
+   while (pl->count == 0 && !pl->eof && !pl->stop)
+   {
+      pthread_cond_wait(&pl->cond, &pl->lock);
+   }
+
+   if (pl->count > 0)
+   {
+      *buf = pl->data + pl->head * pl->period_bytes;
+      n = pl->frames[pl->head];
+   }
+
+   pthread_mutex_unlock(&pl->lock);
+
+   return n;
+}
+
+void
+hrmp_pipeline_release(struct pipeline* pl)
+{
+   if (pl == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&pl->lock);
+
+   if (pl->count > 0)
+   {
+      pl->head = (pl->head + 1) % pl->depth;
+      pl->count--;
+      pthread_cond_broadcast(&pl->cond);
+   }
+
+   pthread_mutex_unlock(&pl->lock);
+}
+
+void
+hrmp_pipeline_suspend(struct pipeline* pl)
+{
+   if (pl == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&pl->lock);
+
+   pl->suspended = true;
+   while (pl->busy)
+   {
+      pthread_cond_wait(&pl->cond, &pl->lock);
+   }
+
+   pthread_mutex_unlock(&pl->lock);
+}
+
+void
+hrmp_pipeline_resume(struct pipeline* pl)
+{
+   if (pl == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&pl->lock);
+
+   pl->head = 0;
+   pl->count = 0;
+   pl->eof = false;
+   pl->suspended = false;
+   pthread_cond_broadcast(&pl->cond);
+
+   pthread_mutex_unlock(&pl->lock);
+}
+
+size_t
+hrmp_pipeline_queued(struct pipeline* pl)
+{
+   size_t n = 0;
+
+   if (pl == NULL)
+   {
+      return 0;
+   }
+
+   pthread_mutex_lock(&pl->lock);
+   n = pl->count;
+   pthread_mutex_unlock(&pl->lock);
+
+   return n;
+}
+
+static void*
+pipeline_thread(void* arg)
+{
+   struct pipeline* pl = (struct pipeline*)arg;
+
+   pthread_mutex_lock(&pl->lock);
+
+   while (!pl->stop)
+   {
+      size_t slot;
+      size_t n;
+
+      if (pl->suspended || pl->eof || pl->count == pl->depth)
+      {
+         pthread_cond_wait(&pl->cond, &pl->lock);
+         continue;
+      }
+
+      /* The slot after the queued periods is never handed out, so decode into it unlocked */
+      slot = (pl->head + pl->count) % pl->depth;
+      pl->busy = true;
+      pthread_mutex_unlock(&pl->lock);
+
+      n = pl->decode(pl->user, pl->data + slot * pl->period_bytes, pl->period_frames);
+
+      pthread_mutex_lock(&pl->lock);
+      pl->busy = false;
+
+      /* A period decoded across a suspend belongs to the old position */
+      if (!pl->suspended)
+      {
+         if (n == 0)
+         {
+            pl->eof = true;
+         }
+         else
+         {
+            pl->frames[slot] = n;
+            pl->count++;
+         }
+      }
+
+      pthread_cond_broadcast(&pl->cond);
+   }
+
+   pthread_mutex_unlock(&pl->lock);
+
+   return NULL;
+}
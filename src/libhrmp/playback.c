@@ -18,14 +18,20 @@
 /* hrmp */
 #include <hrmp.h>
 #include <alsa.h>
+#include <blockcache.h>
 #include <devices.h>
+#include <event.h>
 #include <files.h>
 #include <keyboard.h>
 #include <logging.h>
 #include <mkv.h>
+#include <pack.h>
 #include <playback.h>
+#include <prefetch.h>
+#include <realtime.h>
 #include <ringbuffer.h>
 #include <utils.h>
+#include <wav.h>
 
 /* system */
 #include <limits.h>
@@ -40,29 +46,45 @@
 #include <alsa/asoundlib.h>
 
 static void normalize_pcm_rate(struct configuration* config, struct file_metadata* fm);
-static void writei_all(snd_pcm_t* h, void* buf, snd_pcm_uframes_t frames, size_t bytes_per_frame);
+static int writei_all(struct playback* pb, void* buf, snd_pcm_uframes_t frames, size_t bytes_per_frame);
+static int output_begin(struct playback* pb, uint8_t* scratch, snd_pcm_uframes_t* frames, uint8_t** dst);
+static int output_commit(struct playback* pb, uint8_t* dst, snd_pcm_uframes_t frames, size_t bytes_per_frame);
+static int wait_device(struct playback* pb);
+static void wait_input(struct playback* pb);
+static void pause_output(struct playback* pb, bool pause);
+static void prefault(void* buf, size_t size);
+static void count_recover(struct playback* pb, int err);
+static unsigned long audible_samples(struct playback* pb);
 static unsigned frames_from_ms(struct playback* pb, unsigned ms);
 static void write_dsd_center_pad(struct playback* pb, unsigned frames, uint8_t* marker);
 static void write_dsd_fadeout(struct playback* pb, unsigned ms, uint8_t* marker);
 static size_t ringbuffer_target_capacity(size_t file_size);
 static size_t ringbuffer_target_max(size_t file_size);
-static void ensure_ringbuffer_target(struct ringbuffer* rb, size_t file_size);
-static void prefill_ringbuffer_limit(FILE* f, struct ringbuffer* rb, size_t bytes_left);
-static void prefill_ringbuffer(FILE* f, struct ringbuffer* rb, size_t file_size);
-static size_t read_some(FILE* f, struct ringbuffer* rb, void* buf, size_t n, size_t file_size);
+static int start_prefetch(struct playback* pb, uint64_t offset, uint64_t end);
+static void stop_prefetch(struct playback* pb);
+static void stop_pipeline(struct playback* pb);
+static size_t read_some(struct playback* pb, FILE* f, struct prefetch* pf, void* buf, size_t n);
 static sf_count_t sndfile_vio_get_filelen(void* user_data);
 static sf_count_t sndfile_vio_seek(sf_count_t offset, int whence, void* user_data);
 static sf_count_t sndfile_vio_read(void* ptr, sf_count_t count, void* user_data);
 static sf_count_t sndfile_vio_write(const void* ptr, sf_count_t count, void* user_data);
 static sf_count_t sndfile_vio_tell(void* user_data);
 static int playback_sndfile(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total, bool* next);
-static uint8_t bitrev8(uint8_t x);
-static int read_exact(FILE* f, struct ringbuffer* rb, void* buf, size_t n, size_t bytes_left);
+static int playback_wav(snd_pcm_t* pcm_handle, struct playback* pb, FILE* fp, struct wav* wav, bool* next);
+static int open_wav(struct playback* pb, struct wav* wav, FILE** fp);
+static size_t sndfile_decode(void* user, void* buf, size_t frames);
+static void dsd_pack_dop(hrmp_pack_dsd_kernel kernel, const uint8_t* in, size_t per_ch, uint32_t in_channels,
+                         size_t first, size_t frames, uint8_t* out, uint8_t* marker);
+static void dsd_pack_native(hrmp_pack_dsd_kernel kernel, const uint8_t* in, size_t per_ch, uint32_t in_channels,
+                            bool interleaved, size_t first, size_t frames, uint8_t* out);
+static int read_exact(struct playback* pb, FILE* f, void* buf, size_t n);
+static const uint8_t* read_block(struct playback* pb, FILE* f, uint8_t* scratch, size_t n);
+static void release_block(struct prefetch* pf, const uint8_t* block, const uint8_t* scratch, size_t n);
 static int playback_dsf(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total, bool* next);
 static int playback_dff(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total, bool* next);
 static int playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total, bool* next);
 static void fmt2(int v, char out[3]);
-static char* format_output(struct playback* pb);
+static char* format_output(struct playback* pb, unsigned long position);
 static int playback_identifier(struct file_metadata* fm, char** identifer);
 static char* get_progress(struct playback* pb);
 static void print_progress_done(struct playback* pb);
@@ -77,6 +99,8 @@ static int do_keyboard(FILE* f, SNDFILE* sndf, struct playback* pb, char** print
 #define HRMP_DSD_FADEOUT_MS  20u
 #define HRMP_DSD_POSTROLL_MS 60u
 
+#define PROGRESS_INTERVAL_NS 100000000ULL
+
 int
 hrmp_playback_init(int number, int total, struct file_metadata* fm, struct playback** pb)
 {
@@ -165,18 +189,78 @@ hrmp_playback_prepare_ringbuffer(struct playback* pb)
    /* Minimum must always be 4MiB so the buffer can shrink over time. */
    size_t min_size = HRMP_RINGBUFFER_MIN_BYTES;
 
-   if (hrmp_ringbuffer_create(min_size, cap, max_size, &pb->rb))
+   int flags = config->cache_mirror ? HRMP_RINGBUFFER_FLAG_MIRROR : HRMP_RINGBUFFER_FLAG_NONE;
+
+   if (config->cache_hugepages == HRMP_HUGEPAGES_AUTO)
+   {
+      flags |= HRMP_RINGBUFFER_FLAG_HUGETLB | HRMP_RINGBUFFER_FLAG_HUGEPAGES | HRMP_RINGBUFFER_FLAG_PREFAULT;
+   }
+   else if (config->cache_hugepages == HRMP_HUGEPAGES_TRANSPARENT)
+   {
+      flags |= HRMP_RINGBUFFER_FLAG_HUGEPAGES | HRMP_RINGBUFFER_FLAG_PREFAULT;
+   }
+   else if (config->cache_hugepages == HRMP_HUGEPAGES_EXPLICIT)
+   {
+      flags |= HRMP_RINGBUFFER_FLAG_HUGETLB | HRMP_RINGBUFFER_FLAG_PREFAULT;
+   }
+
+   if (hrmp_ringbuffer_create(min_size, cap, max_size, flags, &pb->rb))
+   {
+      return 1;
+   }
+
+   if (config->cache_mirror && !pb->rb->mirrored)
+   {
+      hrmp_log_debug("Mirrored ringbuffer not available for '%s', using a single mapping", pb->fm->name);
+   }
+
+   if (config->cache_hugepages != HRMP_HUGEPAGES_OFF)
+   {
+      hrmp_log_debug("Ringbuffer for '%s' uses %s", pb->fm->name, hrmp_ringbuffer_backing_name(pb->rb));
+   }
+
+   return 0;
+}
+
+int
+hrmp_playback_prebuffer(struct playback* pb)
+{
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   if (pb == NULL || pb->rb == NULL || pb->pf != NULL || config->cache_prebuffer == 0)
+   {
+      return 0;
+   }
+
+   if (hrmp_prefetch_create(pb->fm->name, pb->rb, 0, pb->file_size, config->cache_prebuffer, &pb->pf))
    {
+      hrmp_log_debug("Could not prebuffer '%s'", pb->fm->name);
       return 1;
    }
 
    return 0;
 }
 
+void
+hrmp_playback_stop_prebuffer(struct playback* pb)
+{
+   if (pb != NULL)
+   {
+      stop_prefetch(pb);
+   }
+}
+
 int
-hrmp_playback(struct playback* pb, bool* next)
+hrmp_playback(struct playback* pb, snd_pcm_t** handle, bool* next)
 {
    int ret = 1;
+   FILE* fp = NULL;
+   struct wav wav;
+   uint64_t hits = 0;
+   uint64_t misses = 0;
+   uint64_t faults = 0;
    snd_pcm_t* pcm_handle = NULL;
    struct configuration* config = NULL;
 
@@ -184,28 +268,64 @@ hrmp_playback(struct playback* pb, bool* next)
 
    *next = true;
 
-   if (hrmp_alsa_init_handle(pb->fm, &pcm_handle))
+   if (*handle != NULL)
    {
-      hrmp_log_error("Could not initialize '%s' for '%s'", &config->active_device.name[0], pb->fm->name);
-      goto error;
+      if (hrmp_alsa_reuse_handle(pb->fm, *handle))
+      {
+         hrmp_alsa_close_handle(*handle);
+         *handle = NULL;
+      }
+      else
+      {
+         pcm_handle = *handle;
+      }
+   }
+
+   if (pcm_handle == NULL)
+   {
+      if (hrmp_alsa_init_handle(pb->fm, &pcm_handle))
+      {
+         hrmp_log_error("Could not initialize '%s' for '%s'", &config->active_device.name[0], pb->fm->name);
+         goto error;
+      }
+      *handle = pcm_handle;
    }
 
    config->active_device.is_paused = false;
    pb->pcm_handle = pcm_handle;
+   pb->mmap = hrmp_alsa_is_mmap(pcm_handle);
+
+   if (hrmp_event_create(pcm_handle, &pb->ev))
+   {
+      hrmp_log_debug("Reading the keyboard after every write for '%s'", pb->fm->name);
+   }
    pb->current_samples = 0;
    pb->bytes_left = pb->file_size;
+   hrmp_stats_reset(&pb->stats);
+   hrmp_blockcache_counters(&hits, &misses);
+   faults = hrmp_stats_faults();
+   pb->progress_ns = 0;
 
    if (hrmp_playback_prepare_ringbuffer(pb))
    {
       goto error;
    }
 
+   if (pb->rb != NULL)
+   {
+      prefault(pb->rb->buf, pb->rb->mirrored ? 2 * pb->rb->cap : pb->rb->cap);
+   }
+
    if (config->metadata || config->developer)
    {
       hrmp_print_file_metadata(pb->fm);
    }
 
-   if (pb->fm->type == TYPE_WAV || pb->fm->type == TYPE_FLAC || pb->fm->type == TYPE_MP3)
+   if (pb->fm->type == TYPE_WAV && !open_wav(pb, &wav, &fp))
+   {
+      ret = playback_wav(pcm_handle, pb, fp, &wav, next);
+   }
+   else if (pb->fm->type == TYPE_WAV || pb->fm->type == TYPE_FLAC || pb->fm->type == TYPE_MP3)
    {
       ret = playback_sndfile(pcm_handle, pb, pb->file_number, pb->total_number, next);
    }
@@ -226,22 +346,43 @@ hrmp_playback(struct playback* pb, bool* next)
       goto error;
    }
 
-   hrmp_alsa_close_handle(pcm_handle);
+   hrmp_blockcache_counters(&pb->stats.cache_hits, &pb->stats.cache_misses);
+   pb->stats.cache_hits -= hits;
+   pb->stats.cache_misses -= misses;
+   pb->stats.faults = hrmp_stats_faults() - faults;
+
+   hrmp_stats_report(&pb->stats, pb->fm->name);
+
+   stop_prefetch(pb);
+   hrmp_event_destroy(pb->ev);
+   pb->ev = NULL;
    return ret;
 
 error:
 
+   stop_prefetch(pb);
+   hrmp_event_destroy(pb->ev);
+   pb->ev = NULL;
    if (pcm_handle != NULL)
    {
       hrmp_alsa_close_handle(pcm_handle);
+      *handle = NULL;
    }
    return 1;
 }
 
+struct sndfile_decoder
+{
+   SNDFILE* f;
+   int channels;
+   hrmp_pack_kernel pack;
+   int32_t* input;
+};
+
 struct sndfile_vio_state
 {
    FILE* fp;
-   struct ringbuffer* rb;
+   struct prefetch* pf;
    uint64_t pos;
    uint64_t file_size;
    struct playback* pb;
@@ -278,27 +419,266 @@ normalize_pcm_rate(struct configuration* config, struct file_metadata* fm)
    fm->pcm_rate = new_pcm_rate;
 }
 
-static void
-writei_all(snd_pcm_t* h, void* buf, snd_pcm_uframes_t frames, size_t bytes_per_frame)
+static int
+writei_all(struct playback* pb, void* buf, snd_pcm_uframes_t frames, size_t bytes_per_frame)
 {
    uint8_t* p = (uint8_t*)buf;
    snd_pcm_sframes_t remaining = frames;
 
    while (remaining > 0)
    {
-      snd_pcm_sframes_t w = snd_pcm_writei(h, p, remaining);
+      snd_pcm_sframes_t w;
+      uint64_t start = hrmp_stats_now();
+
+      wait_device(pb);
+      hrmp_stats_wait(&pb->stats, start);
+
+      start = hrmp_stats_now();
+      if (pb->mmap)
+      {
+         w = snd_pcm_mmap_writei(pb->pcm_handle, p, remaining);
+      }
+      else
+      {
+         w = snd_pcm_writei(pb->pcm_handle, p, remaining);
+      }
+
+      hrmp_stats_write(&pb->stats, start);
+
       if (w == -EPIPE)
       {
-         snd_pcm_prepare(h);
+         count_recover(pb, (int)w);
+         snd_pcm_prepare(pb->pcm_handle);
          continue;
       }
       else if (w < 0)
       {
-         break;
+         count_recover(pb, (int)w);
+         if (snd_pcm_recover(pb->pcm_handle, (int)w, 1) < 0)
+         {
+            return 1;
+         }
+         continue;
+      }
+      else if (w < remaining)
+      {
+         pb->stats.short_writes++;
       }
       p += (size_t)w * bytes_per_frame;
       remaining -= w;
    }
+
+   return 0;
+}
+
+/* A memory mapped handle hands out room in its own buffer, so the caller
+ * converts straight into the device buffer instead of into scratch */
+static int
+output_begin(struct playback* pb, uint8_t* scratch, snd_pcm_uframes_t* frames, uint8_t** dst)
+{
+   int err;
+   bool waited = false;
+   snd_pcm_sframes_t avail;
+   snd_pcm_uframes_t offset = 0;
+   snd_pcm_uframes_t n = *frames;
+   const snd_pcm_channel_area_t* areas = NULL;
+   uint64_t start;
+
+   *dst = NULL;
+
+   if (!pb->mmap)
+   {
+      *dst = scratch;
+      return 0;
+   }
+
+   start = hrmp_stats_now();
+
+   for (;;)
+   {
+      avail = snd_pcm_avail_update(pb->pcm_handle);
+      if (avail < 0)
+      {
+         count_recover(pb, (int)avail);
+         if ((err = snd_pcm_recover(pb->pcm_handle, (int)avail, 1)) < 0)
+         {
+            hrmp_log_error("snd_pcm_avail_update %s", snd_strerror(err));
+            return 1;
+         }
+         continue;
+      }
+
+      if ((snd_pcm_uframes_t)avail >= n)
+      {
+         break;
+      }
+
+      if (avail > 0 && (waited || snd_pcm_state(pb->pcm_handle) == SND_PCM_STATE_PREPARED))
+      {
+         n = (snd_pcm_uframes_t)avail;
+         break;
+      }
+
+      if (snd_pcm_state(pb->pcm_handle) == SND_PCM_STATE_PREPARED)
+      {
+         /* Full before it was started */
+         snd_pcm_start(pb->pcm_handle);
+      }
+
+      if ((err = wait_device(pb)) < 0)
+      {
+         count_recover(pb, err);
+         if ((err = snd_pcm_recover(pb->pcm_handle, err, 1)) < 0)
+         {
+            hrmp_log_error("snd_pcm_wait %s", snd_strerror(err));
+            return 1;
+         }
+      }
+      waited = true;
+   }
+
+   hrmp_stats_wait(&pb->stats, start);
+
+   if ((err = snd_pcm_mmap_begin(pb->pcm_handle, &areas, &offset, &n)) < 0)
+   {
+      hrmp_log_error("snd_pcm_mmap_begin %s", snd_strerror(err));
+      return 1;
+   }
+
+   /* Interleaved access, so one area describes all channels */
+   *dst = (uint8_t*)areas[0].addr + areas[0].first / 8 + (size_t)offset * (areas[0].step / 8);
+   *frames = n;
+   pb->mmap_offset = offset;
+
+   return 0;
+}
+
+static int
+output_commit(struct playback* pb, uint8_t* dst, snd_pcm_uframes_t frames, size_t bytes_per_frame)
+{
+   snd_pcm_sframes_t c;
+   uint64_t start;
+
+   if (!pb->mmap)
+   {
+      return writei_all(pb, dst, frames, bytes_per_frame);
+   }
+
+   start = hrmp_stats_now();
+   c = snd_pcm_mmap_commit(pb->pcm_handle, pb->mmap_offset, frames);
+   hrmp_stats_write(&pb->stats, start);
+   if (c < 0 || (snd_pcm_uframes_t)c != frames)
+   {
+      if (c >= 0)
+      {
+         pb->stats.short_writes++;
+      }
+      count_recover(pb, c < 0 ? (int)c : 0);
+      if (snd_pcm_recover(pb->pcm_handle, c < 0 ? (int)c : -EPIPE, 1) < 0)
+      {
+         hrmp_log_error("snd_pcm_mmap_commit %s", snd_strerror(c < 0 ? (int)c : -EPIPE));
+         return 1;
+      }
+   }
+
+   if (snd_pcm_state(pb->pcm_handle) == SND_PCM_STATE_PREPARED)
+   {
+      snd_pcm_start(pb->pcm_handle);
+   }
+
+   return 0;
+}
+
+/* Wait for room on the device. Keyboard input seen while waiting is
+ * remembered so do_keyboard() only reads stdin when there is something */
+static int
+wait_device(struct playback* pb)
+{
+   if (pb->ev == NULL)
+   {
+      return snd_pcm_wait(pb->pcm_handle, 1000);
+   }
+
+   hrmp_event_wait(pb->ev, true, 1000);
+
+   return 0;
+}
+
+static void
+wait_input(struct playback* pb)
+{
+   if (pb->ev == NULL)
+   {
+      SLEEP(10000000L);
+      return;
+   }
+
+   hrmp_event_wait(pb->ev, false, -1);
+}
+
+/* Without hardware pause the device runs dry and is recovered on the next write */
+static void
+pause_output(struct playback* pb, bool pause)
+{
+   struct configuration* config = (struct configuration*)shmem;
+
+   if (pause)
+   {
+      if (snd_pcm_state(pb->pcm_handle) == SND_PCM_STATE_RUNNING)
+      {
+         snd_pcm_pause(pb->pcm_handle, 1);
+      }
+   }
+   else if (snd_pcm_state(pb->pcm_handle) == SND_PCM_STATE_PAUSED)
+   {
+      snd_pcm_pause(pb->pcm_handle, 0);
+   }
+
+   config->active_device.is_paused = pause;
+}
+
+static void
+count_recover(struct playback* pb, int err)
+{
+   pb->stats.recovers++;
+   if (err == -EPIPE)
+   {
+      pb->stats.xruns++;
+   }
+}
+
+/* The position at the DAC: the frames still queued on the device are
+ * converted from the device rate back to file samples */
+static unsigned long
+audible_samples(struct playback* pb)
+{
+   snd_pcm_sframes_t delay = 0;
+   uint64_t behind = 0;
+
+   if (pb->pcm_handle == NULL || pb->fm->pcm_rate == 0 || pb->fm->sample_rate == 0 ||
+       snd_pcm_delay(pb->pcm_handle, &delay) < 0 || delay <= 0)
+   {
+      return pb->current_samples;
+   }
+
+   behind = ((uint64_t)delay * (uint64_t)pb->fm->sample_rate) / (uint64_t)pb->fm->pcm_rate;
+   if (behind >= (uint64_t)pb->current_samples)
+   {
+      return 0;
+   }
+
+   return pb->current_samples - (unsigned long)behind;
+}
+
+static void
+prefault(void* buf, size_t size)
+{
+   struct configuration* config = (struct configuration*)shmem;
+
+   if (config->realtime)
+   {
+      hrmp_realtime_prefault(buf, size);
+   }
 }
 
 static unsigned
@@ -353,7 +733,7 @@ write_dsd_center_pad(struct playback* pb, unsigned frames, uint8_t* marker)
          }
          m = (m == DOP_MARKER_8LSB) ? DOP_MARKER_8MSB : DOP_MARKER_8LSB;
       }
-      writei_all(pb->pcm_handle, pr, frames, bytes_per_frame);
+      writei_all(pb, pr, frames, bytes_per_frame);
       if (marker != NULL)
       {
          *marker = m;
@@ -374,7 +754,7 @@ write_dsd_center_pad(struct playback* pb, unsigned frames, uint8_t* marker)
             pr[off + 3] = b;
          }
       }
-      writei_all(pb->pcm_handle, pr, frames, bytes_per_frame);
+      writei_all(pb, pr, frames, bytes_per_frame);
    }
 
    free(pr);
@@ -439,172 +819,73 @@ ringbuffer_target_max(size_t file_size)
    return limit;
 }
 
-static void
-ensure_ringbuffer_target(struct ringbuffer* rb, size_t file_size)
-{
-   if (rb == NULL)
-   {
-      return;
-   }
-
-   size_t target = ringbuffer_target_max(file_size);
-   size_t cur = hrmp_ringbuffer_size(rb);
-   if (target <= cur)
-   {
-      return;
-   }
-
-   /* Ensure capacity >= target (need free space == target - cur) */
-   (void)hrmp_ringbuffer_ensure_write(rb, target - cur);
-}
-
-static void
-prefill_ringbuffer_limit(FILE* f, struct ringbuffer* rb, size_t bytes_left)
+static int
+start_prefetch(struct playback* pb, uint64_t offset, uint64_t end)
 {
-   if (f == NULL || rb == NULL)
+   /* Continue from the prebuffered start of the file when it covers the segment */
+   if (pb->pf != NULL && end <= pb->pf->end && !hrmp_prefetch_seek(pb->pf, offset))
    {
-      return;
-   }
-
-   if (bytes_left == 0)
-   {
-      return;
+      hrmp_prefetch_set_target(pb->pf, 0);
+      return 0;
    }
 
-   size_t cur = hrmp_ringbuffer_size(rb);
-   if (cur >= bytes_left)
-   {
-      return;
-   }
+   stop_prefetch(pb);
 
-   size_t target = ringbuffer_target_max(bytes_left);
-   if (target > bytes_left)
+   if (pb->rb == NULL)
    {
-      target = bytes_left;
-   }
-   if (target <= cur)
-   {
-      return;
+      return 0;
    }
 
-   if (hrmp_ringbuffer_ensure_write(rb, target - cur))
+   if (hrmp_prefetch_create(pb->fm->name, pb->rb, offset, end, 0, &pb->pf))
    {
-      return;
+      hrmp_log_warn("Reading '%s' without prefetch", pb->fm->name);
+      return 1;
    }
 
-   size_t remaining = bytes_left - cur;
-   while (hrmp_ringbuffer_size(rb) < target && remaining > 0)
-   {
-      void* wp = NULL;
-      size_t span = hrmp_ringbuffer_get_write_span(rb, &wp);
-      if (span == 0)
-      {
-         break;
-      }
-      if (span > remaining)
-      {
-         span = remaining;
-      }
-
-      size_t got = fread(wp, 1, span, f);
-      if (got == 0)
-      {
-         break;
-      }
-
-      if (hrmp_ringbuffer_produce(rb, got))
-      {
-         break;
-      }
-      if (got > remaining)
-      {
-         break;
-      }
-      remaining -= got;
-   }
+   return 0;
 }
 
 static void
-prefill_ringbuffer(FILE* f, struct ringbuffer* rb, size_t file_size)
+stop_prefetch(struct playback* pb)
 {
-   if (f == NULL || rb == NULL)
+   if (pb->pf != NULL)
    {
-      return;
+      hrmp_prefetch_destroy(pb->pf);
+      pb->pf = NULL;
    }
+}
 
-   size_t remaining = SIZE_MAX;
-   if (file_size > 0)
+static void
+stop_pipeline(struct playback* pb)
+{
+   if (pb->pl != NULL)
    {
-      off_t pos = ftello(f);
-      if (pos >= 0 && (size_t)pos <= file_size)
-      {
-         remaining = file_size - (size_t)pos;
-      }
+      hrmp_pipeline_destroy(pb->pl);
+      pb->pl = NULL;
    }
-
-   prefill_ringbuffer_limit(f, rb, remaining);
 }
 
 static size_t
-read_some(FILE* f, struct ringbuffer* rb, void* buf, size_t n, size_t file_size)
+read_some(struct playback* pb, FILE* f, struct prefetch* pf, void* buf, size_t n)
 {
-   if (rb == NULL)
-   {
-      return fread(buf, 1, n, f);
-   }
+   size_t got;
+   size_t fill;
+   uint64_t start = hrmp_stats_now();
 
-   off_t pos = ftello(f);
-   if (pos >= 0 && (size_t)pos <= file_size)
+   if (pf == NULL)
    {
-      ensure_ringbuffer_target(rb, file_size - (size_t)pos);
+      got = fread(buf, 1, n, f);
+      hrmp_stats_read(&pb->stats, start, 0, false);
+      return got;
    }
 
-   uint8_t* out = (uint8_t*)buf;
-   size_t off = 0;
-
-   while (off < n)
-   {
-      void* rp = NULL;
-      size_t have = hrmp_ringbuffer_peek(rb, &rp);
-      if (have > 0)
-      {
-         size_t take = (n - off) < have ? (n - off) : have;
-         memcpy(out + off, rp, take);
-         hrmp_ringbuffer_consume(rb, take);
-         off += take;
-         prefill_ringbuffer(f, rb, file_size);
-         continue;
-      }
-
-      if (hrmp_ringbuffer_ensure_write(rb, 1))
-      {
-         break;
-      }
-
-      void* wp = NULL;
-      size_t span = hrmp_ringbuffer_get_write_span(rb, &wp);
-      if (span == 0)
-      {
-         if (hrmp_ringbuffer_ensure_write(rb, hrmp_ringbuffer_capacity(rb) / 2u))
-         {
-            break;
-         }
-         continue;
-      }
+   fill = hrmp_prefetch_buffered(pf);
+   got = hrmp_prefetch_read(pf, buf, n);
 
-      size_t got = fread(wp, 1, span, f);
-      if (got == 0)
-      {
-         break;
-      }
-
-      if (hrmp_ringbuffer_produce(rb, got))
-      {
-         break;
-      }
-   }
+   /* The fill only drains to zero at the end of the segment */
+   hrmp_stats_read(&pb->stats, start, fill, !atomic_load(&pf->eof));
 
-   return off;
+   return got;
 }
 
 static sf_count_t
@@ -651,14 +932,16 @@ sndfile_vio_seek(sf_count_t offset, int whence, void* user_data)
       newpos = (int64_t)st->file_size;
    }
 
-   if (fseeko(st->fp, (off_t)newpos, SEEK_SET) != 0)
+   if (st->pf != NULL)
    {
-      return -1;
+      if (hrmp_prefetch_seek(st->pf, (uint64_t)newpos))
+      {
+         return -1;
+      }
    }
-   if (st->rb != NULL)
+   else if (fseeko(st->fp, (off_t)newpos, SEEK_SET) != 0)
    {
-      hrmp_ringbuffer_reset(st->rb);
-      prefill_ringbuffer(st->fp, st->rb, st->file_size);
+      return -1;
    }
 
    st->pos = (uint64_t)newpos;
@@ -679,7 +962,7 @@ sndfile_vio_read(void* ptr, sf_count_t count, void* user_data)
       return 0;
    }
 
-   size_t got = read_some(st->fp, st->rb, ptr, (size_t)count, (size_t)st->file_size);
+   size_t got = read_some(st->pb, st->fp, st->pf, ptr, (size_t)count);
    st->pos += (uint64_t)got;
    if (st->pb != NULL)
    {
@@ -715,13 +998,16 @@ playback_sndfile(snd_pcm_t* pcm_handle, struct playback* pb, int number, int tot
    size_t bytes_per_frame;
    snd_pcm_uframes_t pcm_buffer_size = 0;
    snd_pcm_uframes_t pcm_period_size = 0;
-   snd_pcm_sframes_t frames_to_write;
-   snd_pcm_sframes_t w;
-   sf_count_t frames_read;
+   size_t frames_read;
    size_t input_buffer_size = 0;
    int32_t* input_buffer = NULL;
    size_t output_buffer_size = 0;
    unsigned char* output_buffer = NULL;
+   struct sndfile_decoder dec;
+   bool interrupted = false;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
 
    *next = true;
 
@@ -738,16 +1024,13 @@ playback_sndfile(snd_pcm_t* pcm_handle, struct playback* pb, int number, int tot
       goto error;
    }
 
-   if (pb->rb != NULL)
-   {
-      hrmp_ringbuffer_reset(pb->rb);
-   }
    pb->bytes_left = pb->file_size;
+   start_prefetch(pb, 0, pb->file_size);
 
    struct sndfile_vio_state vio_state;
    memset(&vio_state, 0, sizeof(vio_state));
    vio_state.fp = fp;
-   vio_state.rb = pb->rb;
+   vio_state.pf = pb->pf;
    vio_state.pos = 0;
    vio_state.file_size = pb->file_size;
    vio_state.pb = pb;
@@ -808,118 +1091,311 @@ playback_sndfile(snd_pcm_t* pcm_handle, struct playback* pb, int number, int tot
    memset(input_buffer, 0, input_buffer_size);
    memset(output_buffer, 0, output_buffer_size);
 
-   while ((frames_read = sf_readf_int(f, input_buffer, pcm_period_size)) > 0)
+   dec.f = f;
+   dec.channels = info->channels;
+   dec.pack = hrmp_pack_select(pb->fm->container == 16 ? HRMP_PACK_S16 :
+                               pb->fm->container == 24 ? HRMP_PACK_S24_3 : HRMP_PACK_S32,
+                               (unsigned int)info->channels);
+   dec.input = input_buffer;
+
+   if (config->decode_queue > 0)
+   {
+      if (hrmp_pipeline_create((size_t)config->decode_queue, pcm_period_size, bytes_per_frame,
+                               sndfile_decode, &dec, &pb->pl))
+      {
+         hrmp_log_debug("Decoding '%s' on the playback thread", pb->fm->name);
+      }
+      else
+      {
+         prefault(pb->pl->data, pb->pl->depth * pb->pl->period_bytes);
+      }
+   }
+
+   while (true)
    {
-      size_t outpos = 0;
-      int in_ch = info->channels;
+      void* out = NULL;
       char* p = NULL;
       char* k = NULL;
       int kb = 0;
 
-      for (sf_count_t fi = 0; fi < frames_read; ++fi)
+      err = 0;
+      if (pb->pl != NULL)
       {
-         if (in_ch == 2)
+         frames_read = hrmp_pipeline_get(pb->pl, &out);
+         if (frames_read == 0)
          {
-            int32_t L = input_buffer[fi * in_ch + 0];
-            int32_t R = input_buffer[fi * in_ch + 1];
+            break;
+         }
 
-            if (pb->fm->container == 16)
-            {
-               int16_t l16 = (int16_t)(L >> 16);
-               int16_t r16 = (int16_t)(R >> 16);
-               output_buffer[outpos++] = (uint8_t)(l16 & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((l16 >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)(r16 & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((r16 >> 8) & 0xFF);
-            }
-            else if (pb->fm->container == 24)
-            {
-               output_buffer[outpos++] = (uint8_t)(L & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((L >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((L >> 16) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)(R & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((R >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((R >> 16) & 0xFF);
-            }
-            else
-            {
-               output_buffer[outpos++] = (uint8_t)(L & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((L >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((L >> 16) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((L >> 24) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)(R & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((R >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((R >> 16) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((R >> 24) & 0xFF);
-            }
+         err = writei_all(pb, out, (snd_pcm_uframes_t)frames_read, bytes_per_frame);
+         hrmp_pipeline_release(pb->pl);
+      }
+      else
+      {
+         snd_pcm_uframes_t room = pcm_period_size;
+         uint8_t* dst = NULL;
+
+         if (output_begin(pb, output_buffer, &room, &dst))
+         {
+            interrupted = true;
+            break;
          }
-         else
+
+         frames_read = sndfile_decode(&dec, dst, room);
+         if (frames_read == 0)
          {
-            int64_t acc = 0;
-            for (int ch = 0; ch < in_ch; ++ch)
-            {
-               acc += (int64_t)input_buffer[fi * in_ch + ch];
-            }
-            int32_t mono = (int32_t)(acc / (int64_t)in_ch);
+            break;
+         }
+
+         err = output_commit(pb, dst, (snd_pcm_uframes_t)frames_read, bytes_per_frame);
+      }
+
+      if (err)
+      {
+         interrupted = true;
+         break;
+      }
+
+      p = get_progress(pb);
+      pb->current_samples += (unsigned long)frames_read;
+
+      kb = do_keyboard(NULL, f, pb, &k);
+
+      if (kb == 1 || kb == 2)
+      {
+         if (kb == 2)
+         {
+            *next = false;
+         }
+
+         free(p);
+         p = NULL;
+         interrupted = true;
+         break;
+      }
+
+      if (p != NULL)
+      {
+         printf("%s", p);
+         fflush(stdout);
+         free(p);
+         p = NULL;
+      }
+      if (k != NULL)
+      {
+         p = hrmp_append(p, "\n");
+         p = hrmp_append(p, k);
+         printf("%s\n", p);
+         free(k);
+         free(p);
+         p = NULL;
+         k = NULL;
+         fflush(stdout);
+      }
+   }
+
+   stop_pipeline(pb);
+
+   /* Leave the tail queued so that the next file follows without a gap,
+    * a skip throws it away */
+   if (interrupted)
+   {
+      snd_pcm_drop(pcm_handle);
+   }
+
+   pb->bytes_left = 0;
+   stop_prefetch(pb);
+   if (pb->rb != NULL)
+   {
+      hrmp_ringbuffer_reset(pb->rb);
+   }
+   print_progress_done(pb);
+
+   free(input_buffer);
+   free(output_buffer);
+   free(info);
+
+   sf_close(f);
+   fclose(fp);
+
+   return 0;
+
+error:
+
+   stop_pipeline(pb);
+   if (input_buffer)
+   {
+      free(input_buffer);
+   }
+   if (output_buffer)
+   {
+      free(output_buffer);
+   }
+   if (info)
+   {
+      free(info);
+   }
+   if (f)
+   {
+      sf_close(f);
+   }
+   if (fp)
+   {
+      fclose(fp);
+   }
+   stop_prefetch(pb);
+
+   return 1;
+}
+
+static size_t
+sndfile_decode(void* user, void* buf, size_t frames)
+{
+   struct sndfile_decoder* dec = (struct sndfile_decoder*)user;
+   sf_count_t frames_read;
+
+   frames_read = sf_readf_int(dec->f, dec->input, (sf_count_t)frames);
+   if (frames_read <= 0)
+   {
+      return 0;
+   }
+
+   dec->pack(dec->input, (unsigned int)dec->channels, (size_t)frames_read, (uint8_t*)buf);
+
+   return (size_t)frames_read;
+}
+
+/* PCM WAVE data that already is in the device format skips libsndfile,
+ * anything else is decoded by it */
+static int
+open_wav(struct playback* pb, struct wav* wav, FILE** fp)
+{
+   FILE* f = NULL;
+
+   *fp = NULL;
+
+   f = fopen(pb->fm->name, "rb");
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   if (hrmp_wav_read_header(f, pb->file_size, wav))
+   {
+      goto error;
+   }
+
+   if (!hrmp_wav_is_native(wav, pb->fm))
+   {
+      goto error;
+   }
+
+   hrmp_log_debug("Playing '%s' without conversion", pb->fm->name);
+
+   *fp = f;
+
+   return 0;
+
+error:
+
+   if (f != NULL)
+   {
+      fclose(f);
+   }
+
+   return 1;
+}
+
+static int
+playback_wav(snd_pcm_t* pcm_handle, struct playback* pb, FILE* fp, struct wav* wav, bool* next)
+{
+   int err;
+   size_t bytes_per_frame = wav->block_align;
+   snd_pcm_uframes_t pcm_buffer_size = 0;
+   snd_pcm_uframes_t pcm_period_size = 0;
+   uint8_t* scratch = NULL;
+   bool interrupted = false;
+
+   *next = true;
+
+   if (snd_pcm_get_params(pcm_handle, &pcm_buffer_size, &pcm_period_size) < 0)
+   {
+      hrmp_log_error("Could not get parameters for '%s'", pb->fm->name);
+      goto error;
+   }
+
+   scratch = (uint8_t*)malloc(bytes_per_frame * pcm_period_size);
+   if (scratch == NULL)
+   {
+      goto error;
+   }
+
+   pb->wav = wav;
+   pb->bytes_left = wav->data_size;
+   start_prefetch(pb, wav->data_offset, wav->data_offset + wav->data_size);
+
+   while (true)
+   {
+      snd_pcm_uframes_t frames = pcm_period_size;
+      size_t bytes;
+      uint8_t* dst = NULL;
+      const uint8_t* block = NULL;
+      char* p = NULL;
+      char* k = NULL;
+      int kb = 0;
 
-            if (pb->fm->container == 16)
-            {
-               int16_t s16 = (int16_t)(mono >> 16);
-               /* L */
-               output_buffer[outpos++] = (uint8_t)(s16 & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((s16 >> 8) & 0xFF);
-               /* R */
-               output_buffer[outpos++] = (uint8_t)(s16 & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((s16 >> 8) & 0xFF);
-            }
-            else if (pb->fm->container == 24)
-            {
-               /* L */
-               output_buffer[outpos++] = (uint8_t)(mono & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 16) & 0xFF);
-               /* R */
-               output_buffer[outpos++] = (uint8_t)(mono & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 16) & 0xFF);
-            }
-            else
-            {
-               /* L */
-               output_buffer[outpos++] = (uint8_t)(mono & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 16) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 24) & 0xFF);
-               /* R */
-               output_buffer[outpos++] = (uint8_t)(mono & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 8) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 16) & 0xFF);
-               output_buffer[outpos++] = (uint8_t)((mono >> 24) & 0xFF);
-            }
-         }
+      if (pb->bytes_left / bytes_per_frame < frames)
+      {
+         frames = (snd_pcm_uframes_t)(pb->bytes_left / bytes_per_frame);
       }
 
-      frames_to_write = frames_read;
-      w = snd_pcm_writei(pcm_handle, output_buffer, frames_to_write);
-
-      if (w == -EPIPE)
+      if (frames == 0)
       {
-         snd_pcm_prepare(pcm_handle);
-         w = snd_pcm_writei(pcm_handle, output_buffer, frames_to_write);
+         break;
       }
 
-      if (w < 0)
+      /* The samples go from the ringbuffer to the device unchanged */
+      if (pb->mmap)
+      {
+         if (output_begin(pb, scratch, &frames, &dst))
+         {
+            interrupted = true;
+            break;
+         }
+
+         bytes = (size_t)frames * bytes_per_frame;
+         if (read_exact(pb, fp, dst, bytes))
+         {
+            break;
+         }
+
+         err = output_commit(pb, dst, frames, bytes_per_frame);
+      }
+      else
       {
-         if ((err = snd_pcm_recover(pcm_handle, (int)w, 0)) < 0)
+         bytes = (size_t)frames * bytes_per_frame;
+         block = read_block(pb, fp, scratch, bytes);
+         if (block == NULL)
          {
             break;
          }
+
+         err = writei_all(pb, (void*)block, frames, bytes_per_frame);
+         release_block(pb->pf, block, scratch, bytes);
+      }
+
+      pb->bytes_left -= bytes;
+
+      if (err)
+      {
+         interrupted = true;
+         break;
       }
 
       p = get_progress(pb);
-      pb->current_samples += (unsigned long)frames_read;
+      pb->current_samples += (unsigned long)frames;
 
-      kb = do_keyboard(NULL, f, pb, &k);
+      kb = do_keyboard(fp, NULL, pb, &k);
 
       if (kb == 1 || kb == 2)
       {
@@ -930,12 +1406,10 @@ playback_sndfile(snd_pcm_t* pcm_handle, struct playback* pb, int number, int tot
 
          free(p);
          p = NULL;
+         interrupted = true;
          break;
       }
 
-      memset(input_buffer, 0, input_buffer_size);
-      memset(output_buffer, 0, output_buffer_size);
-
       if (p != NULL)
       {
          printf("%s", p);
@@ -956,135 +1430,117 @@ playback_sndfile(snd_pcm_t* pcm_handle, struct playback* pb, int number, int tot
       }
    }
 
-   snd_pcm_drain(pcm_handle);
+   /* Leave the tail queued so that the next file follows without a gap,
+    * a skip throws it away */
+   if (interrupted)
+   {
+      snd_pcm_drop(pcm_handle);
+   }
 
    pb->bytes_left = 0;
+   pb->wav = NULL;
+   stop_prefetch(pb);
    if (pb->rb != NULL)
    {
       hrmp_ringbuffer_reset(pb->rb);
    }
    print_progress_done(pb);
 
-   free(input_buffer);
-   free(output_buffer);
-   free(info);
-
-   sf_close(f);
+   free(scratch);
    fclose(fp);
 
    return 0;
 
 error:
 
-   if (input_buffer)
-   {
-      free(input_buffer);
-   }
-   if (output_buffer)
-   {
-      free(output_buffer);
-   }
-   if (info)
-   {
-      free(info);
-   }
-   if (f)
-   {
-      sf_close(f);
-   }
-   if (fp)
-   {
-      fclose(fp);
-   }
+   pb->wav = NULL;
+   free(scratch);
+   fclose(fp);
+   stop_prefetch(pb);
 
    return 1;
 }
 
-static uint8_t
-bitrev8(uint8_t x)
+static void
+dsd_pack_dop(hrmp_pack_dsd_kernel kernel, const uint8_t* in, size_t per_ch, uint32_t in_channels,
+             size_t first, size_t frames, uint8_t* out, uint8_t* marker)
 {
-   x = (x >> 4) | (x << 4);
-   x = ((x & 0xCC) >> 2) | ((x & 0x33) << 2);
-   x = ((x & 0xAA) >> 1) | ((x & 0x55) << 1);
+   /* Source ch0 and ch1 if present, else duplicate ch0 to both */
+   const uint8_t* lp = in + first * 2u;
+   const uint8_t* rp = in + (in_channels >= 2 ? per_ch : 0) + first * 2u;
 
-   return x;
+   kernel(lp, rp, frames, out, marker);
 }
 
-static int
-read_exact(FILE* f, struct ringbuffer* rb, void* buf, size_t n, size_t bytes_left)
+static void
+dsd_pack_native(hrmp_pack_dsd_kernel kernel, const uint8_t* in, size_t per_ch, uint32_t in_channels,
+                bool interleaved, size_t first, size_t frames, uint8_t* out)
 {
-   if (rb == NULL)
-   {
-      return fread(buf, 1, n, f) == n ? 0 : -1;
-   }
-
-   uint8_t* out = (uint8_t*)buf;
-   size_t off = 0;
+   uint32_t cL = 0;
+   uint32_t cR = (in_channels >= 2 ? 1u : 0u);
+   size_t woff = 0;
 
-   while (off < n)
+   if (interleaved)
    {
-      size_t remaining = n - off;
-
-      while (hrmp_ringbuffer_size(rb) < remaining)
+      for (size_t i = first; i < first + frames; ++i)
       {
-         size_t bytes_remaining = bytes_left > off ? bytes_left - off : 0;
-         size_t buffered = hrmp_ringbuffer_size(rb);
-         size_t to_read_limit = bytes_remaining > buffered ? bytes_remaining - buffered : 0;
-         if (to_read_limit == 0)
-         {
-            return -1;
-         }
-
-         if (hrmp_ringbuffer_ensure_write(rb, 1))
-         {
-            return -1;
-         }
+         size_t base = i * (size_t)in_channels * 4u;
 
-         void* wp = NULL;
-         size_t span = hrmp_ringbuffer_get_write_span(rb, &wp);
-         if (span == 0)
-         {
-            if (hrmp_ringbuffer_ensure_write(rb, hrmp_ringbuffer_capacity(rb) / 2u))
-            {
-               return -1;
-            }
-            continue;
-         }
-         if (span > to_read_limit)
-         {
-            span = to_read_limit;
-         }
+         out[woff + 0] = in[base + 0 * (size_t)in_channels + cL];
+         out[woff + 1] = in[base + 1 * (size_t)in_channels + cL];
+         out[woff + 2] = in[base + 2 * (size_t)in_channels + cL];
+         out[woff + 3] = in[base + 3 * (size_t)in_channels + cL];
 
-         size_t got = fread(wp, 1, span, f);
-         if (got == 0)
-         {
-            return -1;
-         }
+         out[woff + 4] = in[base + 0 * (size_t)in_channels + cR];
+         out[woff + 5] = in[base + 1 * (size_t)in_channels + cR];
+         out[woff + 6] = in[base + 2 * (size_t)in_channels + cR];
+         out[woff + 7] = in[base + 3 * (size_t)in_channels + cR];
 
-         if (hrmp_ringbuffer_produce(rb, got))
-         {
-            return -1;
-         }
+         woff += 8;
       }
+   }
+   else
+   {
+      kernel(in + (size_t)cL * per_ch + first * 4u, in + (size_t)cR * per_ch + first * 4u, frames, out, NULL);
+   }
+}
 
-      void* rp = NULL;
-      size_t have = hrmp_ringbuffer_peek(rb, &rp);
-      if (have == 0)
-      {
-         continue;
-      }
+static int
+read_exact(struct playback* pb, FILE* f, void* buf, size_t n)
+{
+   return read_some(pb, f, pb->pf, buf, n) == n ? 0 : -1;
+}
 
-      size_t take = remaining < have ? remaining : have;
-      memcpy(out + off, rp, take);
-      hrmp_ringbuffer_consume(rb, take);
-      off += take;
-      if (bytes_left > off)
+/* Hand out n bytes straight from the ringbuffer when they are contiguous,
+ * otherwise copy them into scratch */
+static const uint8_t*
+read_block(struct playback* pb, FILE* f, uint8_t* scratch, size_t n)
+{
+   void* p = NULL;
+   struct prefetch* pf = pb->pf;
+
+   if (pf != NULL)
+   {
+      uint64_t start = hrmp_stats_now();
+      size_t fill = hrmp_prefetch_buffered(pf);
+
+      if (hrmp_prefetch_peek(pf, n, &p) >= n)
       {
-         prefill_ringbuffer_limit(f, rb, bytes_left - off);
+         hrmp_stats_read(&pb->stats, start, fill, !atomic_load(&pf->eof));
+         return (const uint8_t*)p;
       }
    }
 
-   return 0;
+   return read_exact(pb, f, scratch, n) == 0 ? scratch : NULL;
+}
+
+static void
+release_block(struct prefetch* pf, const uint8_t* block, const uint8_t* scratch, size_t n)
+{
+   if (block != scratch)
+   {
+      hrmp_prefetch_consume(pf, n);
+   }
 }
 
 static int
@@ -1103,11 +1559,6 @@ playback_dsf(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       goto error;
    }
 
-   if (pb->rb != NULL)
-   {
-      hrmp_ringbuffer_reset(pb->rb);
-   }
-
    /* Seek to the data segment */
    if (fseek(f, 92, SEEK_SET) != 0)
    {
@@ -1115,11 +1566,7 @@ playback_dsf(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       goto error;
    }
 
-   if (pb->rb != NULL)
-   {
-      hrmp_ringbuffer_reset(pb->rb);
-      prefill_ringbuffer_limit(f, pb->rb, pb->fm->data_size);
-   }
+   start_prefetch(pb, 92, 92 + pb->fm->data_size);
 
    uint32_t ch_in = pb->fm->channels > 0 ? pb->fm->channels : 2;
    uint32_t stride = pb->fm->block_size > 0 ? pb->fm->block_size : 4096;
@@ -1147,6 +1594,7 @@ error:
    {
       fclose(f);
    }
+   stop_prefetch(pb);
 
    return 1;
 }
@@ -1168,11 +1616,6 @@ playback_dff(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       goto error;
    }
 
-   if (pb->rb != NULL)
-   {
-      hrmp_ringbuffer_reset(pb->rb);
-   }
-
    if (fread(id4, 1, 4, f) != 4 || strncmp(id4, "FRM8", 4) != 0)
    {
       hrmp_log_error("Not a DFF file for playback");
@@ -1196,10 +1639,10 @@ playback_dff(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       uint64_t chunk_size = hrmp_read_be_u64(f);
       if (strncmp(id4, "DSD ", 4) == 0)
       {
-         if (pb->rb != NULL)
+         off_t data_start = ftello(f);
+         if (data_start >= 0)
          {
-            hrmp_ringbuffer_reset(pb->rb);
-            prefill_ringbuffer_limit(f, pb->rb, chunk_size);
+            start_prefetch(pb, (uint64_t)data_start, (uint64_t)data_start + chunk_size);
          }
 
          uint32_t ch_in = pb->fm->channels > 0 ? pb->fm->channels : 2;
@@ -1244,6 +1687,7 @@ error:
    {
       fclose(f);
    }
+   stop_prefetch(pb);
 
    return 1;
 }
@@ -1257,14 +1701,12 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
    *next = true;
 
    pb->bytes_left = pb->file_size;
-   if (pb->rb != NULL)
-   {
-      hrmp_ringbuffer_reset(pb->rb);
-   }
+   start_prefetch(pb, 0, pb->file_size);
 
-   if (hrmp_mkv_open_path_rb(pb->fm->name, pb->rb, pb->file_size, &pb->bytes_left, &demux) < 0 || !demux)
+   if (hrmp_mkv_open_path_prefetch(pb->fm->name, pb->pf, pb->file_size, &pb->bytes_left, &demux) < 0 || !demux)
    {
       hrmp_log_error("MKV: open failed: %s", pb->fm->name);
+      stop_prefetch(pb);
       return 1;
    }
    if (hrmp_mkv_get_audio_info(demux, &ai) < 0)
@@ -1285,7 +1727,12 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       goto error;
    }
 
+   hrmp_pack_kernel downmix = hrmp_pack_select(bps8 == 2 ? HRMP_PACK_S16_LE :
+                                                bps8 == 3 ? HRMP_PACK_S24_LE : HRMP_PACK_S32,
+                                                in_channels);
+
    int64_t last_pts_ns = -1;
+   bool interrupted = false;
 
    for (;;)
    {
@@ -1296,6 +1743,7 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       kb = do_keyboard(NULL, NULL, pb, &k);
       if (kb == 1 || kb == 2)
       {
+         interrupted = true;
          break;
       }
       else if (kb == 3)
@@ -1304,12 +1752,13 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
          uint64_t target_ns = (sr > 0) ? (target_samples * 1000000000ULL) / (uint64_t)sr : 0ULL;
 
          hrmp_mkv_close(demux);
+         demux = NULL;
          pb->bytes_left = pb->file_size;
-         if (pb->rb != NULL)
+         if (pb->pf != NULL)
          {
-            hrmp_ringbuffer_reset(pb->rb);
+            hrmp_prefetch_seek(pb->pf, 0);
          }
-         if (hrmp_mkv_open_path_rb(pb->fm->name, pb->rb, pb->file_size, &pb->bytes_left, &demux) < 0 || !demux)
+         if (hrmp_mkv_open_path_prefetch(pb->fm->name, pb->pf, pb->file_size, &pb->bytes_left, &demux) < 0 || !demux)
          {
             hrmp_log_error("MKV: reopen failed for seek");
             goto error;
@@ -1358,7 +1807,7 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       if (in_channels == 2)
       {
          size_t out_bpf = (size_t)2 * (size_t)bps8;
-         writei_all(pcm_handle, pkt.data, (snd_pcm_uframes_t)in_frames, out_bpf);
+         writei_all(pb, pkt.data, (snd_pcm_uframes_t)in_frames, out_bpf);
       }
       else
       {
@@ -1372,77 +1821,9 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
             goto error;
          }
 
-         if (bps8 == 2)
-         {
-            const int16_t* in = (const int16_t*)pkt.data;
-            size_t w = 0;
-            for (size_t i = 0; i < in_frames; ++i)
-            {
-               int64_t acc = 0;
-               for (unsigned ch = 0; ch < in_channels; ++ch)
-               {
-                  acc += (int64_t)in[i * in_channels + ch];
-               }
-               int16_t s = (int16_t)(acc / (int64_t)in_channels);
-               /* L */
-               out[w++] = (uint8_t)(s & 0xFF);
-               out[w++] = (uint8_t)((s >> 8) & 0xFF);
-               /* R */
-               out[w++] = (uint8_t)(s & 0xFF);
-               out[w++] = (uint8_t)((s >> 8) & 0xFF);
-            }
-         }
-         else if (bps8 == 3)
-         {
-            const uint8_t* in = (const uint8_t*)pkt.data;
-            size_t w = 0;
-            for (size_t i = 0; i < in_frames; ++i)
-            {
-               int64_t acc = 0;
-               for (unsigned ch = 0; ch < in_channels; ++ch)
-               {
-                  const uint8_t* p = &in[(i * in_channels + ch) * 3];
-                  int32_t v = (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16));
-                  if (p[2] & 0x80)
-                  {
-                     v |= 0xFF000000;
-                  }
-                  acc += (int64_t)v;
-               }
-               int32_t s = (int32_t)(acc / (int64_t)in_channels);
-               /* L */
-               out[w++] = (uint8_t)(s & 0xFF);
-               out[w++] = (uint8_t)((s >> 8) & 0xFF);
-               out[w++] = (uint8_t)((s >> 16) & 0xFF);
-               /* R */
-               out[w++] = (uint8_t)(s & 0xFF);
-               out[w++] = (uint8_t)((s >> 8) & 0xFF);
-               out[w++] = (uint8_t)((s >> 16) & 0xFF);
-            }
-         }
-         else if (bps8 == 4)
+         if (bps8 >= 2 && bps8 <= 4)
          {
-            const int32_t* in = (const int32_t*)pkt.data;
-            size_t w = 0;
-            for (size_t i = 0; i < in_frames; ++i)
-            {
-               int64_t acc = 0;
-               for (unsigned ch = 0; ch < in_channels; ++ch)
-               {
-                  acc += (int64_t)in[i * in_channels + ch];
-               }
-               int32_t s = (int32_t)(acc / (int64_t)in_channels);
-               /* L */
-               out[w++] = (uint8_t)(s & 0xFF);
-               out[w++] = (uint8_t)((s >> 8) & 0xFF);
-               out[w++] = (uint8_t)((s >> 16) & 0xFF);
-               out[w++] = (uint8_t)((s >> 24) & 0xFF);
-               /* R */
-               out[w++] = (uint8_t)(s & 0xFF);
-               out[w++] = (uint8_t)((s >> 8) & 0xFF);
-               out[w++] = (uint8_t)((s >> 16) & 0xFF);
-               out[w++] = (uint8_t)((s >> 24) & 0xFF);
-            }
+            downmix(pkt.data, in_channels, in_frames, out);
          }
          else
          {
@@ -1452,7 +1833,7 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
             goto error;
          }
 
-         writei_all(pcm_handle, out, (snd_pcm_uframes_t)in_frames, out_bpf);
+         writei_all(pb, out, (snd_pcm_uframes_t)in_frames, out_bpf);
          free(out);
       }
 
@@ -1501,21 +1882,28 @@ playback_mkv(snd_pcm_t* pcm_handle, struct playback* pb, int number, int total,
       }
    }
 
-   snd_pcm_drain(pcm_handle);
+   /* Leave the tail queued so that the next file follows without a gap,
+    * a skip throws it away */
+   if (interrupted)
+   {
+      snd_pcm_drop(pcm_handle);
+   }
 
    pb->bytes_left = 0;
+   hrmp_mkv_close(demux);
+   stop_prefetch(pb);
    if (pb->rb != NULL)
    {
       hrmp_ringbuffer_reset(pb->rb);
    }
    print_progress_done(pb);
-   hrmp_mkv_close(demux);
    return 0;
 
 error:
 
    print_progress_done(pb);
    hrmp_mkv_close(demux);
+   stop_prefetch(pb);
    return 1;
 }
 
@@ -1533,7 +1921,7 @@ fmt2(int v, char out[3])
 }
 
 static char*
-format_output(struct playback* pb)
+format_output(struct playback* pb, unsigned long position)
 {
    char* fmt = NULL;
    char* fname = NULL;
@@ -1559,12 +1947,12 @@ format_output(struct playback* pb)
    /* Current time from samples and sample_rate */
    if (pb->fm->sample_rate > 0)
    {
-      if (pb->current_samples >= pb->fm->total_samples)
+      if (position >= pb->fm->total_samples)
       {
-         pb->current_samples = pb->fm->total_samples;
+         position = pb->fm->total_samples;
       }
 
-      current = (double)pb->current_samples / (double)pb->fm->sample_rate;
+      current = (double)position / (double)pb->fm->sample_rate;
    }
    else
    {
@@ -1643,7 +2031,7 @@ format_output(struct playback* pb)
                }
 
                if (percent > 100 ||
-                   (pb->current_samples >= pb->fm->total_samples))
+                   (position >= pb->fm->total_samples))
                {
                   percent = 100;
                }
@@ -1689,7 +2077,7 @@ format_output(struct playback* pb)
 
             case 'b':
             {
-               uint64_t bytes = (pb->rb != NULL) ? (uint64_t)hrmp_ringbuffer_size(pb->rb) : 0;
+               uint64_t bytes = (pb->pf != NULL) ? (uint64_t)hrmp_prefetch_buffered(pb->pf) : 0;
                uint64_t denom = 1024u * 1024u;
                uint64_t tenths = (bytes * 10u + denom / 2u) / denom;
                out = hrmp_append_int(out, (int)(tenths / 10u));
@@ -1972,7 +2360,22 @@ static char*
 get_progress(struct playback* pb)
 {
    char* print = NULL;
-   char* formatted = format_output(pb);
+   char* formatted = NULL;
+   uint64_t now = hrmp_stats_now();
+
+   /* Refresh on a clock rather than on every period */
+   if (pb->progress_ns != 0 && now - pb->progress_ns < PROGRESS_INTERVAL_NS)
+   {
+      return NULL;
+   }
+   pb->progress_ns = now;
+
+   if (pb->current_samples >= pb->fm->total_samples)
+   {
+      pb->current_samples = pb->fm->total_samples;
+   }
+
+   formatted = format_output(pb, audible_samples(pb));
 
    if (formatted != NULL)
    {
@@ -1993,7 +2396,7 @@ print_progress_done(struct playback* pb)
    /* Change playback */
    pb->current_samples = pb->fm->total_samples;
 
-   formatted = format_output(pb);
+   formatted = format_output(pb, pb->current_samples);
 
    if (formatted != NULL)
    {
@@ -2026,6 +2429,8 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
    size_t pre_bytes = (size_t)pre * bytes_per_frame;
    uint8_t* pr = (uint8_t*)malloc(pre_bytes);
 
+   bool interrupted = false;
+
    *next = true;
 
    if (pr)
@@ -2045,7 +2450,7 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
          }
          m = (m == DOP_MARKER_8LSB) ? DOP_MARKER_8MSB : DOP_MARKER_8LSB;
       }
-      snd_pcm_writei(pb->pcm_handle, pr, pre);
+      writei_all(pb, pr, pre, bytes_per_frame);
       free(pr);
    }
    else
@@ -2055,6 +2460,7 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
    }
 
    uint8_t marker = DOP_MARKER_8LSB;
+   hrmp_pack_dsd_kernel kernel = hrmp_pack_dsd_select(HRMP_PACK_DSD_DOP);
 
    size_t in_batch_max = (size_t)in_channels * (size_t)stride;
    uint8_t* blk = (uint8_t*)malloc(in_batch_max);
@@ -2077,6 +2483,9 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
       return 1;
    }
 
+   prefault(blk, in_batch_max);
+   prefault(out, out_cap);
+
    pb->bytes_left = bytes_left;
    while (bytes_left > 0)
    {
@@ -2093,7 +2502,8 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
       }
 
       size_t to_read = (size_t)in_channels * (size_t)per_ch;
-      if (read_exact(f, pb->rb, blk, to_read, bytes_left) < 0)
+      const uint8_t* in = read_block(pb, f, blk, to_read);
+      if (in == NULL)
       {
          break;
       }
@@ -2114,70 +2524,41 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
          out_cap = need;
       }
 
-      size_t woff = 0;
-      for (size_t i = 0; i < frames; ++i)
-      {
-         /* Source ch0 and ch1 if present, else duplicate ch0 to both */
-         uint32_t cL = 0;
-         uint32_t cR = (in_channels >= 2 ? 1u : 0u);
-
-         const uint8_t* lp = blk + (size_t)cL * (size_t)per_ch + (size_t)i * 2u;
-         const uint8_t* rp = blk + (size_t)cR * (size_t)per_ch + (size_t)i * 2u;
-
-         uint8_t l0 = bitrev8(lp[0]), l1 = bitrev8(lp[1]);
-         uint8_t r0 = bitrev8(rp[0]), r1 = bitrev8(rp[1]);
-
-         uint8_t t;
-         t = l0;
-         l0 = l1;
-         l1 = t;
-         t = r0;
-         r0 = r1;
-         r1 = t;
-
-         /* L */
-         out[woff + 0] = 0x00;
-         out[woff + 1] = l0;
-         out[woff + 2] = l1;
-         out[woff + 3] = marker;
-         /* R */
-         out[woff + 4] = 0x00;
-         out[woff + 5] = r0;
-         out[woff + 6] = r1;
-         out[woff + 7] = marker;
-         woff += 8;
+      size_t done_frames = 0;
+      while (done_frames < frames)
+      {
+         snd_pcm_uframes_t n = (snd_pcm_uframes_t)(frames - done_frames);
+         uint8_t* dst = NULL;
 
-         marker = (marker == DOP_MARKER_8LSB) ? DOP_MARKER_8MSB : DOP_MARKER_8LSB;
+         if (output_begin(pb, out, &n, &dst))
+         {
+            release_block(pb->pf, in, blk, to_read);
+            interrupted = true;
+            goto done;
+         }
+
+         dsd_pack_dop(kernel, in, per_ch, in_channels, done_frames, n, dst, &marker);
+
+         if (output_commit(pb, dst, n, bytes_per_frame))
+         {
+            hrmp_log_error("ALSA write failed");
+            release_block(pb->pf, in, blk, to_read);
+            interrupted = true;
+            goto done;
+         }
+
+         done_frames += n;
       }
 
-      /* Write */
-      snd_pcm_sframes_t to_write = (snd_pcm_sframes_t)frames;
-      const uint8_t* bytes = out;
-      while (to_write > 0)
+      release_block(pb->pf, in, blk, to_read);
+
       {
          char* p = NULL;
          char* k = NULL;
          int kb = 0;
-         snd_pcm_sframes_t n = snd_pcm_writei(pb->pcm_handle, bytes, to_write);
-         if (n < 0)
-         {
-            n = snd_pcm_recover(pb->pcm_handle, (int)n, 1);
-            if (n < 0)
-            {
-               hrmp_log_error("ALSA write failed: %s", snd_strerror((int)n));
-               goto done;
-            }
-            continue;
-         }
-         if (n > to_write)
-         {
-            n = to_write;
-         }
-         bytes += (size_t)n * bytes_per_frame;
-         to_write -= n;
 
          /* Each DoP PCM frame carries 16 DSD samples per channel */
-         pb->current_samples += (unsigned long)(n * 16u);
+         pb->current_samples += (unsigned long)(frames * 16u);
          if (pb->fm->total_samples > 0 && pb->current_samples >= pb->fm->total_samples)
          {
             bytes_left = 0;
@@ -2194,6 +2575,7 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
                *next = false;
             }
             free(k);
+            interrupted = true;
             goto done;
          }
 
@@ -2222,6 +2604,14 @@ dsd_play_dop_s32le(FILE* f, struct playback* pb,
    }
 
 done:
+   if (interrupted)
+   {
+      /* A skip throws away what is queued. The silence below stays
+       * queued in front of the next file like at the end of a file */
+      snd_pcm_drop(pb->pcm_handle);
+      snd_pcm_prepare(pb->pcm_handle);
+   }
+
    write_dsd_fadeout(pb, HRMP_DSD_FADEOUT_MS, &marker);
 
    snd_pcm_uframes_t buffer_size = 0, period_size = 0;
@@ -2232,9 +2622,8 @@ done:
    unsigned post_frames = frames_from_ms(pb, HRMP_DSD_POSTROLL_MS);
    write_dsd_center_pad(pb, post_frames, &marker);
 
-   snd_pcm_drain(pb->pcm_handle);
-
    pb->bytes_left = 0;
+   stop_prefetch(pb);
    if (pb->rb != NULL)
    {
       hrmp_ringbuffer_reset(pb->rb);
@@ -2279,8 +2668,13 @@ dsd_play_native_u32_be(FILE* f, struct playback* pb,
       return 1;
    }
 
+   prefault(blk, in_batch_max);
+   prefault(out, out_cap);
+
    bool need_bit_reverse = (pb->fm->type == TYPE_DSF);
    bool interleaved = (pb->fm->type == TYPE_DFF);
+   bool interrupted = false;
+   hrmp_pack_dsd_kernel kernel = hrmp_pack_dsd_select(need_bit_reverse ? HRMP_PACK_DSD_U32_BE_REV : HRMP_PACK_DSD_U32_BE);
 
    pb->bytes_left = bytes_left;
    while (bytes_left > 0)
@@ -2298,7 +2692,8 @@ dsd_play_native_u32_be(FILE* f, struct playback* pb,
       }
 
       size_t to_read = (size_t)in_channels * (size_t)per_ch;
-      if (read_exact(f, pb->rb, blk, to_read, bytes_left) < 0)
+      const uint8_t* in = read_block(pb, f, blk, to_read);
+      if (in == NULL)
       {
          break;
       }
@@ -2319,106 +2714,41 @@ dsd_play_native_u32_be(FILE* f, struct playback* pb,
          out_cap = need;
       }
 
-      size_t woff = 0;
-      if (interleaved)
+      size_t done_frames = 0;
+      while (done_frames < frames)
       {
-         uint32_t cL = 0;
-         uint32_t cR = (in_channels >= 2 ? 1u : 0u);
+         snd_pcm_uframes_t n = (snd_pcm_uframes_t)(frames - done_frames);
+         uint8_t* dst = NULL;
 
-         for (size_t i = 0; i < frames; ++i)
+         if (output_begin(pb, out, &n, &dst))
          {
-            size_t base = i * (size_t)in_channels * 4u;
-
-            uint8_t lb0 = blk[base + 0 * (size_t)in_channels + cL];
-            uint8_t lb1 = blk[base + 1 * (size_t)in_channels + cL];
-            uint8_t lb2 = blk[base + 2 * (size_t)in_channels + cL];
-            uint8_t lb3 = blk[base + 3 * (size_t)in_channels + cL];
-
-            uint8_t rb0 = blk[base + 0 * (size_t)in_channels + cR];
-            uint8_t rb1 = blk[base + 1 * (size_t)in_channels + cR];
-            uint8_t rb2 = blk[base + 2 * (size_t)in_channels + cR];
-            uint8_t rb3 = blk[base + 3 * (size_t)in_channels + cR];
-
-            out[woff + 0] = lb0;
-            out[woff + 1] = lb1;
-            out[woff + 2] = lb2;
-            out[woff + 3] = lb3;
-
-            out[woff + 4] = rb0;
-            out[woff + 5] = rb1;
-            out[woff + 6] = rb2;
-            out[woff + 7] = rb3;
-
-            woff += 8;
+            release_block(pb->pf, in, blk, to_read);
+            interrupted = true;
+            goto done;
          }
-      }
-      else
-      {
-         for (size_t i = 0; i < frames; ++i)
-         {
-            uint32_t cL = 0;
-            uint32_t cR = (in_channels >= 2 ? 1u : 0u);
-
-            const uint8_t* lp = blk + (size_t)cL * (size_t)per_ch + (size_t)i * 4u;
-            const uint8_t* rp = blk + (size_t)cR * (size_t)per_ch + (size_t)i * 4u;
 
-            if (need_bit_reverse)
-            {
-               out[woff + 0] = bitrev8(lp[0]);
-               out[woff + 1] = bitrev8(lp[1]);
-               out[woff + 2] = bitrev8(lp[2]);
-               out[woff + 3] = bitrev8(lp[3]);
-
-               out[woff + 4] = bitrev8(rp[0]);
-               out[woff + 5] = bitrev8(rp[1]);
-               out[woff + 6] = bitrev8(rp[2]);
-               out[woff + 7] = bitrev8(rp[3]);
-            }
-            else
-            {
-               out[woff + 0] = lp[0];
-               out[woff + 1] = lp[1];
-               out[woff + 2] = lp[2];
-               out[woff + 3] = lp[3];
-
-               out[woff + 4] = rp[0];
-               out[woff + 5] = rp[1];
-               out[woff + 6] = rp[2];
-               out[woff + 7] = rp[3];
-            }
+         dsd_pack_native(kernel, in, per_ch, in_channels, interleaved, done_frames, n, dst);
 
-            woff += 8;
+         if (output_commit(pb, dst, n, bytes_per_frame))
+         {
+            hrmp_log_error("ALSA write failed");
+            release_block(pb->pf, in, blk, to_read);
+            interrupted = true;
+            goto done;
          }
+
+         done_frames += n;
       }
 
-      snd_pcm_sframes_t to_write = (snd_pcm_sframes_t)frames;
-      const uint8_t* bytes = out;
-      while (to_write > 0)
+      release_block(pb->pf, in, blk, to_read);
+
       {
          char* p = NULL;
          char* k = NULL;
          int kb = 0;
-         snd_pcm_sframes_t n = snd_pcm_writei(pb->pcm_handle, bytes, to_write);
-
-         if (n < 0)
-         {
-            n = snd_pcm_recover(pb->pcm_handle, (int)n, 1);
-            if (n < 0)
-            {
-               hrmp_log_error("ALSA write failed: %s", snd_strerror((int)n));
-               goto done;
-            }
-            continue;
-         }
-         if (n > to_write)
-         {
-            n = to_write;
-         }
-         bytes += (size_t)n * bytes_per_frame;
-         to_write -= n;
 
          /* Each native DSD_U32_BE frame carries 32 DSD samples per channel */
-         pb->current_samples += (unsigned long)(n * 32u);
+         pb->current_samples += (unsigned long)(frames * 32u);
          if (pb->fm->total_samples > 0 && pb->current_samples >= pb->fm->total_samples)
          {
             bytes_left = 0;
@@ -2434,6 +2764,8 @@ dsd_play_native_u32_be(FILE* f, struct playback* pb,
             {
                *next = false;
             }
+            free(k);
+            interrupted = true;
             goto done;
          }
 
@@ -2461,6 +2793,14 @@ dsd_play_native_u32_be(FILE* f, struct playback* pb,
    }
 
 done:
+   if (interrupted)
+   {
+      /* A skip throws away what is queued. The silence below stays
+       * queued in front of the next file like at the end of a file */
+      snd_pcm_drop(pb->pcm_handle);
+      snd_pcm_prepare(pb->pcm_handle);
+   }
+
 {
    uint8_t m_ignored = DOP_MARKER_8LSB;
    write_dsd_fadeout(pb, HRMP_DSD_FADEOUT_MS, &m_ignored);
@@ -2473,9 +2813,8 @@ done:
    write_dsd_center_pad(pb, post_frames, &m_ignored);
 }
 
-   snd_pcm_drain(pb->pcm_handle);
-
    pb->bytes_left = 0;
+   stop_prefetch(pb);
    if (pb->rb != NULL)
    {
       hrmp_ringbuffer_reset(pb->rb);
@@ -2501,7 +2840,18 @@ do_keyboard(FILE* f, SNDFILE* sndf, struct playback* pb, char** print)
 
 keyboard:
    k = NULL;
-   keyboard_action = hrmp_keyboard_get(&k);
+   keyboard_action = KEYBOARD_IGNORE;
+
+   if (hrmp_event_input(pb->ev))
+   {
+      keyboard_action = hrmp_keyboard_get(&k);
+
+      if (feof(stdin))
+      {
+         /* read() returned 0, poll() would report stdin ready forever */
+         hrmp_event_close_input(pb->ev);
+      }
+   }
 
    if (keyboard_action == KEYBOARD_Q)
    {
@@ -2512,26 +2862,25 @@ keyboard:
    }
    else if (keyboard_action == KEYBOARD_ENTER)
    {
+      if (config->active_device.is_paused)
+      {
+         pause_output(pb, false);
+      }
       free(k);
       return 1;
    }
    else if (keyboard_action == KEYBOARD_BACKSLASH)
    {
+      if (config->active_device.is_paused)
+      {
+         pause_output(pb, false);
+      }
       free(k);
       return 2;
    }
    else if (keyboard_action == KEYBOARD_SPACE)
    {
-      if (config->active_device.is_paused)
-      {
-         config->active_device.is_paused = false;
-      }
-      else
-      {
-         config->active_device.is_paused = true;
-         free(k);
-         SLEEP_AND_GOTO(10000L, keyboard);
-      }
+      pause_output(pb, !config->active_device.is_paused);
    }
    else if (keyboard_action == KEYBOARD_UP ||
             keyboard_action == KEYBOARD_DOWN ||
@@ -2580,7 +2929,8 @@ keyboard:
          delta_samples = (int64_t)((double)seconds * (pb->fm->total_samples / pb->fm->duration));
       }
 
-      new_pos_samples = (int64_t)pb->current_samples + delta_samples;
+      /* Seek from what is playing, not from what has been queued */
+      new_pos_samples = (int64_t)audible_samples(pb) + delta_samples;
 
       if (pb->fm->type == TYPE_DSF)
       {
@@ -2588,7 +2938,6 @@ keyboard:
 
          if (new_pos_samples <= 0)
          {
-            fseek(f, 92L, SEEK_SET);
             pb->current_samples = 0;
          }
          else
@@ -2604,7 +2953,6 @@ keyboard:
             {
                aligned_bytes = (pb->fm->data_size / bytes_group) * bytes_group;
             }
-            fseek(f, 92L + (long)aligned_bytes, SEEK_SET);
             pb->current_samples = (unsigned long)((aligned_bytes / (uint64_t)pb->fm->channels) * 8ULL);
             if (pb->current_samples >= pb->fm->total_samples)
             {
@@ -2614,10 +2962,13 @@ keyboard:
 
          pb->bytes_left = pb->fm->data_size - aligned_bytes;
 
-         if (pb->rb != NULL)
+         if (pb->pf != NULL)
          {
-            hrmp_ringbuffer_reset(pb->rb);
-            prefill_ringbuffer_limit(f, pb->rb, pb->fm->data_size - aligned_bytes);
+            hrmp_prefetch_seek(pb->pf, 92 + aligned_bytes);
+         }
+         else
+         {
+            fseek(f, 92L + (long)aligned_bytes, SEEK_SET);
          }
          hrmp_alsa_reset_handle(pb->pcm_handle);
       }
@@ -2626,8 +2977,33 @@ keyboard:
          free(k);
          return 1;
       }
+      else if (pb->wav != NULL)
+      {
+         uint64_t frames = pb->wav->data_size / pb->wav->block_align;
+         uint64_t target = 0;
+
+         if (new_pos_samples > 0)
+         {
+            target = (uint64_t)new_pos_samples < frames ? (uint64_t)new_pos_samples : frames;
+         }
+
+         pb->current_samples = (unsigned long)target;
+         pb->bytes_left = pb->wav->data_size - target * pb->wav->block_align;
+
+         if (pb->pf != NULL)
+         {
+            hrmp_prefetch_seek(pb->pf, pb->wav->data_offset + target * pb->wav->block_align);
+         }
+         else
+         {
+            fseeko(f, (off_t)(pb->wav->data_offset + target * pb->wav->block_align), SEEK_SET);
+         }
+         hrmp_alsa_reset_handle(pb->pcm_handle);
+      }
       else if (pb->fm->type != TYPE_MKV)
       {
+         hrmp_pipeline_suspend(pb->pl);
+
          if (new_pos_samples >= (int64_t)pb->fm->total_samples)
          {
             sf_seek(sndf, 0, SEEK_END);
@@ -2640,7 +3016,7 @@ keyboard:
          }
          else
          {
-            sf_seek(sndf, (sf_count_t)new_pos_samples, SEEK_CUR);
+            sf_seek(sndf, (sf_count_t)new_pos_samples, SEEK_SET);
             pb->current_samples = (unsigned long)new_pos_samples;
             if (pb->current_samples >= pb->fm->total_samples)
             {
@@ -2648,6 +3024,7 @@ keyboard:
             }
          }
 
+         hrmp_pipeline_resume(pb->pl);
          hrmp_alsa_reset_handle(pb->pcm_handle);
       }
       else
@@ -2761,12 +3138,13 @@ keyboard:
          }
       }
    }
-   else
+
+   /* Nothing is written while paused, so block until the next key */
+   if (config->active_device.is_paused)
    {
-      if (config->active_device.is_paused)
-      {
-         SLEEP_AND_GOTO(10000L, keyboard);
-      }
+      free(k);
+      wait_input(pb);
+      goto keyboard;
    }
 
    *print = k;
@@ -0,0 +1,888 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <blockcache.h>
+#include <logging.h>
+#include <prefetch.h>
+#include <reader.h>
+#include <realtime.h>
+#include <ringbuffer.h>
+
+/* system */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct mapping
+{
+   _Atomic(uint8_t*) base; /**< The start of the mapping, NULL for a free slot */
+   size_t size;            /**< The size of the mapping */
+   atomic_bool* truncated; /**< Set when a page past the end of the file was touched */
+};
+
+static struct mapping mappings[HRMP_PREFETCH_MAPPINGS];
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sigbus_once = PTHREAD_ONCE_INIT;
+static struct sigaction sigbus_previous;
+static bool sigbus_installed = false;
+static size_t page_size = 4096;
+
+static void* prefetch_thread(void* arg);
+static size_t prefetch_wait(struct prefetch* pf, size_t n);
+static size_t prefetch_wake_level(struct prefetch* pf);
+static void prefetch_fill(struct prefetch* pf);
+static void prefetch_publish(struct prefetch* pf, size_t n);
+static void prefetch_finish(struct prefetch* pf, atomic_bool* flag);
+static void prefetch_wake(struct prefetch* pf);
+static int prefetch_map(struct prefetch* pf, uint64_t offset, uint64_t end);
+static void prefetch_unmap(struct prefetch* pf);
+static void prefetch_advise(struct prefetch* pf);
+static bool prefetch_truncated(struct prefetch* pf);
+static void prefetch_sigbus_install(void);
+static void prefetch_sigbus(int sig, siginfo_t* info, void* context);
+
+int
+hrmp_prefetch_create(char* path, struct ringbuffer* rb, uint64_t offset, uint64_t end, size_t target,
+                     struct prefetch** out)
+{
+   size_t history;
+   pthread_attr_t attr;
+   struct prefetch* pf = NULL;
+   struct configuration* config = (struct configuration*)shmem;
+
+   *out = NULL;
+
+   if (path == NULL || rb == NULL || end < offset)
+   {
+      goto error;
+   }
+
+   pf = (struct prefetch*)malloc(sizeof(struct prefetch));
+   if (pf == NULL)
+   {
+      goto error;
+   }
+
+   memset(pf, 0, sizeof(struct prefetch));
+
+   pf->fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (pf->fd < 0)
+   {
+      hrmp_log_error("Prefetch: could not open '%s' (%s)", path, strerror(errno));
+      goto error;
+   }
+
+   hrmp_blockcache_file(pf->fd, &pf->file);
+
+   pf->pos = offset;
+   pf->end = end;
+
+   if (config != NULL && config->reader == HRMP_READER_MMAP && !prefetch_map(pf, offset, end))
+   {
+      hrmp_log_debug("Prefetch: reading '%s' with %s", path, hrmp_reader_name(HRMP_READER_MMAP));
+
+      /* Everything is available, so the segment never underruns */
+      atomic_init(&pf->eof, true);
+      atomic_init(&pf->error, false);
+
+      *out = pf;
+
+      return 0;
+   }
+
+   if (hrmp_reader_create(pf->fd, config != NULL ? config->reader : HRMP_READER_AUTO, &pf->reader))
+   {
+      hrmp_log_error("Prefetch: could not create a reader for '%s'", path);
+      goto error;
+   }
+
+   hrmp_log_debug("Prefetch: reading '%s' with %s", path, hrmp_reader_name(pf->reader->type));
+
+   posix_fadvise(pf->fd, (off_t)offset, (off_t)(end - offset), POSIX_FADV_SEQUENTIAL);
+
+   /* The ringbuffer grows to the smaller of the segment and its maximum */
+   history = rb->max;
+   if ((uint64_t)history > end - offset)
+   {
+      history = (size_t)(end - offset);
+   }
+
+   hrmp_ringbuffer_reset(rb);
+   hrmp_ringbuffer_set_history(rb, history / HRMP_PREFETCH_HISTORY_DIVISOR);
+   hrmp_ringbuffer_set_spsc(rb, true);
+
+   pf->rb = rb;
+   pf->read_pos = offset;
+   if (target == 0 || target > rb->max - rb->history)
+   {
+      target = rb->max - rb->history;
+   }
+
+   atomic_init(&pf->eof, false);
+   atomic_init(&pf->error, false);
+   atomic_init(&pf->consumer_waiting, false);
+   atomic_init(&pf->producer_waiting, false);
+   atomic_init(&pf->wake_level, 0);
+   atomic_init(&pf->target, target);
+
+   pthread_mutex_init(&pf->lock, NULL);
+   pthread_cond_init(&pf->cond, NULL);
+
+   hrmp_realtime_helper_attr(&attr);
+
+   if (pthread_create(&pf->thread, &attr, prefetch_thread, pf) != 0)
+   {
+      pthread_attr_destroy(&attr);
+      hrmp_log_error("Prefetch: could not start reader thread for '%s'", path);
+      pthread_cond_destroy(&pf->cond);
+      pthread_mutex_destroy(&pf->lock);
+      hrmp_ringbuffer_set_spsc(rb, false);
+      hrmp_ringbuffer_set_history(rb, 0);
+      goto error;
+   }
+
+   pthread_attr_destroy(&attr);
+
+   *out = pf;
+
+   return 0;
+
+error:
+
+   if (pf != NULL)
+   {
+      hrmp_reader_destroy(pf->reader);
+      if (pf->fd >= 0)
+      {
+         close(pf->fd);
+      }
+      free(pf);
+   }
+
+   return 1;
+}
+
+void
+hrmp_prefetch_destroy(struct prefetch* pf)
+{
+   if (pf == NULL)
+   {
+      return;
+   }
+
+   if (pf->map != NULL)
+   {
+      prefetch_unmap(pf);
+      close(pf->fd);
+      free(pf);
+      return;
+   }
+
+   pthread_mutex_lock(&pf->lock);
+   pf->stop = true;
+   pthread_cond_broadcast(&pf->cond);
+   pthread_mutex_unlock(&pf->lock);
+
+   pthread_join(pf->thread, NULL);
+
+   pthread_cond_destroy(&pf->cond);
+   pthread_mutex_destroy(&pf->lock);
+
+   hrmp_ringbuffer_set_spsc(pf->rb, false);
+   hrmp_ringbuffer_set_history(pf->rb, 0);
+
+   hrmp_reader_destroy(pf->reader);
+   close(pf->fd);
+   free(pf);
+}
+
+size_t
+hrmp_prefetch_read(struct prefetch* pf, void* buf, size_t n)
+{
+   uint8_t* out = (uint8_t*)buf;
+   size_t off = 0;
+
+   if (pf == NULL || buf == NULL)
+   {
+      return 0;
+   }
+
+   if (pf->map != NULL)
+   {
+      if ((uint64_t)n > pf->end - pf->pos)
+      {
+         n = (size_t)(pf->end - pf->pos);
+      }
+
+      memcpy(out, pf->map + pf->pos, n);
+
+      if (prefetch_truncated(pf))
+      {
+         return 0;
+      }
+
+      pf->pos += n;
+      prefetch_advise(pf);
+
+      return n;
+   }
+
+   while (off < n)
+   {
+      void* rp = NULL;
+      size_t have = hrmp_ringbuffer_peek(pf->rb, &rp);
+
+      if (have > 0)
+      {
+         size_t take = (n - off) < have ? (n - off) : have;
+         memcpy(out + off, rp, take);
+         hrmp_ringbuffer_consume(pf->rb, take);
+         pf->pos += take;
+         off += take;
+         prefetch_wake(pf);
+         continue;
+      }
+
+      if (prefetch_wait(pf, 1) == 0)
+      {
+         break;
+      }
+   }
+
+   return off;
+}
+
+size_t
+hrmp_prefetch_peek(struct prefetch* pf, size_t n, void** ptr)
+{
+   *ptr = NULL;
+
+   if (pf == NULL || n == 0)
+   {
+      return 0;
+   }
+
+   if (pf->map != NULL)
+   {
+      if (prefetch_truncated(pf) || pf->pos >= pf->end)
+      {
+         return 0;
+      }
+
+      *ptr = pf->map + pf->pos;
+      return (size_t)(pf->end - pf->pos);
+   }
+
+   if (prefetch_wait(pf, n) == 0)
+   {
+      return 0;
+   }
+
+   return hrmp_ringbuffer_peek(pf->rb, ptr);
+}
+
+void
+hrmp_prefetch_consume(struct prefetch* pf, size_t n)
+{
+   if (pf == NULL)
+   {
+      return;
+   }
+
+   if (pf->map != NULL)
+   {
+      pf->pos = (uint64_t)n < pf->end - pf->pos ? pf->pos + n : pf->end;
+      prefetch_advise(pf);
+      return;
+   }
+
+   hrmp_ringbuffer_consume(pf->rb, n);
+   pf->pos += n;
+   prefetch_wake(pf);
+}
+
+int
+hrmp_prefetch_seek(struct prefetch* pf, uint64_t offset)
+{
+   if (pf == NULL)
+   {
+      return 1;
+   }
+
+   if (offset > pf->end)
+   {
+      offset = pf->end;
+   }
+
+   if (pf->map != NULL)
+   {
+      pf->pos = offset;
+      pf->advised = offset;
+      if (pf->released > offset)
+      {
+         pf->released = offset - (offset % page_size);
+      }
+      prefetch_advise(pf);
+      return 0;
+   }
+
+   size_t buffered = hrmp_ringbuffer_size(pf->rb);
+   if (offset >= pf->pos && offset - pf->pos <= (uint64_t)buffered)
+   {
+      /* Forward inside the buffered window */
+      hrmp_ringbuffer_consume(pf->rb, (size_t)(offset - pf->pos));
+      pf->pos = offset;
+      prefetch_wake(pf);
+      return 0;
+   }
+
+   if (offset < pf->pos && pf->pos - offset <= (uint64_t)hrmp_ringbuffer_history(pf->rb))
+   {
+      /* Backward inside the history, the bytes are still held */
+      hrmp_ringbuffer_rewind(pf->rb, (size_t)(pf->pos - offset));
+      pf->pos = offset;
+      return 0;
+   }
+
+   pthread_mutex_lock(&pf->lock);
+
+   pf->seek_offset = offset;
+   pf->seek_pending = true;
+   pthread_cond_broadcast(&pf->cond);
+
+   while (pf->seek_pending)
+   {
+      pthread_cond_wait(&pf->cond, &pf->lock);
+   }
+
+   pthread_mutex_unlock(&pf->lock);
+
+   return 0;
+}
+
+void
+hrmp_prefetch_set_target(struct prefetch* pf, size_t target)
+{
+   if (pf == NULL || pf->map != NULL)
+   {
+      return;
+   }
+
+   if (target == 0 || target > pf->rb->max - pf->rb->history)
+   {
+      target = pf->rb->max - pf->rb->history;
+   }
+
+   pthread_mutex_lock(&pf->lock);
+   atomic_store(&pf->target, target);
+   pthread_cond_broadcast(&pf->cond);
+   pthread_mutex_unlock(&pf->lock);
+}
+
+uint64_t
+hrmp_prefetch_tell(struct prefetch* pf)
+{
+   return pf != NULL ? pf->pos : 0;
+}
+
+size_t
+hrmp_prefetch_buffered(struct prefetch* pf)
+{
+   if (pf != NULL && pf->map != NULL)
+   {
+      return pf->advised > pf->pos ? (size_t)(pf->advised - pf->pos) : 0;
+   }
+
+   return pf != NULL ? hrmp_ringbuffer_size(pf->rb) : 0;
+}
+
+/* Wait until n bytes are buffered or the segment is exhausted */
+static size_t
+prefetch_wait(struct prefetch* pf, size_t n)
+{
+   size_t buffered = hrmp_ringbuffer_size(pf->rb);
+   size_t target = atomic_load(&pf->target);
+
+   if (n > target)
+   {
+      n = target;
+   }
+
+   if (buffered >= n)
+   {
+      return buffered;
+   }
+
+   pthread_mutex_lock(&pf->lock);
+   atomic_store(&pf->consumer_waiting, true);
+   atomic_thread_fence(memory_order_seq_cst);
+   while ((buffered = hrmp_ringbuffer_size(pf->rb)) < n)
+   {
+      if (atomic_load(&pf->eof) || atomic_load(&pf->error))
+      {
+         buffered = hrmp_ringbuffer_size(pf->rb);
+         break;
+      }
+      pthread_cond_wait(&pf->cond, &pf->lock);
+   }
+   atomic_store(&pf->consumer_waiting, false);
+   pthread_mutex_unlock(&pf->lock);
+
+   return buffered;
+}
+
+static void*
+prefetch_thread(void* arg)
+{
+   struct prefetch* pf = (struct prefetch*)arg;
+
+   pthread_mutex_lock(&pf->lock);
+
+   while (!pf->stop)
+   {
+      if (pf->seek_pending)
+      {
+         /* The consumer is parked until the seek completes, and no read
+          * may still land in the ringbuffer */
+         hrmp_reader_drain(pf->reader);
+         pf->queued = 0;
+         hrmp_ringbuffer_clear(pf->rb);
+         pf->pos = pf->seek_offset;
+         pf->read_pos = pf->seek_offset;
+         atomic_store(&pf->eof, false);
+         atomic_store(&pf->error, false);
+         pf->seek_pending = false;
+         pthread_cond_broadcast(&pf->cond);
+         continue;
+      }
+
+      size_t level = prefetch_wake_level(pf);
+
+      atomic_store(&pf->wake_level, level);
+      atomic_store(&pf->producer_waiting, true);
+      atomic_thread_fence(memory_order_seq_cst);
+
+      if (atomic_load(&pf->eof) || atomic_load(&pf->error) || hrmp_ringbuffer_size(pf->rb) > level)
+      {
+         pthread_cond_wait(&pf->cond, &pf->lock);
+         atomic_store(&pf->producer_waiting, false);
+         continue;
+      }
+
+      atomic_store(&pf->producer_waiting, false);
+
+      pthread_mutex_unlock(&pf->lock);
+      prefetch_fill(pf);
+      pthread_mutex_lock(&pf->lock);
+   }
+
+   pthread_mutex_unlock(&pf->lock);
+
+   return NULL;
+}
+
+/* Reading resumes once a full batch fits, so a reader parked on a full
+ * buffer is not woken for every small read of the consumer */
+static size_t
+prefetch_wake_level(struct prefetch* pf)
+{
+   size_t buffered = hrmp_ringbuffer_size(pf->rb);
+   size_t limit = atomic_load(&pf->target);
+   size_t usable = hrmp_ringbuffer_capacity(pf->rb);
+   uint64_t remaining = pf->end > pf->read_pos ? pf->end - pf->read_pos : 0;
+   size_t batch = HRMP_PREFETCH_CHUNK_BYTES;
+
+   /* A non-empty SPSC ringbuffer can not grow, and the history is not
+    * available for reading ahead */
+   usable = usable > pf->rb->history ? usable - pf->rb->history : 0;
+   if (buffered > 0 && usable < limit)
+   {
+      limit = usable;
+   }
+
+   if ((uint64_t)batch > remaining)
+   {
+      batch = (size_t)remaining;
+   }
+   if (batch == 0)
+   {
+      batch = 1;
+   }
+
+   return limit > batch ? limit - batch : 0;
+}
+
+static void
+prefetch_fill(struct prefetch* pf)
+{
+   void* wp = NULL;
+   void* rp = NULL;
+   size_t buffered = hrmp_ringbuffer_size(pf->rb);
+   size_t target = atomic_load(&pf->target);
+   uint64_t remaining = pf->end > pf->read_pos ? pf->end - pf->read_pos : 0;
+   size_t span;
+   size_t want = 0;
+   ssize_t got;
+
+   if (remaining == 0)
+   {
+      prefetch_finish(pf, &pf->eof);
+      return;
+   }
+
+   if (buffered == 0 && pf->queued == 0)
+   {
+      /* Size for the whole cache, the target may be raised later */
+      size_t size = pf->rb->max;
+      if ((uint64_t)size > remaining)
+      {
+         size = (size_t)remaining;
+      }
+      (void)hrmp_ringbuffer_ensure_write(pf->rb, size);
+   }
+
+   span = hrmp_ringbuffer_get_write_span(pf->rb, &wp);
+   if ((uint64_t)span > remaining)
+   {
+      span = (size_t)remaining;
+   }
+   if (buffered >= target)
+   {
+      span = 0;
+   }
+   else if (span > target - buffered)
+   {
+      span = target - buffered;
+   }
+
+   if (pf->queued == 0 && span > 0)
+   {
+      size_t hit = hrmp_blockcache_lookup(&pf->file, wp, span, pf->read_pos);
+      if (hit > 0)
+      {
+         prefetch_publish(pf, hit);
+         return;
+      }
+   }
+
+   /* Reads end on block boundaries, so whole blocks can be cached */
+   while (pf->queued < span)
+   {
+      uint64_t offset = pf->read_pos + pf->queued;
+      size_t n = HRMP_BLOCKCACHE_BLOCK_BYTES - (size_t)(offset % HRMP_BLOCKCACHE_BLOCK_BYTES);
+
+      if (n > span - pf->queued)
+      {
+         n = span - pf->queued;
+      }
+
+      if (hrmp_reader_submit(pf->reader, (uint8_t*)wp + pf->queued, n, offset))
+      {
+         break;
+      }
+
+      pf->queued += n;
+   }
+
+   if (hrmp_reader_pending(pf->reader) == 0)
+   {
+      return;
+   }
+
+   got = hrmp_reader_wait(pf->reader, &rp, &want);
+   pf->queued -= want;
+
+   if (got < 0)
+   {
+      int err = errno;
+
+      hrmp_reader_drain(pf->reader);
+      pf->queued = 0;
+
+      if (err != EINTR && err != EAGAIN)
+      {
+         hrmp_log_error("Prefetch: read failed at %llu (%s)", (unsigned long long)pf->read_pos, strerror(err));
+         prefetch_finish(pf, &pf->error);
+      }
+      return;
+   }
+
+   if (got == 0)
+   {
+      hrmp_reader_drain(pf->reader);
+      pf->queued = 0;
+      prefetch_finish(pf, &pf->eof);
+      return;
+   }
+
+   hrmp_blockcache_insert(&pf->file, pf->read_pos, rp, (size_t)got);
+
+   if ((size_t)got < want)
+   {
+      /* The reads queued behind a short one landed at the wrong place */
+      hrmp_reader_drain(pf->reader);
+      pf->queued = 0;
+   }
+
+   prefetch_publish(pf, (size_t)got);
+}
+
+static void
+prefetch_publish(struct prefetch* pf, size_t n)
+{
+   hrmp_ringbuffer_produce(pf->rb, n);
+   pf->read_pos += (uint64_t)n;
+
+   atomic_thread_fence(memory_order_seq_cst);
+   if (atomic_load_explicit(&pf->consumer_waiting, memory_order_relaxed))
+   {
+      pthread_mutex_lock(&pf->lock);
+      pthread_cond_broadcast(&pf->cond);
+      pthread_mutex_unlock(&pf->lock);
+   }
+}
+
+static void
+prefetch_finish(struct prefetch* pf, atomic_bool* flag)
+{
+   pthread_mutex_lock(&pf->lock);
+   atomic_store(flag, true);
+   pthread_cond_broadcast(&pf->cond);
+   pthread_mutex_unlock(&pf->lock);
+}
+
+static void
+prefetch_wake(struct prefetch* pf)
+{
+   /* Pairs with the fence the reader takes before it re-checks the level */
+   atomic_thread_fence(memory_order_seq_cst);
+
+   if (atomic_load_explicit(&pf->producer_waiting, memory_order_relaxed) &&
+       hrmp_ringbuffer_size(pf->rb) <= atomic_load_explicit(&pf->wake_level, memory_order_relaxed))
+   {
+      pthread_mutex_lock(&pf->lock);
+      pthread_cond_broadcast(&pf->cond);
+      pthread_mutex_unlock(&pf->lock);
+   }
+}
+
+static int
+prefetch_map(struct prefetch* pf, uint64_t offset, uint64_t end)
+{
+   int slot = -1;
+   uint64_t start;
+   uint8_t* map = NULL;
+
+   if (hrmp_realtime_is_locked())
+   {
+      /* mlockall(MCL_FUTURE) would read the whole mapping in */
+      hrmp_log_debug("Prefetch: memory is locked, the file is not mapped");
+      goto error;
+   }
+
+   if (pf->file.size == 0 || end > pf->file.size || pf->file.size > (uint64_t)SIZE_MAX)
+   {
+      goto error;
+   }
+
+   pthread_once(&sigbus_once, prefetch_sigbus_install);
+   if (!sigbus_installed)
+   {
+      goto error;
+   }
+
+   map = (uint8_t*)mmap(NULL, (size_t)pf->file.size, PROT_READ, MAP_SHARED, pf->fd, 0);
+   if (map == MAP_FAILED)
+   {
+      hrmp_log_debug("Prefetch: mmap failed (%s)", strerror(errno));
+      goto error;
+   }
+
+   atomic_init(&pf->truncated, false);
+
+   pthread_mutex_lock(&mappings_lock);
+   for (int i = 0; i < HRMP_PREFETCH_MAPPINGS; i++)
+   {
+      if (atomic_load(&mappings[i].base) == NULL)
+      {
+         mappings[i].size = (size_t)pf->file.size;
+         mappings[i].truncated = &pf->truncated;
+         atomic_store(&mappings[i].base, map);
+         slot = i;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&mappings_lock);
+
+   if (slot < 0)
+   {
+      hrmp_log_debug("Prefetch: too many mapped files");
+      munmap(map, (size_t)pf->file.size);
+      goto error;
+   }
+
+   pf->map = map;
+   pf->map_size = (size_t)pf->file.size;
+
+   start = offset - (offset % page_size);
+   madvise(pf->map + start, (size_t)(end - start), MADV_SEQUENTIAL);
+
+   pf->advised = offset;
+   pf->released = start;
+   prefetch_advise(pf);
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+prefetch_unmap(struct prefetch* pf)
+{
+   pthread_mutex_lock(&mappings_lock);
+   for (int i = 0; i < HRMP_PREFETCH_MAPPINGS; i++)
+   {
+      if (atomic_load(&mappings[i].base) == pf->map)
+      {
+         atomic_store(&mappings[i].base, NULL);
+         break;
+      }
+   }
+   pthread_mutex_unlock(&mappings_lock);
+
+   munmap(pf->map, pf->map_size);
+   pf->map = NULL;
+}
+
+/* Request the pages ahead of the play position half a window at a time,
+ * and release those more than a window behind it */
+static void
+prefetch_advise(struct prefetch* pf)
+{
+   uint64_t ahead = pf->pos + HRMP_PREFETCH_WINDOW_BYTES;
+   uint64_t behind;
+
+   if (ahead > pf->end)
+   {
+      ahead = pf->end;
+   }
+   if (pf->advised < pf->pos)
+   {
+      pf->advised = pf->pos;
+   }
+
+   if (ahead > pf->advised && (ahead - pf->advised >= HRMP_PREFETCH_WINDOW_BYTES / 2 || ahead == pf->end))
+   {
+      uint64_t start = pf->advised - (pf->advised % page_size);
+
+      madvise(pf->map + start, (size_t)(ahead - start), MADV_WILLNEED);
+      pf->advised = ahead;
+   }
+
+   if (pf->pos > HRMP_PREFETCH_WINDOW_BYTES)
+   {
+      behind = pf->pos - HRMP_PREFETCH_WINDOW_BYTES;
+      behind -= behind % page_size;
+
+      if (behind > pf->released && behind - pf->released >= HRMP_PREFETCH_WINDOW_BYTES / 2)
+      {
+         madvise(pf->map + pf->released, (size_t)(behind - pf->released), MADV_DONTNEED);
+         pf->released = behind;
+      }
+   }
+}
+
+static bool
+prefetch_truncated(struct prefetch* pf)
+{
+   if (!atomic_load(&pf->truncated))
+   {
+      return false;
+   }
+
+   if (!atomic_load(&pf->error))
+   {
+      hrmp_log_error("Prefetch: the file was truncated at %llu", (unsigned long long)pf->pos);
+      atomic_store(&pf->error, true);
+   }
+
+   return true;
+}
+
+static void
+prefetch_sigbus_install(void)
+{
+   struct sigaction sa;
+
+   page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+   memset(&sa, 0, sizeof(struct sigaction));
+   sa.sa_sigaction = prefetch_sigbus;
+   sa.sa_flags = SA_SIGINFO;
+   sigemptyset(&sa.sa_mask);
+
+   if (sigaction(SIGBUS, &sa, &sigbus_previous) == 0)
+   {
+      sigbus_installed = true;
+   }
+   else
+   {
+      hrmp_log_warn("Prefetch: could not install a SIGBUS handler (%s)", strerror(errno));
+   }
+}
+
+/* A page of a mapping past the end of a truncated file is replaced with
+ * zeros, so the faulting read completes and the playback stops cleanly */
+static void
+prefetch_sigbus(int sig, siginfo_t* info, void* context)
+{
+   uint8_t* addr = (uint8_t*)info->si_addr;
+
+   (void)sig;
+   (void)context;
+
+   for (int i = 0; i < HRMP_PREFETCH_MAPPINGS; i++)
+   {
+      uint8_t* base = atomic_load(&mappings[i].base);
+
+      if (base != NULL && addr >= base && addr < base + mappings[i].size)
+      {
+         uint8_t* page = base + ((size_t)(addr - base) / page_size) * page_size;
+
+         if (mmap(page, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+         {
+            atomic_store(mappings[i].truncated, true);
+            return;
+         }
+         break;
+      }
+   }
+
+   /* Not a mapped file, the fault is handled as before */
+   sigaction(SIGBUS, &sigbus_previous, NULL);
+}
@@ -0,0 +1,648 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <logging.h>
+#include <reader.h>
+
+/* system */
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#if defined(HAVE_LINUX) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && \
+   __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+/* How often a failed io_uring_enter() is retried, a millisecond apart, while
+ * waiting for cancelled reads */
+#define HRMP_READER_CANCEL_TRIES 1000
+
+static int uring_create(struct reader* r);
+static void uring_destroy(struct reader* r);
+static int uring_submit(struct reader* r, unsigned int slot);
+static int uring_wait(struct reader* r, struct reader_slot* s);
+static int uring_enter(struct reader* r, bool submit, unsigned int wait);
+static void uring_reap(struct reader* r);
+static void uring_cancel(struct reader* r);
+static void fallback(struct reader* r);
+static ssize_t pread_all(int fd, void* buf, size_t n, uint64_t offset);
+
+int
+hrmp_reader_create(int fd, int type, struct reader** out)
+{
+   struct reader* r = NULL;
+
+   *out = NULL;
+
+   r = (struct reader*)malloc(sizeof(struct reader));
+   if (r == NULL)
+   {
+      goto error;
+   }
+
+   memset(r, 0, sizeof(struct reader));
+
+   r->fd = fd;
+   r->ring_fd = -1;
+   r->type = HRMP_READER_PREAD;
+   r->depth = 1;
+
+   if (type == HRMP_READER_AUTO || type == HRMP_READER_IO_URING)
+   {
+      if (!uring_create(r))
+      {
+         r->type = HRMP_READER_IO_URING;
+         r->depth = HRMP_READER_DEPTH;
+      }
+      else if (type == HRMP_READER_IO_URING)
+      {
+         hrmp_log_debug("Reader: io_uring is not available, using pread");
+      }
+   }
+
+   *out = r;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void
+hrmp_reader_destroy(struct reader* r)
+{
+   if (r == NULL)
+   {
+      return;
+   }
+
+   /* The kernel may still write into the destinations */
+   hrmp_reader_drain(r);
+   uring_destroy(r);
+
+   free(r);
+}
+
+char*
+hrmp_reader_name(int type)
+{
+   switch (type)
+   {
+      case HRMP_READER_PREAD:
+         return "pread";
+      case HRMP_READER_IO_URING:
+         return "io_uring";
+      case HRMP_READER_MMAP:
+         return "mmap";
+      default:
+         break;
+   }
+
+   return "auto";
+}
+
+int
+hrmp_reader_submit(struct reader* r, void* buf, size_t n, uint64_t offset)
+{
+   unsigned int slot;
+
+   if (r == NULL || r->count >= r->depth)
+   {
+      return 1;
+   }
+
+   slot = (r->head + r->count) % HRMP_READER_DEPTH;
+
+   r->slots[slot].iov.iov_base = buf;
+   r->slots[slot].iov.iov_len = n;
+   r->slots[slot].offset = offset;
+   r->slots[slot].result = 0;
+   r->slots[slot].done = false;
+
+   if (r->type == HRMP_READER_IO_URING && uring_submit(r, slot))
+   {
+      /* Done with pread when it is waited for */
+      fallback(r);
+   }
+
+   r->count++;
+
+   return 0;
+}
+
+unsigned int
+hrmp_reader_pending(struct reader* r)
+{
+   return r != NULL ? r->count : 0;
+}
+
+ssize_t
+hrmp_reader_wait(struct reader* r, void** buf, size_t* n)
+{
+   struct reader_slot* s = NULL;
+   ssize_t result;
+
+   *buf = NULL;
+   *n = 0;
+
+   if (r == NULL || r->count == 0)
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   s = &r->slots[r->head];
+
+   if (r->type == HRMP_READER_IO_URING && uring_wait(r, s))
+   {
+      fallback(r);
+   }
+
+   if (!s->done)
+   {
+      s->result = pread_all(r->fd, s->iov.iov_base, s->iov.iov_len, s->offset);
+      if (s->result < 0)
+      {
+         s->result = -errno;
+      }
+   }
+
+   result = s->result;
+   *buf = s->iov.iov_base;
+   *n = s->iov.iov_len;
+
+   s->done = false;
+   r->head = (r->head + 1) % HRMP_READER_DEPTH;
+   r->count--;
+
+   if (result < 0)
+   {
+      errno = (int)-result;
+      return -1;
+   }
+
+   return result;
+}
+
+void
+hrmp_reader_drain(struct reader* r)
+{
+   void* buf;
+   size_t n;
+
+   while (hrmp_reader_pending(r) > 0)
+   {
+      (void)hrmp_reader_wait(r, &buf, &n);
+   }
+}
+
+/* The ring is broken. Closing it does not stop the reads in flight, they
+ * would keep writing into destinations that are handed out again, so they
+ * are cancelled and waited for first. The queued reads that have not
+ * completed and all later ones are done with pread */
+static void
+fallback(struct reader* r)
+{
+   hrmp_log_debug("Reader: io_uring failed, using pread");
+
+   uring_cancel(r);
+   uring_destroy(r);
+
+   r->type = HRMP_READER_PREAD;
+   r->unsubmitted = 0;
+}
+
+static ssize_t
+pread_all(int fd, void* buf, size_t n, uint64_t offset)
+{
+   ssize_t got;
+
+   do
+   {
+      got = pread(fd, buf, n, (off_t)offset);
+   }
+   while (got < 0 && errno == EINTR);
+
+   return got;
+}
+
+#ifdef HAVE_IO_URING
+
+static int
+uring_create(struct reader* r)
+{
+   struct io_uring_params p;
+   uint8_t* sq = NULL;
+   uint8_t* cq = NULL;
+
+   memset(&p, 0, sizeof(struct io_uring_params));
+
+   r->ring_fd = (int)syscall(__NR_io_uring_setup, HRMP_READER_DEPTH, &p);
+   if (r->ring_fd < 0)
+   {
+      hrmp_log_debug("Reader: io_uring_setup failed (%s)", strerror(errno));
+      r->ring_fd = -1;
+      goto error;
+   }
+
+   r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+   r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+   /* Newer kernels map both rings with a single call */
+   if (p.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      if (r->cq_ring_size > r->sq_ring_size)
+      {
+         r->sq_ring_size = r->cq_ring_size;
+      }
+      r->cq_ring_size = 0;
+   }
+
+   r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->ring_fd, IORING_OFF_SQ_RING);
+   if (r->sq_ring == MAP_FAILED)
+   {
+      r->sq_ring = NULL;
+      goto error;
+   }
+
+   if (r->cq_ring_size > 0)
+   {
+      r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        r->ring_fd, IORING_OFF_CQ_RING);
+      if (r->cq_ring == MAP_FAILED)
+      {
+         r->cq_ring = NULL;
+         goto error;
+      }
+   }
+
+   r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+   r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  r->ring_fd, IORING_OFF_SQES);
+   if (r->sqes == MAP_FAILED)
+   {
+      r->sqes = NULL;
+      goto error;
+   }
+
+   sq = (uint8_t*)r->sq_ring;
+   cq = r->cq_ring != NULL ? (uint8_t*)r->cq_ring : sq;
+
+   r->sq_tail = (unsigned int*)(sq + p.sq_off.tail);
+   r->sq_mask = (unsigned int*)(sq + p.sq_off.ring_mask);
+   r->sq_array = (unsigned int*)(sq + p.sq_off.array);
+   r->cq_head = (unsigned int*)(cq + p.cq_off.head);
+   r->cq_tail = (unsigned int*)(cq + p.cq_off.tail);
+   r->cq_mask = (unsigned int*)(cq + p.cq_off.ring_mask);
+   r->cqes = cq + p.cq_off.cqes;
+
+   return 0;
+
+error:
+
+   uring_destroy(r);
+
+   return 1;
+}
+
+static void
+uring_destroy(struct reader* r)
+{
+   if (r->sqes != NULL)
+   {
+      munmap(r->sqes, r->sqes_size);
+      r->sqes = NULL;
+   }
+   if (r->cq_ring != NULL)
+   {
+      munmap(r->cq_ring, r->cq_ring_size);
+      r->cq_ring = NULL;
+   }
+   if (r->sq_ring != NULL)
+   {
+      munmap(r->sq_ring, r->sq_ring_size);
+      r->sq_ring = NULL;
+   }
+   if (r->ring_fd >= 0)
+   {
+      close(r->ring_fd);
+      r->ring_fd = -1;
+   }
+}
+
+static int
+uring_submit(struct reader* r, unsigned int slot)
+{
+   unsigned int tail = *r->sq_tail;
+   unsigned int idx = tail & *r->sq_mask;
+   struct io_uring_sqe* sqe = &((struct io_uring_sqe*)r->sqes)[idx];
+
+   /* IORING_OP_READV is in every kernel that has io_uring */
+   memset(sqe, 0, sizeof(struct io_uring_sqe));
+   sqe->opcode = IORING_OP_READV;
+   sqe->fd = r->fd;
+   sqe->addr = (uint64_t)(uintptr_t)&r->slots[slot].iov;
+   sqe->len = 1;
+   sqe->off = r->slots[slot].offset;
+   sqe->user_data = slot;
+
+   r->sq_array[idx] = idx;
+   atomic_store_explicit((_Atomic unsigned int*)r->sq_tail, tail + 1, memory_order_release);
+   r->unsubmitted++;
+
+   /* A kernel short of resources leaves the entry queued for the next call */
+   if (uring_enter(r, true, 0) && errno != EAGAIN && errno != EBUSY)
+   {
+      /* Take the entry back so it is not submitted later */
+      atomic_store_explicit((_Atomic unsigned int*)r->sq_tail, tail, memory_order_release);
+      r->unsubmitted--;
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+uring_wait(struct reader* r, struct reader_slot* s)
+{
+   unsigned int in_flight;
+
+   uring_reap(r);
+
+   while (!s->done)
+   {
+      if (!uring_enter(r, true, 1))
+      {
+         uring_reap(r);
+         continue;
+      }
+
+      if (errno != EAGAIN && errno != EBUSY)
+      {
+         return 1;
+      }
+
+      /* The kernel is short of resources or completions are waiting to be
+       * reaped. Reap them and block for a read in flight without
+       * submitting, the queued entries go in with a later call */
+      uring_reap(r);
+      if (s->done)
+      {
+         break;
+      }
+
+      in_flight = 0;
+      for (unsigned int i = 0; i < r->count; i++)
+      {
+         if (!r->slots[(r->head + i) % HRMP_READER_DEPTH].done)
+         {
+            in_flight++;
+         }
+      }
+      in_flight -= r->unsubmitted;
+
+      if (in_flight == 0)
+      {
+         /* Nothing would wake us up, only submit. A kernel that takes no
+          * entry at all is given up on */
+         if (uring_enter(r, true, 0))
+         {
+            return 1;
+         }
+         continue;
+      }
+
+      if (uring_enter(r, false, 1) && errno != EAGAIN && errno != EBUSY)
+      {
+         return 1;
+      }
+      uring_reap(r);
+   }
+
+   return 0;
+}
+
+static int
+uring_enter(struct reader* r, bool submit, unsigned int wait)
+{
+   for (;;)
+   {
+      long ret = syscall(__NR_io_uring_enter, r->ring_fd, submit ? r->unsubmitted : 0, wait,
+                         wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+      if (ret >= 0)
+      {
+         r->unsubmitted -= (unsigned int)ret;
+         return 0;
+      }
+
+      if (errno == EINTR)
+      {
+         continue;
+      }
+
+      if (errno != EAGAIN && errno != EBUSY)
+      {
+         hrmp_log_debug("Reader: io_uring_enter failed (%s)", strerror(errno));
+      }
+
+      return 1;
+   }
+}
+
+static void
+uring_reap(struct reader* r)
+{
+   unsigned int head = *r->cq_head;
+   unsigned int tail = atomic_load_explicit((_Atomic unsigned int*)r->cq_tail, memory_order_acquire);
+
+   while (head != tail)
+   {
+      struct io_uring_cqe* cqe = &((struct io_uring_cqe*)r->cqes)[head & *r->cq_mask];
+
+      if (cqe->user_data < HRMP_READER_DEPTH)
+      {
+         r->slots[cqe->user_data].result = cqe->res;
+         r->slots[cqe->user_data].done = true;
+      }
+      head++;
+   }
+
+   atomic_store_explicit((_Atomic unsigned int*)r->cq_head, head, memory_order_release);
+}
+
+/* Cancel the reads in flight and wait until each has completed. The
+ * entries not yet entered are taken back, and a read that failed or was
+ * cancelled is left for pread */
+static void
+uring_cancel(struct reader* r)
+{
+   unsigned int tail;
+   unsigned int in_flight;
+   unsigned int slot;
+   unsigned int failures = 0;
+
+   if (r->ring_fd < 0)
+   {
+      return;
+   }
+
+   tail = *r->sq_tail - r->unsubmitted;
+   atomic_store_explicit((_Atomic unsigned int*)r->sq_tail, tail, memory_order_release);
+   in_flight = r->count - r->unsubmitted;
+   r->unsubmitted = 0;
+
+   uring_reap(r);
+
+   for (unsigned int i = 0; i < in_flight; i++)
+   {
+      slot = (r->head + i) % HRMP_READER_DEPTH;
+
+      if (!r->slots[slot].done)
+      {
+         unsigned int idx = tail & *r->sq_mask;
+         struct io_uring_sqe* sqe = &((struct io_uring_sqe*)r->sqes)[idx];
+
+         /* Matched on the user data of the read, and completes with a user
+          * data that uring_reap() ignores */
+         memset(sqe, 0, sizeof(struct io_uring_sqe));
+         sqe->opcode = IORING_OP_ASYNC_CANCEL;
+         sqe->fd = -1;
+         sqe->addr = slot;
+         sqe->user_data = HRMP_READER_DEPTH + slot;
+
+         r->sq_array[idx] = idx;
+         tail++;
+         r->unsubmitted++;
+      }
+   }
+   atomic_store_explicit((_Atomic unsigned int*)r->sq_tail, tail, memory_order_release);
+
+   if (r->unsubmitted > 0)
+   {
+      hrmp_log_debug("Reader: cancelling %u reads in flight", r->unsubmitted);
+   }
+
+   for (;;)
+   {
+      unsigned int pending = 0;
+
+      uring_reap(r);
+      for (unsigned int i = 0; i < in_flight; i++)
+      {
+         if (!r->slots[(r->head + i) % HRMP_READER_DEPTH].done)
+         {
+            pending++;
+         }
+      }
+
+      if (pending == 0)
+      {
+         break;
+      }
+
+      /* A read that can not be cancelled still completes, but a ring that
+       * can not be waited on at all is only given a bounded time */
+      if (uring_enter(r, r->unsubmitted > 0, 1) && errno != EAGAIN && errno != EBUSY)
+      {
+         if (++failures > HRMP_READER_CANCEL_TRIES)
+         {
+            hrmp_log_warn("Reader: %u reads still in flight on a failed io_uring", pending);
+            break;
+         }
+         usleep(1000);
+      }
+   }
+
+   for (unsigned int i = 0; i < in_flight; i++)
+   {
+      struct reader_slot* s = &r->slots[(r->head + i) % HRMP_READER_DEPTH];
+
+      if (s->done && s->result < 0)
+      {
+         s->done = false;
+      }
+   }
+}
+
+#else
+
+static int
+uring_create(struct reader* r)
+{
+   (void)r;
+   return 1;
+}
+
+static void
+uring_destroy(struct reader* r)
+{
+   (void)r;
+}
+
+static int
+uring_submit(struct reader* r, unsigned int slot)
+{
+   (void)r;
+   (void)slot;
+   return 1;
+}
+
+static int
+uring_wait(struct reader* r, struct reader_slot* s)
+{
+   (void)r;
+   (void)s;
+   return 1;
+}
+
+static int
+uring_enter(struct reader* r, bool submit, unsigned int wait)
+{
+   (void)r;
+   (void)submit;
+   (void)wait;
+   return 1;
+}
+
+static void
+uring_reap(struct reader* r)
+{
+   (void)r;
+}
+
+static void
+uring_cancel(struct reader* r)
+{
+   (void)r;
+}
+
+#endif
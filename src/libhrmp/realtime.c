@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <logging.h>
+#include <realtime.h>
+
+/* system */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static bool locked = false;
+
+int
+hrmp_realtime_enable(int priority)
+{
+   int ret = 0;
+   int min;
+   int max;
+   struct rlimit rl;
+   struct sched_param param;
+
+   /* With a limited RLIMIT_MEMLOCK, MCL_FUTURE would make later allocations
+    * fail once the limit is reached, so only lock when it is unlimited or
+    * when running as root */
+   if (getrlimit(RLIMIT_MEMLOCK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && geteuid() != 0)
+   {
+      hrmp_log_warn("Realtime: RLIMIT_MEMLOCK is %lu bytes, memory is not locked",
+                    (unsigned long)rl.rlim_cur);
+      ret = 1;
+   }
+   else if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+   {
+      hrmp_log_warn("Realtime: mlockall failed (%s), memory is not locked", strerror(errno));
+      ret = 1;
+   }
+   else
+   {
+      locked = true;
+   }
+
+   min = sched_get_priority_min(SCHED_FIFO);
+   max = sched_get_priority_max(SCHED_FIFO);
+
+   memset(&param, 0, sizeof(param));
+   param.sched_priority = MIN(MAX(priority, min), max);
+
+   if ((errno = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0)
+   {
+      hrmp_log_warn("Realtime: SCHED_FIFO priority %d not available (%s)",
+                    param.sched_priority, strerror(errno));
+      ret = 1;
+   }
+   else
+   {
+      hrmp_log_debug("Realtime: SCHED_FIFO priority %d", param.sched_priority);
+   }
+
+   return ret;
+}
+
+int
+hrmp_realtime_helper_attr(pthread_attr_t* attr)
+{
+   struct sched_param param;
+
+   pthread_attr_init(attr);
+
+   memset(&param, 0, sizeof(param));
+
+   if (pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED) != 0 ||
+       pthread_attr_setschedpolicy(attr, SCHED_OTHER) != 0 ||
+       pthread_attr_setschedparam(attr, &param) != 0)
+   {
+      pthread_attr_setinheritsched(attr, PTHREAD_INHERIT_SCHED);
+      hrmp_log_debug("Realtime: helper threads inherit the scheduling policy");
+      return 1;
+   }
+
+   return 0;
+}
+
+bool
+hrmp_realtime_is_locked(void)
+{
+   return locked;
+}
+
+void
+hrmp_realtime_prefault(void* buf, size_t size)
+{
+   long page;
+   uintptr_t start;
+   uintptr_t end;
+
+   if (buf == NULL || size == 0)
+   {
+      return;
+   }
+
+   page = sysconf(_SC_PAGESIZE);
+   if (page <= 0)
+   {
+      page = 4096;
+   }
+
+   start = (uintptr_t)buf & ~((uintptr_t)page - 1);
+   end = (uintptr_t)buf + size;
+
+#ifdef MADV_POPULATE_WRITE
+   if (madvise((void*)start, end - start, MADV_POPULATE_WRITE) == 0)
+   {
+      return;
+   }
+#endif
+
+   /* Older kernels: a read touch at least maps every page */
+   for (uintptr_t p = (uintptr_t)buf; p < end; p = (p & ~((uintptr_t)page - 1)) + (uintptr_t)page)
+   {
+      (void)*(volatile uint8_t*)p;
+   }
+}
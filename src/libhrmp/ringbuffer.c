@@ -15,19 +15,62 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <hrmp.h>
+#include <logging.h>
 #include <ringbuffer.h>
 
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MFD_HUGE_2MB
+#define MFD_HUGE_2MB (21U << 26)
+#endif
 
 static size_t
 clamp_size(size_t v, size_t lo, size_t hi);
+static size_t
+write_space(struct ringbuffer* rb, size_t r, size_t w);
 static int
 resize_to(struct ringbuffer* rb, size_t newcap);
+static size_t
+storage_size(size_t cap);
+static int
+storage_create(struct ringbuffer* rb);
+static int
+storage_resize(struct ringbuffer* rb, size_t newcap);
+static void
+storage_destroy(struct ringbuffer* rb);
+static uint8_t*
+storage_at(struct ringbuffer* rb, size_t idx, size_t* span);
+static int
+mirror_create(struct ringbuffer* rb);
+static int
+mirror_map(struct ringbuffer* rb, size_t cap, size_t keep);
+static int
+mirror_regular(struct ringbuffer* rb, size_t oldcap, size_t newcap);
+static int
+regular_grow(struct ringbuffer* rb, size_t oldcap, size_t newcap);
+static uint8_t*
+reserve(size_t size);
+static void
+prefault(struct ringbuffer* rb, size_t from, size_t to);
+static bool
+transparent_available(bool shmem);
+
+/* The capacity of all ringbuffers, which shares the cache budget with the
+ * block cache */
+static atomic_size_t committed = 0;
 
 int
-hrmp_ringbuffer_create(size_t min_size, size_t initial_size, size_t max_size, struct ringbuffer** out)
+hrmp_ringbuffer_create(size_t min_size, size_t initial_size, size_t max_size, int flags, struct ringbuffer** out)
 {
    struct ringbuffer* rb = NULL;
 
@@ -38,25 +81,44 @@ hrmp_ringbuffer_create(size_t min_size, size_t initial_size, size_t max_size, st
       goto error;
    }
 
-   rb = (struct ringbuffer*)calloc(1, sizeof(struct ringbuffer));
+   rb = (struct ringbuffer*)aligned_alloc(64, sizeof(struct ringbuffer));
    if (!rb)
    {
       goto error;
    }
+   memset(rb, 0, sizeof(struct ringbuffer));
 
-   rb->min = min_size;
-   rb->max = max_size;
+   rb->min = storage_size(min_size);
+   rb->max = storage_size(max_size);
+   rb->flags = flags;
+   rb->fd = -1;
+   atomic_init(&rb->r, 0);
+   atomic_init(&rb->w, 0);
 
    if (initial_size <= min_size)
    {
       initial_size = min_size;
    }
-   rb->cap = clamp_size(initial_size, min_size, max_size);
 
-   rb->buf = (uint8_t*)malloc(rb->cap);
-   if (!rb->buf)
+   initial_size = storage_size(clamp_size(initial_size, min_size, max_size));
+
+   if (storage_create(rb) || storage_resize(rb, initial_size))
    {
-      goto error;
+      storage_destroy(rb);
+
+      if (!(rb->flags & HRMP_RINGBUFFER_FLAG_HUGETLB))
+      {
+         goto error;
+      }
+
+      /* The huge page pool can not back the initial size */
+      rb->flags &= ~HRMP_RINGBUFFER_FLAG_HUGETLB;
+
+      if (storage_create(rb) || storage_resize(rb, initial_size))
+      {
+         storage_destroy(rb);
+         goto error;
+      }
    }
 
    *out = rb;
@@ -68,12 +130,18 @@ error:
    return 1;
 }
 
+size_t
+hrmp_ringbuffer_committed(void)
+{
+   return atomic_load_explicit(&committed, memory_order_relaxed);
+}
+
 void
 hrmp_ringbuffer_destroy(struct ringbuffer* rb)
 {
    if (rb != NULL)
    {
-      free(rb->buf);
+      storage_destroy(rb);
       free(rb);
    }
 
@@ -85,9 +153,7 @@ hrmp_ringbuffer_reset(struct ringbuffer* rb)
 {
    if (rb != NULL)
    {
-      rb->r = 0;
-      rb->w = 0;
-      rb->size = 0;
+      hrmp_ringbuffer_clear(rb);
 
       if (rb->cap > rb->min)
       {
@@ -96,16 +162,70 @@ hrmp_ringbuffer_reset(struct ringbuffer* rb)
    }
 }
 
+void
+hrmp_ringbuffer_clear(struct ringbuffer* rb)
+{
+   if (rb != NULL)
+   {
+      atomic_store_explicit(&rb->r, 0, memory_order_relaxed);
+      atomic_store_explicit(&rb->w, 0, memory_order_relaxed);
+      rb->r_max = 0;
+   }
+}
+
+void
+hrmp_ringbuffer_set_spsc(struct ringbuffer* rb, bool spsc)
+{
+   if (rb != NULL)
+   {
+      rb->spsc = spsc;
+   }
+}
+
+void
+hrmp_ringbuffer_set_history(struct ringbuffer* rb, size_t history)
+{
+   if (rb != NULL)
+   {
+      rb->history = history < rb->max ? history : rb->max / 2;
+      rb->r_max = atomic_load_explicit(&rb->r, memory_order_relaxed) + rb->history;
+   }
+}
+
 size_t
 hrmp_ringbuffer_capacity(struct ringbuffer* rb)
 {
    return rb ? rb->cap : 0;
 }
 
+char*
+hrmp_ringbuffer_backing_name(struct ringbuffer* rb)
+{
+   switch (rb != NULL ? rb->backing : HRMP_RINGBUFFER_BACKING_PAGES)
+   {
+      case HRMP_RINGBUFFER_BACKING_TRANSPARENT:
+         return "transparent huge pages";
+      case HRMP_RINGBUFFER_BACKING_EXPLICIT:
+         return "explicit huge pages";
+      default:
+         break;
+   }
+
+   return "regular pages";
+}
+
 size_t
 hrmp_ringbuffer_size(struct ringbuffer* rb)
 {
-   return rb ? rb->size : 0;
+   if (rb == NULL)
+   {
+      return 0;
+   }
+
+   size_t r = atomic_load_explicit(&rb->r, memory_order_acquire);
+   size_t w = atomic_load_explicit(&rb->w, memory_order_acquire);
+
+   return w - r;
 }
 
 int
@@ -116,13 +236,26 @@ hrmp_ringbuffer_ensure_write(struct ringbuffer* rb, size_t n)
       goto error;
    }
 
-   size_t free_space = rb->cap - rb->size;
+   size_t size = hrmp_ringbuffer_size(rb);
+   size_t free_space = rb->cap - size;
    if (free_space >= n)
    {
       return 0;
    }
 
-   size_t need_total = rb->size + n;
+   if (rb->spsc && size > 0)
+   {
+      /* The consumer may hold a pointer into the current storage */
+      goto error;
+   }
+
+   if (rb->spsc && rb->history > 0 && atomic_load_explicit(&rb->r, memory_order_acquire) > 0)
+   {
+      /* The consumer may rewind into the current storage */
+      goto error;
+   }
+
+   size_t need_total = size + n;
    if (need_total > rb->max)
    {
       goto error;
@@ -160,44 +293,87 @@ hrmp_ringbuffer_peek(struct ringbuffer* rb, void** ptr)
    }
    *ptr = NULL;
 
-   if (rb->size == 0)
+   size_t r = atomic_load_explicit(&rb->r, memory_order_relaxed);
+   size_t w = atomic_load_explicit(&rb->w, memory_order_acquire);
+   size_t size = w - r;
+
+   if (size == 0)
    {
       return 0;
    }
 
-   size_t n = rb->cap - rb->r;
-   if (n > rb->size)
+   size_t n = 0;
+
+   *ptr = storage_at(rb, r % rb->cap, &n);
+   if (n > size)
    {
-      n = rb->size;
+      n = size;
    }
 
-   *ptr = rb->buf + rb->r;
    return n;
 }
 
 void
 hrmp_ringbuffer_consume(struct ringbuffer* rb, size_t n)
 {
-   if (rb == NULL || rb->size == 0)
+   if (rb == NULL)
    {
       return;
    }
 
-   if (n > rb->size)
+   size_t r = atomic_load_explicit(&rb->r, memory_order_relaxed);
+   size_t w = atomic_load_explicit(&rb->w, memory_order_acquire);
+   size_t size = w - r;
+
+   if (size == 0)
    {
-      n = rb->size;
+      return;
    }
 
-   rb->r = (rb->r + n) % rb->cap;
-   rb->size -= n;
+   if (n > size)
+   {
+      n = size;
+   }
+
+   atomic_store_explicit(&rb->r, r + n, memory_order_release);
 
-   if (rb->size == 0)
+   if (r + n > rb->r_max)
    {
-      rb->r = 0;
-      rb->w = 0;
+      rb->r_max = r + n;
    }
 }
 
+size_t
+hrmp_ringbuffer_history(struct ringbuffer* rb)
+{
+   if (rb == NULL || rb->history == 0)
+   {
+      return 0;
+   }
+
+   /* The producer has never seen a read counter above r_max, so it keeps
+    * everything from r_max - history on */
+   size_t r = atomic_load_explicit(&rb->r, memory_order_relaxed);
+   size_t low = rb->r_max > rb->history ? rb->r_max - rb->history : 0;
+
+   return r > low ? r - low : 0;
+}
+
+int
+hrmp_ringbuffer_rewind(struct ringbuffer* rb, size_t n)
+{
+   if (rb == NULL || n > hrmp_ringbuffer_history(rb))
+   {
+      return 1;
+   }
+
+   size_t r = atomic_load_explicit(&rb->r, memory_order_relaxed);
+
+   atomic_store_explicit(&rb->r, r - n, memory_order_release);
+
+   return 0;
+}
+
 size_t
 hrmp_ringbuffer_get_write_span(struct ringbuffer* rb, void** ptr)
 {
@@ -207,19 +383,22 @@ hrmp_ringbuffer_get_write_span(struct ringbuffer* rb, void** ptr)
    }
    *ptr = NULL;
 
-   size_t free_space = rb->cap - rb->size;
+   size_t w = atomic_load_explicit(&rb->w, memory_order_relaxed);
+   size_t r = atomic_load_explicit(&rb->r, memory_order_acquire);
+   size_t free_space = write_space(rb, r, w);
    if (free_space == 0)
    {
       return 0;
    }
 
-   size_t n = rb->cap - rb->w;
+   size_t n = 0;
+
+   *ptr = storage_at(rb, w % rb->cap, &n);
    if (n > free_space)
    {
       n = free_space;
    }
 
-   *ptr = rb->buf + rb->w;
    return n;
 }
 
@@ -231,14 +410,15 @@ hrmp_ringbuffer_produce(struct ringbuffer* rb, size_t n)
       goto error;
    }
 
-   size_t free_space = rb->cap - rb->size;
+   size_t w = atomic_load_explicit(&rb->w, memory_order_relaxed);
+   size_t r = atomic_load_explicit(&rb->r, memory_order_acquire);
+   size_t free_space = rb->cap - (w - r);
    if (n > free_space)
    {
       goto error;
    }
 
-   rb->w = (rb->w + n) % rb->cap;
-   rb->size += n;
+   atomic_store_explicit(&rb->w, w + n, memory_order_release);
    return 0;
 
 error:
@@ -260,6 +440,26 @@ clamp_size(size_t v, size_t lo, size_t hi)
    return v;
 }
 
+/* The space the producer may fill, which leaves the history behind r alone.
+ * A rewind only moves r back over bytes the producer has kept, so the
+ * physical space checked by hrmp_ringbuffer_produce() is never exceeded */
+static size_t
+write_space(struct ringbuffer* rb, size_t r, size_t w)
+{
+   size_t used = w - r;
+   size_t keep = rb->history < r ? rb->history : r;
+
+   if (used + keep >= rb->cap)
+   {
+      return 0;
+   }
+
+   return rb->cap - used - keep;
+}
+
+/* Chunks are added or dropped at the end, so data that does not wrap
+ * stays where it is. When growing, wrapped data is made contiguous again
+ * by copying the smaller of its two parts next to the other one */
 static int
 resize_to(struct ringbuffer* rb, size_t newcap)
 {
@@ -268,45 +468,449 @@ resize_to(struct ringbuffer* rb, size_t newcap)
       return 1;
    }
 
-   newcap = clamp_size(newcap, rb->min, rb->max);
-   if (newcap == rb->cap)
+   size_t r = atomic_load_explicit(&rb->r, memory_order_acquire);
+   size_t w = atomic_load_explicit(&rb->w, memory_order_relaxed);
+   size_t size = w - r;
+   size_t oldcap = rb->cap;
+   size_t idx = r % oldcap;
+   size_t tail = idx + size > oldcap ? idx + size - oldcap : 0;
+
+   newcap = storage_size(clamp_size(newcap, rb->min, rb->max));
+   if (newcap == oldcap)
    {
       return 0;
    }
-   if (rb->size > newcap)
+   if (size > 0 && newcap < oldcap && (tail > 0 || idx + size > newcap))
    {
       return 1;
    }
 
-   uint8_t* nb = (uint8_t*)malloc(newcap);
-   if (!nb)
+   if (storage_resize(rb, newcap))
    {
       return 1;
    }
 
-   if (rb->size)
+   if (tail > 0)
+   {
+      size_t added = newcap - oldcap;
+
+      if (tail <= added)
+      {
+         /* The start of the buffer goes into the new chunks */
+         memcpy(rb->buf + oldcap, rb->buf, tail);
+      }
+      else
+      {
+         /* The end of the old capacity moves to the end of the new one */
+         memmove(rb->buf + idx + added, rb->buf + idx, oldcap - idx);
+         idx += added;
+      }
+   }
+
+   /* An empty buffer keeps its counters, so a concurrent consumer in SPSC
+    * mode never observes a transient size */
+   if (size)
+   {
+      atomic_store_explicit(&rb->r, idx, memory_order_relaxed);
+      atomic_store_explicit(&rb->w, idx + size, memory_order_release);
+   }
+
+   /* Nothing behind r is kept across a resize. In SPSC mode a history only
+    * allows a resize before anything was consumed, so there is none */
+   if (!rb->spsc)
+   {
+      rb->r_max = atomic_load_explicit(&rb->r, memory_order_relaxed) + rb->history;
+   }
+
+   return 0;
+}
+
+static size_t
+storage_size(size_t cap)
+{
+   return ((cap + HRMP_RINGBUFFER_CHUNK_BYTES - 1) / HRMP_RINGBUFFER_CHUNK_BYTES) * HRMP_RINGBUFFER_CHUNK_BYTES;
+}
+
+static int
+storage_create(struct ringbuffer* rb)
+{
+   rb->backing = HRMP_RINGBUFFER_BACKING_PAGES;
+
+   if ((rb->flags & HRMP_RINGBUFFER_FLAG_MIRROR) && !mirror_create(rb))
+   {
+      rb->mirrored = true;
+   }
+   else
+   {
+      rb->buf = reserve(rb->max);
+      if (rb->buf == NULL)
+      {
+         return 1;
+      }
+   }
+
+   if (rb->flags & HRMP_RINGBUFFER_FLAG_HUGETLB)
+   {
+      rb->backing = HRMP_RINGBUFFER_BACKING_EXPLICIT;
+   }
+   else if ((rb->flags & HRMP_RINGBUFFER_FLAG_HUGEPAGES) && transparent_available(rb->mirrored))
+   {
+      /* A mirror is advised each time it is mapped */
+      if (rb->mirrored || !madvise(rb->buf, rb->max, MADV_HUGEPAGE))
+      {
+         rb->backing = HRMP_RINGBUFFER_BACKING_TRANSPARENT;
+      }
+   }
+
+   return 0;
+}
+
+static int
+storage_resize(struct ringbuffer* rb, size_t newcap)
+{
+   size_t oldcap = rb->cap;
+   size_t from = oldcap;
+   bool explicit = rb->backing == HRMP_RINGBUFFER_BACKING_EXPLICIT;
+
+   if (rb->mirrored)
    {
-      size_t first = rb->cap - rb->r;
-      if (first > rb->size)
+      /* Growing a huge page memfd only reserves pages from the pool when
+       * they are mapped */
+      if (newcap > oldcap && ftruncate(rb->fd, (off_t)newcap) != 0)
       {
-         first = rb->size;
+         if (!explicit || mirror_regular(rb, oldcap, newcap))
+         {
+            return 1;
+         }
+         from = 0;
       }
-      memcpy(nb, rb->buf + rb->r, first);
-      if (first < rb->size)
+      else if (mirror_map(rb, newcap, oldcap < newcap ? oldcap : newcap))
       {
-         memcpy(nb + first, rb->buf, rb->size - first);
+         /* Put the previous layout back, its pages are still in the memfd */
+         if (oldcap > 0)
+         {
+            mirror_map(rb, oldcap, 0);
+         }
+         if (newcap > oldcap)
+         {
+            (void)ftruncate(rb->fd, (off_t)oldcap);
+         }
+
+         /* The pool ran out, the whole buffer moves to a regular memfd */
+         if (!explicit || newcap < oldcap || mirror_regular(rb, oldcap, newcap))
+         {
+            return 1;
+         }
+         from = 0;
+      }
+
+      /* Dropped chunks give their pages back */
+      if (newcap < oldcap)
+      {
+         (void)ftruncate(rb->fd, (off_t)newcap);
+      }
+   }
+   else if (newcap > oldcap)
+   {
+      if (explicit)
+      {
+         if (mmap(rb->buf + oldcap, newcap - oldcap, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0) == MAP_FAILED)
+         {
+            /* The pool ran out, the new chunks and all later ones use
+             * regular pages */
+            rb->backing = (rb->flags & HRMP_RINGBUFFER_FLAG_HUGEPAGES) && transparent_available(false)
+                             ? HRMP_RINGBUFFER_BACKING_TRANSPARENT
+                             : HRMP_RINGBUFFER_BACKING_PAGES;
+
+            if (regular_grow(rb, oldcap, newcap))
+            {
+               /* Keep the range reserved */
+               mmap(rb->buf + oldcap, newcap - oldcap, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+               rb->backing = HRMP_RINGBUFFER_BACKING_EXPLICIT;
+               return 1;
+            }
+
+            hrmp_log_debug("Huge page pool exhausted at %zu bytes, the ringbuffer grows with %s",
+                           oldcap, hrmp_ringbuffer_backing_name(rb));
+         }
+      }
+      else if (regular_grow(rb, oldcap, newcap))
+      {
+         return 1;
       }
    }
+   else if (rb->flags & HRMP_RINGBUFFER_FLAG_HUGETLB)
+   {
+      /* Dropped chunks go back to the huge page pool, or give their pages
+       * back if they were added after the pool ran out */
+      mmap(rb->buf + newcap, oldcap - newcap, PROT_NONE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+   }
+   else
+   {
+      /* Dropped chunks give their pages back */
+      madvise(rb->buf + newcap, oldcap - newcap, MADV_DONTNEED);
+      mprotect(rb->buf + newcap, oldcap - newcap, PROT_NONE);
+   }
 
-   free(rb->buf);
-   rb->buf = nb;
    rb->cap = newcap;
-   rb->r = 0;
-   rb->w = rb->size;
-   if (rb->w >= rb->cap)
+
+   if (newcap > oldcap)
+   {
+      atomic_fetch_add_explicit(&committed, newcap - oldcap, memory_order_relaxed);
+   }
+   else
+   {
+      atomic_fetch_sub_explicit(&committed, oldcap - newcap, memory_order_relaxed);
+   }
+
+   if ((rb->flags & HRMP_RINGBUFFER_FLAG_PREFAULT) && newcap > from)
+   {
+      prefault(rb, from, newcap);
+   }
+
+   return 0;
+}
+
+static void
+storage_destroy(struct ringbuffer* rb)
+{
+   if (rb->buf != NULL)
+   {
+      munmap(rb->buf, rb->mirrored ? 2 * rb->max : rb->max);
+      rb->buf = NULL;
+   }
+
+   rb->mirrored = false;
+
+   if (rb->fd >= 0)
+   {
+      close(rb->fd);
+      rb->fd = -1;
+   }
+
+   atomic_fetch_sub_explicit(&committed, rb->cap, memory_order_relaxed);
+   rb->cap = 0;
+}
+
+/* The address of an index and the number of contiguous bytes from it */
+static uint8_t*
+storage_at(struct ringbuffer* rb, size_t idx, size_t* span)
+{
+   *span = rb->mirrored ? rb->cap : rb->cap - idx;
+
+   return rb->buf + idx;
+}
+
+static int
+mirror_create(struct ringbuffer* rb)
+{
+   unsigned int flags = MFD_CLOEXEC;
+
+   if (rb->flags & HRMP_RINGBUFFER_FLAG_HUGETLB)
    {
-      rb->w = 0;
+      flags |= MFD_HUGETLB | MFD_HUGE_2MB;
+   }
+
+   rb->fd = memfd_create("hrmp-ringbuffer", flags);
+   if (rb->fd < 0)
+   {
+      goto error;
+   }
+
+   rb->buf = reserve(2 * rb->max);
+   if (rb->buf == NULL)
+   {
+      goto error;
    }
 
    return 0;
+
+error:
+
+   if (rb->fd >= 0)
+   {
+      close(rb->fd);
+      rb->fd = -1;
+   }
+
+   return 1;
+}
+
+/* Map the first cap bytes of the memfd into both halves and release the
+ * rest of the reservation. The first keep bytes of the first half are
+ * mapped already, and stay so their pages remain faulted in */
+static int
+mirror_map(struct ringbuffer* rb, size_t cap, size_t keep)
+{
+   if (keep < cap &&
+       mmap(rb->buf + keep, cap - keep, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, rb->fd, (off_t)keep) == MAP_FAILED)
+   {
+      return 1;
+   }
+
+   if (mmap(rb->buf + cap, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, rb->fd, 0) == MAP_FAILED)
+   {
+      return 1;
+   }
+
+   if (cap < rb->max &&
+       mmap(rb->buf + 2 * cap, 2 * (rb->max - cap), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+            -1, 0) == MAP_FAILED)
+   {
+      return 1;
+   }
+
+   if (rb->backing == HRMP_RINGBUFFER_BACKING_TRANSPARENT)
+   {
+      madvise(rb->buf, 2 * cap, MADV_HUGEPAGE);
+   }
+
+   return 0;
+}
+
+/* Move a mirror from a huge page memfd, whose pool ran out, to a regular
+ * memfd of the new capacity. The content is copied, so the data stays at
+ * the same indexes */
+static int
+mirror_regular(struct ringbuffer* rb, size_t oldcap, size_t newcap)
+{
+   int fd = -1;
+   uint8_t* copy = NULL;
+
+   fd = memfd_create("hrmp-ringbuffer", MFD_CLOEXEC);
+   if (fd < 0 || ftruncate(fd, (off_t)newcap) != 0)
+   {
+      goto error;
+   }
+
+   if (oldcap > 0)
+   {
+      copy = (uint8_t*)mmap(NULL, oldcap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (copy == MAP_FAILED)
+      {
+         goto error;
+      }
+      memcpy(copy, rb->buf, oldcap);
+      munmap(copy, oldcap);
+   }
+
+   close(rb->fd);
+   rb->fd = fd;
+   rb->backing = (rb->flags & HRMP_RINGBUFFER_FLAG_HUGEPAGES) && transparent_available(true)
+                    ? HRMP_RINGBUFFER_BACKING_TRANSPARENT
+                    : HRMP_RINGBUFFER_BACKING_PAGES;
+
+   if (mirror_map(rb, newcap, 0))
+   {
+      /* The new memfd holds the data, so map it at the old capacity */
+      (void)mirror_map(rb, oldcap, 0);
+      return 1;
+   }
+
+   hrmp_log_debug("Huge page pool exhausted at %zu bytes, the mirrored ringbuffer moved to %s",
+                  oldcap, hrmp_ringbuffer_backing_name(rb));
+
+   return 0;
+
+error:
+
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+/* Make chunks of the reserved range accessible with regular pages */
+static int
+regular_grow(struct ringbuffer* rb, size_t oldcap, size_t newcap)
+{
+   /* The chunks hold nothing yet, and a huge page mapping that failed may
+    * have left them unmapped, so they get a fresh mapping */
+   if (mmap(rb->buf + oldcap, newcap - oldcap, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+   {
+      return 1;
+   }
+
+   if (rb->backing == HRMP_RINGBUFFER_BACKING_TRANSPARENT)
+   {
+      madvise(rb->buf + oldcap, newcap - oldcap, MADV_HUGEPAGE);
+   }
+
+   return 0;
+}
+
+/* Reserve an inaccessible, chunk aligned address range. Chunks are made
+ * accessible as the ringbuffer grows, so its address never changes */
+static uint8_t*
+reserve(size_t size)
+{
+   size_t lead;
+   uint8_t* base = (uint8_t*)mmap(NULL, size + HRMP_RINGBUFFER_CHUNK_BYTES, PROT_NONE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+   if (base == MAP_FAILED)
+   {
+      return NULL;
+   }
+
+   lead = (HRMP_RINGBUFFER_CHUNK_BYTES - ((uintptr_t)base % HRMP_RINGBUFFER_CHUNK_BYTES)) % HRMP_RINGBUFFER_CHUNK_BYTES;
+   if (lead > 0)
+   {
+      munmap(base, lead);
+   }
+   munmap(base + lead + size, HRMP_RINGBUFFER_CHUNK_BYTES - lead);
+
+   return base + lead;
+}
+
+/* Fault in the chunks from..to that were just added. The second half of a
+ * mirror is left alone, only a wrapping span touches it. A write populate
+ * leaves the content alone, and the fallback writes to chunks that hold
+ * nothing yet */
+static void
+prefault(struct ringbuffer* rb, size_t from, size_t to)
+{
+#ifdef MADV_POPULATE_WRITE
+   if (madvise(rb->buf + from, to - from, MADV_POPULATE_WRITE) == 0)
+   {
+      return;
+   }
+#endif
+
+   for (size_t i = from; i < to; i += 4096)
+   {
+      ((volatile uint8_t*)rb->buf)[i] = 0;
+   }
+}
+
+/* Transparent huge pages can be switched off system wide, or just for
+ * shared memory, in which case an advice has no effect */
+static bool
+transparent_available(bool shmem)
+{
+   FILE* f = NULL;
+   char mode[128];
+   bool available = false;
+
+   f = fopen(shmem ? "/sys/kernel/mm/transparent_hugepage/shmem_enabled" : "/sys/kernel/mm/transparent_hugepage/enabled",
+             "r");
+   if (f == NULL)
+   {
+      return false;
+   }
+
+   if (fgets(mode, sizeof(mode), f) != NULL)
+   {
+      available = strstr(mode, "[never]") == NULL && strstr(mode, "[deny]") == NULL;
+   }
+
+   fclose(f);
+
+   return available;
 }
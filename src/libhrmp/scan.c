@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <files.h>
+#include <list.h>
+#include <logging.h>
+#include <realtime.h>
+#include <scan.h>
+
+/* system */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void* scan_thread(void* arg);
+
+int
+hrmp_scan_create(struct list* files, struct scan** out)
+{
+   long cores;
+   size_t i = 0;
+   pthread_attr_t attr;
+   struct scan* scan = NULL;
+
+   *out = NULL;
+
+   scan = (struct scan*)malloc(sizeof(struct scan));
+   if (scan == NULL)
+   {
+      goto error;
+   }
+
+   memset(scan, 0, sizeof(struct scan));
+
+   scan->count = hrmp_list_size(files);
+   scan->slots = (struct scan_slot*)calloc(scan->count > 0 ? scan->count : 1, sizeof(struct scan_slot));
+   if (scan->slots == NULL)
+   {
+      goto error;
+   }
+
+   for (struct list_entry* e = hrmp_list_head(files); e != NULL; e = hrmp_list_next(e))
+   {
+      scan->slots[i].path = (char*)e->value;
+      scan->slots[i].state = HRMP_SCAN_PENDING;
+      i++;
+   }
+
+   pthread_mutex_init(&scan->lock, NULL);
+   pthread_cond_init(&scan->cond, NULL);
+
+   cores = sysconf(_SC_NPROCESSORS_ONLN);
+   if (cores < 1)
+   {
+      cores = 1;
+   }
+   if (cores > HRMP_SCAN_MAX_WORKERS)
+   {
+      cores = HRMP_SCAN_MAX_WORKERS;
+   }
+
+   hrmp_realtime_helper_attr(&attr);
+
+   while (scan->workers < cores && (size_t)scan->workers < scan->count)
+   {
+      if (pthread_create(&scan->threads[scan->workers], &attr, scan_thread, scan) != 0)
+      {
+         break;
+      }
+      scan->workers++;
+   }
+
+   pthread_attr_destroy(&attr);
+
+   if (scan->workers == 0 && scan->count > 0)
+   {
+      hrmp_log_error("Scan: could not start a worker thread");
+      pthread_cond_destroy(&scan->cond);
+      pthread_mutex_destroy(&scan->lock);
+      goto error;
+   }
+
+   hrmp_log_debug("Scan: %zu files on %d workers", scan->count, scan->workers);
+
+   *out = scan;
+
+   return 0;
+
+error:
+
+   if (scan != NULL)
+   {
+      free(scan->slots);
+      free(scan);
+   }
+
+   return 1;
+}
+
+void
+hrmp_scan_destroy(struct scan* scan)
+{
+   if (scan == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&scan->lock);
+   scan->stop = true;
+   pthread_mutex_unlock(&scan->lock);
+
+   /* A worker finishes the file it is reading */
+   for (int i = 0; i < scan->workers; i++)
+   {
+      pthread_join(scan->threads[i], NULL);
+   }
+
+   pthread_cond_destroy(&scan->cond);
+   pthread_mutex_destroy(&scan->lock);
+
+   for (size_t i = 0; i < scan->count; i++)
+   {
+      free(scan->slots[i].fm);
+   }
+
+   free(scan->slots);
+   free(scan);
+}
+
+size_t
+hrmp_scan_size(struct scan* scan)
+{
+   return scan != NULL ? scan->count : 0;
+}
+
+bool
+hrmp_scan_ready(struct scan* scan, size_t index)
+{
+   bool ready = false;
+
+   if (scan == NULL || index >= scan->count)
+   {
+      return false;
+   }
+
+   pthread_mutex_lock(&scan->lock);
+   ready = scan->slots[index].state != HRMP_SCAN_PENDING;
+   pthread_mutex_unlock(&scan->lock);
+
+   return ready;
+}
+
+int
+hrmp_scan_take(struct scan* scan, size_t index, struct file_metadata** fm)
+{
+   *fm = NULL;
+
+   if (scan == NULL || index >= scan->count)
+   {
+      return 1;
+   }
+
+   pthread_mutex_lock(&scan->lock);
+
+   while (scan->slots[index].state == HRMP_SCAN_PENDING)
+   {
+      pthread_cond_wait(&scan->cond, &scan->lock);
+   }
+
+   *fm = scan->slots[index].fm;
+   scan->slots[index].fm = NULL;
+
+   pthread_mutex_unlock(&scan->lock);
+
+   return *fm != NULL ? 0 : 1;
+}
+
+static void*
+scan_thread(void* arg)
+{
+   struct scan* scan = (struct scan*)arg;
+
+   pthread_mutex_lock(&scan->lock);
+
+   while (!scan->stop && scan->next < scan->count)
+   {
+      size_t index = scan->next++;
+      struct file_metadata* fm = NULL;
+      int ret;
+
+      pthread_mutex_unlock(&scan->lock);
+
+      ret = hrmp_file_metadata(scan->slots[index].path, &fm);
+
+      pthread_mutex_lock(&scan->lock);
+
+      scan->slots[index].fm = ret == 0 ? fm : NULL;
+      scan->slots[index].state = ret == 0 ? HRMP_SCAN_DONE : HRMP_SCAN_FAILED;
+      pthread_cond_broadcast(&scan->cond);
+   }
+
+   pthread_mutex_unlock(&scan->lock);
+
+   return NULL;
+}
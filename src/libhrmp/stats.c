@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <logging.h>
+#include <stats.h>
+#include <utils.h>
+
+/* system */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+void
+hrmp_stats_reset(struct stats* stats)
+{
+   if (stats != NULL)
+   {
+      memset(stats, 0, sizeof(struct stats));
+   }
+}
+
+uint64_t
+hrmp_stats_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t
+hrmp_stats_faults(void)
+{
+   struct rusage usage;
+
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+   {
+      return 0;
+   }
+
+   return (uint64_t)usage.ru_minflt + (uint64_t)usage.ru_majflt;
+}
+
+void
+hrmp_stats_write(struct stats* stats, uint64_t start)
+{
+   uint64_t ns = hrmp_stats_now() - start;
+
+   stats->writes++;
+   if (ns > stats->max_write_ns)
+   {
+      stats->max_write_ns = ns;
+   }
+}
+
+void
+hrmp_stats_wait(struct stats* stats, uint64_t start)
+{
+   uint64_t ns = hrmp_stats_now() - start;
+
+   if (ns > stats->max_wait_ns)
+   {
+      stats->max_wait_ns = ns;
+   }
+}
+
+void
+hrmp_stats_read(struct stats* stats, uint64_t start, size_t fill, bool buffered)
+{
+   stats->reads++;
+   stats->read_ns += hrmp_stats_now() - start;
+
+   if (buffered && (!stats->has_fill || fill < stats->min_fill))
+   {
+      stats->min_fill = fill;
+      stats->has_fill = true;
+   }
+}
+
+void
+hrmp_stats_report(struct stats* stats, char* name)
+{
+   FILE* f = NULL;
+   char* escaped = NULL;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   hrmp_log_debug("Stats: %s: writes=%lu xruns=%lu short_writes=%lu recovers=%lu max_write=%luus "
+                  "max_wait=%luus reads=%lu read=%luus min_fill=%ld cache_hits=%lu cache_misses=%lu faults=%lu",
+                  name,
+                  (unsigned long)stats->writes, (unsigned long)stats->xruns,
+                  (unsigned long)stats->short_writes, (unsigned long)stats->recovers,
+                  (unsigned long)(stats->max_write_ns / 1000), (unsigned long)(stats->max_wait_ns / 1000),
+                  (unsigned long)stats->reads, (unsigned long)(stats->read_ns / 1000),
+                  stats->has_fill ? (long)stats->min_fill : -1L,
+                  (unsigned long)stats->cache_hits, (unsigned long)stats->cache_misses,
+                  (unsigned long)stats->faults);
+
+   if (stats->xruns > 0)
+   {
+      hrmp_log_warn("%lu underrun(s) during %s", (unsigned long)stats->xruns, name);
+   }
+
+   if (config->developer && !config->quiet)
+   {
+      printf("Writes:       %lu\n", (unsigned long)stats->writes);
+      printf("Underruns:    %lu\n", (unsigned long)stats->xruns);
+      printf("Short writes: %lu\n", (unsigned long)stats->short_writes);
+      printf("Recovers:     %lu\n", (unsigned long)stats->recovers);
+      printf("Max write:    %lu us\n", (unsigned long)(stats->max_write_ns / 1000));
+      printf("Max wait:     %lu us\n", (unsigned long)(stats->max_wait_ns / 1000));
+      printf("Reads:        %lu\n", (unsigned long)stats->reads);
+      printf("Read time:    %lu us\n", (unsigned long)(stats->read_ns / 1000));
+      if (stats->has_fill)
+      {
+         printf("Min fill:     %zu bytes\n", stats->min_fill);
+      }
+      printf("Cache hits:   %lu\n", (unsigned long)stats->cache_hits);
+      printf("Cache misses: %lu\n", (unsigned long)stats->cache_misses);
+      printf("Page faults:  %lu\n", (unsigned long)stats->faults);
+   }
+
+   if (strlen(config->stats_path) == 0)
+   {
+      return;
+   }
+
+   f = fopen(config->stats_path, "a");
+   if (f == NULL)
+   {
+      hrmp_log_debug("Could not open %s (%s)", config->stats_path, strerror(errno));
+      return;
+   }
+
+   escaped = hrmp_escape_string(name);
+
+   fprintf(f, "{\"file\":\"%s\",\"writes\":%lu,\"xruns\":%lu,\"short_writes\":%lu,\"recovers\":%lu,"
+           "\"max_write_us\":%lu,\"max_wait_us\":%lu,\"reads\":%lu,\"read_us\":%lu,\"min_fill\":%ld,"
+           "\"cache_hits\":%lu,\"cache_misses\":%lu,\"faults\":%lu}\n",
+           escaped != NULL ? escaped : "",
+           (unsigned long)stats->writes, (unsigned long)stats->xruns,
+           (unsigned long)stats->short_writes, (unsigned long)stats->recovers,
+           (unsigned long)(stats->max_write_ns / 1000), (unsigned long)(stats->max_wait_ns / 1000),
+           (unsigned long)stats->reads, (unsigned long)(stats->read_ns / 1000),
+           stats->has_fill ? (long)stats->min_fill : -1L,
+           (unsigned long)stats->cache_hits, (unsigned long)stats->cache_misses,
+           (unsigned long)stats->faults);
+
+   free(escaped);
+   fclose(f);
+}
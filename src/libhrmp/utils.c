@@ -850,9 +850,18 @@ hrmp_escape_string(char* str)
       {
          translated_len++;
       }
+      else if ((unsigned char)str[i] < 0x20)
+      {
+         /* \u00XX */
+         translated_len += 5;
+      }
       translated_len++;
    }
    translated_ec_string = (char*)malloc(translated_len + 1);
+   if (translated_ec_string == NULL)
+   {
+      return NULL;
+   }
 
    for (int i = 0; i < len; i++, idx++)
    {
@@ -880,7 +889,15 @@ hrmp_escape_string(char* str)
             translated_ec_string[idx] = 'r';
             break;
          default:
-            translated_ec_string[idx] = str[i];
+            if ((unsigned char)str[i] < 0x20)
+            {
+               sprintf(&translated_ec_string[idx], "\\u%04x", (unsigned char)str[i]);
+               idx += 5;
+            }
+            else
+            {
+               translated_ec_string[idx] = str[i];
+            }
             break;
       }
    }
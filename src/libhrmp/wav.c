@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <hrmp.h>
+#include <files.h>
+#include <logging.h>
+#include <utils.h>
+#include <wav.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define WAV_FMT_MAX 40
+
+static uint16_t read_le_u16_buffer(uint8_t* buffer);
+static void parse_fmt(uint8_t* fmt, size_t n, struct wav* wav);
+
+/* The tail shared by every KSDATAFORMAT_SUBTYPE GUID */
+static const uint8_t subformat_tail[14] = {
+   0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+int
+hrmp_wav_read_header(FILE* f, uint64_t file_size, struct wav* wav)
+{
+   uint8_t head[HRMP_WAV_HEAD_BYTES];
+   size_t got;
+
+   memset(wav, 0, sizeof(struct wav));
+
+   if (fseeko(f, 0, SEEK_SET) != 0)
+   {
+      goto error;
+   }
+
+   got = fread(head, 1, sizeof(head), f);
+
+   if (hrmp_wav_parse_header(head, got, file_size, wav))
+   {
+      goto error;
+   }
+
+   if (fseeko(f, (off_t)wav->data_offset, SEEK_SET) != 0)
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   hrmp_log_debug("Not a supported WAVE header");
+
+   return 1;
+}
+
+int
+hrmp_wav_parse_header(uint8_t* buffer, size_t size, uint64_t file_size, struct wav* wav)
+{
+   uint64_t ds64_data_size = 0;
+   size_t pos = 12;
+   bool rf64 = false;
+   bool has_fmt = false;
+
+   memset(wav, 0, sizeof(struct wav));
+
+   if (buffer == NULL || size < 12)
+   {
+      goto error;
+   }
+
+   if (!memcmp(buffer, "RF64", 4) || !memcmp(buffer, "BW64", 4))
+   {
+      rf64 = true;
+   }
+   else if (memcmp(buffer, "RIFF", 4))
+   {
+      goto error;
+   }
+
+   if (memcmp(&buffer[8], "WAVE", 4))
+   {
+      goto error;
+   }
+
+   /* The data chunk header has to be in the buffer, its samples do not */
+   while (pos + 8 <= size)
+   {
+      uint8_t* id = &buffer[pos];
+      uint32_t chunk = hrmp_read_le_u32_buffer(&buffer[pos + 4]);
+      size_t start = pos + 8;
+      size_t avail = size - start;
+
+      if (!memcmp(id, "ds64", 4) && chunk >= 16 && avail >= 16)
+      {
+         ds64_data_size = hrmp_read_le_u64_buffer(&buffer[start + 8]);
+      }
+      else if (!memcmp(id, "fmt ", 4) && chunk >= 16)
+      {
+         size_t n = chunk < WAV_FMT_MAX ? chunk : WAV_FMT_MAX;
+
+         if (avail < n)
+         {
+            goto error;
+         }
+
+         parse_fmt(&buffer[start], n, wav);
+         has_fmt = true;
+      }
+      else if (!memcmp(id, "data", 4))
+      {
+         if (!has_fmt)
+         {
+            goto error;
+         }
+
+         wav->data_offset = start;
+         wav->data_size = chunk;
+
+         if (rf64 && chunk == UINT32_MAX)
+         {
+            wav->data_size = ds64_data_size;
+         }
+
+         if (file_size > 0 && wav->data_offset + wav->data_size > file_size)
+         {
+            wav->data_size = file_size > wav->data_offset ? file_size - wav->data_offset : 0;
+         }
+
+         return 0;
+      }
+
+      /* Chunks are padded to an even size */
+      if ((uint64_t)chunk + (chunk & 1) > size - start)
+      {
+         break;
+      }
+      pos = start + chunk + (chunk & 1);
+   }
+
+error:
+
+   return 1;
+}
+
+bool
+hrmp_wav_is_native(struct wav* wav, struct file_metadata* fm)
+{
+   if (wav == NULL || fm == NULL)
+   {
+      return false;
+   }
+
+   if (wav->format != HRMP_WAV_FORMAT_PCM || wav->channels != 2)
+   {
+      return false;
+   }
+
+   if (wav->bits_per_sample != 16 && wav->bits_per_sample != 24 && wav->bits_per_sample != 32)
+   {
+      return false;
+   }
+
+   if (wav->block_align != wav->channels * (wav->bits_per_sample / 8))
+   {
+      return false;
+   }
+
+   return (int)wav->bits_per_sample == fm->container && wav->sample_rate == fm->pcm_rate;
+}
+
+static void
+parse_fmt(uint8_t* fmt, size_t n, struct wav* wav)
+{
+   wav->format = read_le_u16_buffer(&fmt[0]);
+   wav->channels = read_le_u16_buffer(&fmt[2]);
+   wav->sample_rate = hrmp_read_le_u32_buffer(&fmt[4]);
+   wav->block_align = read_le_u16_buffer(&fmt[12]);
+   wav->bits_per_sample = read_le_u16_buffer(&fmt[14]);
+
+   if (wav->format == HRMP_WAV_FORMAT_EXTENSIBLE)
+   {
+      if (n == WAV_FMT_MAX && !memcmp(&fmt[26], subformat_tail, sizeof(subformat_tail)))
+      {
+         wav->format = read_le_u16_buffer(&fmt[24]);
+      }
+   }
+}
+
+static uint16_t
+read_le_u16_buffer(uint8_t* buffer)
+{
+   return (uint16_t)buffer[0] | ((uint16_t)buffer[1] << 8);
+}
@@ -18,6 +18,7 @@
 /* hrmp */
 #include <hrmp.h>
 #include <alsa.h>
+#include <blockcache.h>
 #include <cmd.h>
 #include <configuration.h>
 #include <devices.h>
@@ -27,8 +28,11 @@
 #include <keyboard.h>
 #include <list.h>
 #include <logging.h>
+#include <metacache.h>
 #include <playback.h>
 #include <playlist.h>
+#include <realtime.h>
+#include <scan.h>
 #include <shmem.h>
 #include <utils.h>
 
@@ -43,6 +47,7 @@
 
 static void shuffle_files(struct list** files);
 static int update_ringbuffer_cache(struct list* playbacks, struct list_entry* current, struct configuration* config);
+static int collect_playbacks(struct scan* scan, size_t* scanned, struct list* playbacks, size_t want);
 static void free_playback_entry(void* value);
 static void version(void);
 static void usage(void);
@@ -89,6 +94,8 @@ main(int argc, char** argv)
    int num_options = 0;
    int num_results = 0;
    int num_files = 0;
+   uint64_t metadata_hits = 0;
+   uint64_t metadata_misses = 0;
    struct list* files = NULL;
    struct list_entry* files_entry = NULL;
 
@@ -515,39 +522,11 @@ main(int argc, char** argv)
                }
             }
 
-            /* Filter unsupported files: display them, but don't keep them in the list. */
-            struct list* supported_files = NULL;
-            if (hrmp_list_create(&supported_files))
+            if (config->cache_metadata && hrmp_metacache_open())
             {
-               printf("Error creating files list\n");
-               goto error;
-            }
-
-            for (files_entry = hrmp_list_head(files);
-                 files_entry != NULL;
-                 files_entry = hrmp_list_next(files_entry))
-            {
-               struct file_metadata* fm = NULL;
-
-               if (hrmp_file_metadata((char*)files_entry->value, &fm))
-               {
-                  continue;
-               }
-
-               if (hrmp_list_append(supported_files, (const char*)files_entry->value))
-               {
-                  free(fm);
-                  hrmp_list_destroy(supported_files);
-                  printf("Error creating files list\n");
-                  goto error;
-               }
-
-               free(fm);
+               hrmp_log_warn("Could not create the metadata cache");
             }
 
-            hrmp_list_destroy(files);
-            files = supported_files;
-
             if (mode == HRMP_PLAYBACK_MODE_SHUFFLE)
             {
                srand((unsigned)time(NULL));
@@ -555,44 +534,33 @@ main(int argc, char** argv)
                play_from_index = 0;
             }
 
+            /* Each file is parsed once in the background. Unsupported files are
+             * displayed but don't get a playback */
+            struct scan* scan = NULL;
+            size_t scanned = 0;
+            if (hrmp_scan_create(files, &scan))
+            {
+               printf("Error scanning files\n");
+               goto error;
+            }
+
             struct list* playbacks = NULL;
             if (hrmp_list_create(&playbacks))
             {
+               hrmp_scan_destroy(scan);
                printf("Error creating playback list\n");
                goto error;
             }
 
-            num_files = 0;
-            for (files_entry = hrmp_list_head(files);
-                 files_entry != NULL;
-                 files_entry = hrmp_list_next(files_entry))
+            /* Playback starts as soon as the first file is ready, developer
+             * mode lists the whole queue first */
+            if (collect_playbacks(scan, &scanned, playbacks,
+                                  config->developer ? SIZE_MAX : (size_t)play_from_index + 1))
             {
-               struct playback* pb = NULL;
-               struct file_metadata* fm = NULL;
-
-               if (hrmp_file_metadata((char*)files_entry->value, &fm))
-               {
-                  continue;
-               }
-
-               if (hrmp_playback_init(num_files + 1, files->size, fm, &pb))
-               {
-                  free(fm);
-                  hrmp_list_destroy_with(playbacks, free_playback_entry);
-                  printf("Error creating playback\n");
-                  goto error;
-               }
-
-               if (hrmp_list_append_owned(playbacks, pb))
-               {
-                  free(fm);
-                  free_playback_entry(pb);
-                  hrmp_list_destroy_with(playbacks, free_playback_entry);
-                  printf("Error creating playback list\n");
-                  goto error;
-               }
-
-               num_files++;
+               hrmp_scan_destroy(scan);
+               hrmp_list_destroy_with(playbacks, free_playback_entry);
+               printf("Error creating playback\n");
+               goto error;
             }
 
             /* Keyboard */
@@ -600,16 +568,36 @@ main(int argc, char** argv)
 
             if (config->developer && !config->quiet)
             {
-               for (files_entry = hrmp_list_head(files);
+               hrmp_metacache_counters(&metadata_hits, &metadata_misses);
+
+               for (files_entry = hrmp_list_head(playbacks);
                     files_entry != NULL;
                     files_entry = hrmp_list_next(files_entry))
                {
-                  printf("Queued: %s\n", (const char*)files_entry->value);
+                  printf("Queued: %s\n", ((struct playback*)files_entry->value)->fm->name);
                }
 
-               printf("Number of files: %ld\n", hrmp_list_size(files));
+               printf("Number of files: %ld\n", hrmp_list_size(playbacks));
+
+               if (config->cache_metadata)
+               {
+                  printf("Metadata cache: %lu hits, %lu misses\n",
+                         (unsigned long)metadata_hits, (unsigned long)metadata_misses);
+               }
+            }
+
+            if (config->cache_blocks && config->cache_size > 0 && hrmp_blockcache_create(config->cache_size))
+            {
+               hrmp_log_warn("Could not create the block cache");
             }
 
+            if (config->realtime)
+            {
+               hrmp_realtime_enable(config->realtime_priority);
+            }
+
+            snd_pcm_t* pcm_handle = NULL;
+
             num_files = 0;
             files_entry = hrmp_list_head(playbacks);
             for (int i = 0; i < play_from_index && files_entry != NULL; i++)
@@ -622,17 +610,39 @@ main(int argc, char** argv)
                bool next = true;
                struct playback* pb = (struct playback*)files_entry->value;
 
+               /* The next file is needed to read ahead into it */
+               if (collect_playbacks(scan, &scanned, playbacks,
+                                     (size_t)num_files + (config->cache_files != HRMP_CACHE_FILES_OFF ? 2 : 1)))
+               {
+                  hrmp_alsa_close_handle(pcm_handle);
+                  hrmp_scan_destroy(scan);
+                  hrmp_list_destroy_with(playbacks, free_playback_entry);
+                  printf("Error creating playback\n");
+                  goto error;
+               }
+
                hrmp_set_proc_title(argc, argv, pb->fm->name);
                if (update_ringbuffer_cache(playbacks, files_entry, config))
                {
+                  hrmp_alsa_close_handle(pcm_handle);
+                  hrmp_scan_destroy(scan);
                   hrmp_list_destroy_with(playbacks, free_playback_entry);
                   printf("Error preparing cache\n");
                   goto error;
                }
-               hrmp_playback(pb, &next);
+               hrmp_playback(pb, &pcm_handle, &next);
 
                if (next)
                {
+                  if (collect_playbacks(scan, &scanned, playbacks, (size_t)num_files + 2))
+                  {
+                     hrmp_alsa_close_handle(pcm_handle);
+                     hrmp_scan_destroy(scan);
+                     hrmp_list_destroy_with(playbacks, free_playback_entry);
+                     printf("Error creating playback\n");
+                     goto error;
+                  }
+
                   files_entry = hrmp_list_next(files_entry);
                   num_files++;
 
@@ -653,7 +663,13 @@ main(int argc, char** argv)
                }
             }
 
+            hrmp_alsa_close_handle(pcm_handle);
+
+            hrmp_scan_destroy(scan);
+            hrmp_metacache_close();
+
             hrmp_list_destroy_with(playbacks, free_playback_entry);
+            hrmp_blockcache_destroy();
 
             hrmp_keyboard_mode(false);
          }
@@ -747,6 +763,7 @@ update_ringbuffer_cache(struct list* playbacks, struct list_entry* current, stru
       for (struct list_entry* e = hrmp_list_head(playbacks); e != NULL; e = hrmp_list_next(e))
       {
          struct playback* pb = (struct playback*)e->value;
+         hrmp_playback_stop_prebuffer(pb);
          if (pb->rb != NULL)
          {
             hrmp_ringbuffer_destroy(pb->rb);
@@ -756,6 +773,9 @@ update_ringbuffer_cache(struct list* playbacks, struct list_entry* current, stru
       return 0;
    }
 
+   struct list_entry* prev = hrmp_list_prev(current);
+   struct list_entry* next = hrmp_list_next(current);
+
    if (config->cache_files == HRMP_CACHE_FILES_ALL)
    {
       for (struct list_entry* e = hrmp_list_head(playbacks); e != NULL; e = hrmp_list_next(e))
@@ -765,17 +785,19 @@ update_ringbuffer_cache(struct list* playbacks, struct list_entry* current, stru
          {
             return 1;
          }
-         if (e != current && pb->rb != NULL)
+         if (e == next)
          {
+            hrmp_playback_prebuffer(pb);
+         }
+         else if (e != current && pb->rb != NULL)
+         {
+            hrmp_playback_stop_prebuffer(pb);
             hrmp_ringbuffer_reset(pb->rb);
          }
       }
       return 0;
    }
 
-   struct list_entry* prev = hrmp_list_prev(current);
-   struct list_entry* next = hrmp_list_next(current);
-
    for (struct list_entry* e = hrmp_list_head(playbacks); e != NULL; e = hrmp_list_next(e))
    {
       struct playback* pb = (struct playback*)e->value;
@@ -792,9 +814,14 @@ update_ringbuffer_cache(struct list* playbacks, struct list_entry* current, stru
          {
             return 1;
          }
+         if (e == next && e != current)
+         {
+            hrmp_playback_prebuffer(pb);
+         }
       }
       else if (pb->rb != NULL)
       {
+         hrmp_playback_stop_prebuffer(pb);
          hrmp_ringbuffer_destroy(pb->rb);
          pb->rb = NULL;
       }
@@ -803,6 +830,55 @@ update_ringbuffer_cache(struct list* playbacks, struct list_entry* current, stru
    return 0;
 }
 
+/* Turn the files the scan is done with into playbacks, in queue order,
+ * waiting until there are want playbacks or the scan is complete */
+static int
+collect_playbacks(struct scan* scan, size_t* scanned, struct list* playbacks, size_t want)
+{
+   size_t total = hrmp_scan_size(scan);
+
+   if (*scanned == total)
+   {
+      return 0;
+   }
+
+   while (*scanned < total && (hrmp_list_size(playbacks) < want || hrmp_scan_ready(scan, *scanned)))
+   {
+      struct playback* pb = NULL;
+      struct file_metadata* fm = NULL;
+
+      if (hrmp_scan_take(scan, (*scanned)++, &fm))
+      {
+         continue;
+      }
+
+      /* The total is the queue length until the scan is complete */
+      if (hrmp_playback_init((int)hrmp_list_size(playbacks) + 1, (int)total, fm, &pb))
+      {
+         free(fm);
+         return 1;
+      }
+
+      if (hrmp_list_append_owned(playbacks, pb))
+      {
+         free_playback_entry(pb);
+         return 1;
+      }
+   }
+
+   if (*scanned == total)
+   {
+      for (struct list_entry* e = hrmp_list_head(playbacks); e != NULL; e = hrmp_list_next(e))
+      {
+         ((struct playback*)e->value)->total_number = (int)hrmp_list_size(playbacks);
+      }
+
+      hrmp_metacache_close();
+   }
+
+   return 0;
+}
+
 static void
 free_playback_entry(void* value)
 {
@@ -812,6 +888,7 @@ free_playback_entry(void* value)
       return;
    }
 
+   hrmp_playback_stop_prebuffer(pb);
    hrmp_ringbuffer_destroy(pb->rb);
    free(pb->fm);
    free(pb);
@@ -0,0 +1,210 @@
+#!/bin/sh
+#
+# Copyright (C) 2026 The HighResMusicPlayer community
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+
+#
+# Play files on a real ALSA device with mmap off and on, and drive
+# pause, seek and skip from the keyboard. For each run it reports
+#
+#   - the buffer and period sizes negotiated for the latency profile
+#   - the CPU time hrmp uses while paused and while playing
+#   - the progress line before and after each seek
+#   - the playback statistics written to stats_path
+#
+# The keys go through script(1), so hrmp reads them from a terminal as it
+# would from the keyboard. Afterwards hrmp plays with stdin from /dev/null
+# and from a closed pipe, where it should use as little CPU as with a
+# terminal that nobody types on.
+#
+# Usage: test/alsa_exercise.sh DEVICE FILE...
+#
+#   DEVICE is an ALSA address such as hw:0,0 or plughw:0,0
+#   FILE   at least two files of a minute or longer, so there is
+#          something to seek in and to skip to
+#
+# HRMP points to the binary, default build/src/hrmp. The output of every
+# run is kept in a directory that is printed at the end.
+#
+
+HRMP=${HRMP:-build/src/hrmp}
+PLAY=${PLAY:-5}
+PAUSE=${PAUSE:-10}
+
+if [ $# -lt 3 ]; then
+   echo "Usage: $0 DEVICE FILE FILE..."
+   exit 1
+fi
+
+if [ ! -x "$HRMP" ]; then
+   echo "$HRMP not found, set HRMP to the hrmp binary"
+   exit 1
+fi
+
+DEVICE=$1
+shift
+
+OUT=$(mktemp -d /tmp/hrmp-exercise.XXXXXX)
+HZ=$(getconf CLK_TCK)
+FAILED=0
+
+# The files as one quoted string for script -c
+FILES=""
+for F in "$@"; do
+   FILES="$FILES '$F'"
+done
+# The user and system CPU ticks of a process
+cpu_ticks() {
+   awk '{ print $14 + $15 }' "/proc/$1/stat" 2>/dev/null || echo 0
+}
+
+# The hrmp process started by script(1)
+child() {
+   for i in 1 2 3 4 5 6 7 8 9 10; do
+      C=$(pgrep -P "$1" | head -1)
+      if [ -n "$C" ]; then
+         echo "$C"
+         return
+      fi
+      sleep 0.1
+   done
+   echo "$1"
+}
+
+# The last progress line written so far
+progress() {
+   tr '\r' '\n' < "$1" | grep '/' | tail -1
+}
+
+for MMAP in off on; do
+   RUN=$OUT/mmap-$MMAP
+   mkdir -p "$RUN"
+
+   cat > "$RUN/hrmp.conf" << EOF
+[hrmp]
+device = exercise
+log_type = file
+log_level = debug
+log_path = $RUN/hrmp.log
+stats_path = $RUN/stats.json
+mmap = $MMAP
+decode_queue = 0
+
+[exercise]
+device = $DEVICE
+EOF
+
+   echo "== $DEVICE, mmap $MMAP"
+
+   "$HRMP" -c "$RUN/hrmp.conf" -s > "$RUN/status.txt" 2>&1
+   grep -E 'Latency|Buffer|Period' "$RUN/status.txt"
+
+   rm -f "$RUN/keys"
+   mkfifo "$RUN/keys"
+
+   script -qfec "\"$HRMP\" -c \"$RUN/hrmp.conf\" --developer$FILES" /dev/null < "$RUN/keys" > "$RUN/output.txt" 2>&1 &
+   SCRIPT=$!
+   exec 3> "$RUN/keys"
+   PID=$(child $SCRIPT)
+
+   sleep "$PLAY"
+   START=$(cpu_ticks $PID)
+   sleep "$PAUSE"
+   PLAYING=$(( $(cpu_ticks $PID) - START ))
+
+   # Space pauses, the CPU use should drop to about nothing
+   printf ' ' >&3
+   sleep 1
+   START=$(cpu_ticks $PID)
+   sleep "$PAUSE"
+   PAUSED=$(( $(cpu_ticks $PID) - START ))
+   printf ' ' >&3
+
+   echo "   CPU playing: $PLAYING ticks in ${PAUSE}s, paused: $PAUSED ticks in ${PAUSE}s ($HZ ticks/s)"
+
+   # Right and left arrows seek 15s, the position should follow at once
+   sleep "$PLAY"
+   echo "   before seek:  $(progress "$RUN/output.txt")"
+   printf '\033[C' >&3
+   sleep 2
+   echo "   after +15s:   $(progress "$RUN/output.txt")"
+   printf '\033[D' >&3
+   sleep 2
+   echo "   after -15s:   $(progress "$RUN/output.txt")"
+
+   # Enter skips to the next file
+   printf '\n' >&3
+   sleep "$PLAY"
+   echo "   after skip:   $(progress "$RUN/output.txt")"
+
+   printf 'q' >&3
+   exec 3>&-
+
+   sleep 2
+   if kill -0 $PID 2>/dev/null; then
+      echo "   hrmp did not quit"
+      kill $PID
+      FAILED=1
+   fi
+   wait $SCRIPT 2>/dev/null
+
+   if [ -s "$RUN/stats.json" ]; then
+      sed 's/^/   stats: /' "$RUN/stats.json"
+   else
+      echo "   no statistics were written"
+      FAILED=1
+   fi
+done
+
+# Without a terminal there are no keys, and stdin must not wake hrmp up
+for INPUT in null pipe; do
+   RUN=$OUT/stdin-$INPUT
+   mkdir -p "$RUN"
+   sed "s|$OUT/mmap-on|$RUN|" "$OUT/mmap-on/hrmp.conf" > "$RUN/hrmp.conf"
+
+   echo "== $DEVICE, stdin from $INPUT"
+
+   if [ $INPUT = null ]; then
+      "$HRMP" -c "$RUN/hrmp.conf" "$@" < /dev/null > "$RUN/output.txt" 2>&1 &
+      PID=$!
+   else
+      : | "$HRMP" -c "$RUN/hrmp.conf" "$@" > "$RUN/output.txt" 2>&1 &
+      PID=$!
+   fi
+
+   sleep "$PLAY"
+   START=$(cpu_ticks $PID)
+   sleep "$PAUSE"
+   PLAYING=$(( $(cpu_ticks $PID) - START ))
+
+   echo "   CPU playing: $PLAYING ticks in ${PAUSE}s ($HZ ticks/s)"
+
+   # A busy loop on stdin would be close to one CPU, HZ ticks a second
+   if [ $PLAYING -gt $(( PAUSE * HZ / 4 )) ]; then
+      echo "   hrmp is spinning"
+      FAILED=1
+   fi
+
+   if ! kill $PID 2>/dev/null; then
+      echo "   hrmp stopped early"
+      FAILED=1
+   fi
+   wait 2>/dev/null
+done
+
+echo "Output is in $OUT"
+
+exit $FAILED
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <pack.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Cycles per input byte of the selected DSD kernels against the per byte
+ * loops they replaced, on one DSF channel block pair. Every kernel is
+ * checked against the old loop first. Without a time stamp counter the
+ * figures are nanoseconds per byte */
+
+#define BLOCK_BYTES 4096
+#define ROUNDS      20000
+
+static uint8_t bitrev8(uint8_t x);
+static void loop_dop(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker);
+static void loop_u32_be(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker);
+static void loop_u32_be_rev(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker);
+static uint64_t ticks(void);
+static double measure(hrmp_pack_dsd_kernel kernel, const uint8_t* left, const uint8_t* right, size_t frames,
+                      uint8_t* out, int rounds);
+
+static const char* names[HRMP_PACK_DSD_OPS] = {"DoP", "DSD_U32_BE", "DSD_U32_BE reversed"};
+static const hrmp_pack_dsd_kernel loops[HRMP_PACK_DSD_OPS] = {loop_dop, loop_u32_be, loop_u32_be_rev};
+static const size_t bytes_per_frame[HRMP_PACK_DSD_OPS] = {2, 4, 4};
+
+int
+main(int argc, char** argv)
+{
+   static uint8_t left[BLOCK_BYTES];
+   static uint8_t right[BLOCK_BYTES];
+   static uint8_t expected[4 * BLOCK_BYTES];
+   static uint8_t out[4 * BLOCK_BYTES];
+   int rounds = ROUNDS;
+   int errors = 0;
+
+   if (argc > 1)
+   {
+      rounds = atoi(argv[1]);
+   }
+
+   srand(1);
+   for (size_t i = 0; i < BLOCK_BYTES; i++)
+   {
+      left[i] = (uint8_t)rand();
+      right[i] = (uint8_t)rand();
+   }
+
+#if defined(__x86_64__) || defined(__i386__)
+   printf("%-20s %-8s %12s %12s %8s\n", "operation", "kernel", "loop cyc/B", "kernel cyc/B", "speedup");
+#else
+   printf("%-20s %-8s %12s %12s %8s\n", "operation", "kernel", "loop ns/B", "kernel ns/B", "speedup");
+#endif
+
+   for (int op = 0; op < HRMP_PACK_DSD_OPS; op++)
+   {
+      hrmp_pack_dsd_kernel kernel = hrmp_pack_dsd_select(op);
+      size_t frames = BLOCK_BYTES / bytes_per_frame[op];
+      double before;
+      double after;
+
+      /* Odd lengths exercise the tails of the vector loops */
+      for (size_t n = 1; n <= frames; n = n * 3 + 1)
+      {
+         uint8_t m1 = HRMP_PACK_DOP_MARKER_LSB;
+         uint8_t m2 = HRMP_PACK_DOP_MARKER_LSB;
+
+         loops[op](left, right, n, expected, &m1);
+         kernel(left, right, n, out, &m2);
+
+         if (memcmp(expected, out, n * 2 * bytes_per_frame[op]) != 0 || m1 != m2)
+         {
+            printf("%s: %s differs from the loop at %zu frames\n", names[op], hrmp_pack_dsd_name(op), n);
+            errors++;
+            break;
+         }
+      }
+
+      before = measure(loops[op], left, right, frames, out, rounds);
+      after = measure(kernel, left, right, frames, out, rounds);
+
+      printf("%-20s %-8s %12.3f %12.3f %7.1fx\n", names[op], hrmp_pack_dsd_name(op), before, after, before / after);
+   }
+
+   return errors == 0 ? 0 : 1;
+}
+
+static double
+measure(hrmp_pack_dsd_kernel kernel, const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out,
+        int rounds)
+{
+   uint8_t marker = HRMP_PACK_DOP_MARKER_LSB;
+   uint64_t start;
+
+   start = ticks();
+   for (int r = 0; r < rounds; r++)
+   {
+      kernel(left, right, frames, out, &marker);
+      __asm__ volatile("" : : "r"(out) : "memory");
+   }
+
+   return (double)(ticks() - start) / rounds / (2.0 * BLOCK_BYTES);
+}
+
+static uint64_t
+ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint8_t
+bitrev8(uint8_t x)
+{
+   x = (uint8_t)((x >> 4) | (x << 4));
+   x = (uint8_t)(((x & 0xCC) >> 2) | ((x & 0x33) << 2));
+   x = (uint8_t)(((x & 0xAA) >> 1) | ((x & 0x55) << 1));
+
+   return x;
+}
+
+/* The loops below are the playback code before the kernels */
+static void
+loop_dop(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   uint8_t m = *marker;
+
+   for (size_t i = 0; i < frames; i++)
+   {
+      const uint8_t* lp = left + i * 2;
+      const uint8_t* rp = right + i * 2;
+
+      out[0] = 0;
+      out[1] = bitrev8(lp[1]);
+      out[2] = bitrev8(lp[0]);
+      out[3] = m;
+      out[4] = 0;
+      out[5] = bitrev8(rp[1]);
+      out[6] = bitrev8(rp[0]);
+      out[7] = m;
+      out += 8;
+
+      m = (m == HRMP_PACK_DOP_MARKER_LSB) ? HRMP_PACK_DOP_MARKER_MSB : HRMP_PACK_DOP_MARKER_LSB;
+   }
+
+   *marker = m;
+}
+
+static void
+loop_u32_be(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   (void)marker;
+
+   for (size_t i = 0; i < frames; i++)
+   {
+      memcpy(out, left + i * 4, 4);
+      memcpy(out + 4, right + i * 4, 4);
+      out += 8;
+   }
+}
+
+static void
+loop_u32_be_rev(const uint8_t* left, const uint8_t* right, size_t frames, uint8_t* out, uint8_t* marker)
+{
+   (void)marker;
+
+   for (size_t i = 0; i < frames; i++)
+   {
+      for (int b = 0; b < 4; b++)
+      {
+         out[b] = bitrev8(left[i * 4 + b]);
+         out[4 + b] = bitrev8(right[i * 4 + b]);
+      }
+      out += 8;
+   }
+}
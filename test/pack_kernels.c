@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <pack.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Every kernel compiled in for an instruction set the CPU has is compared
+ * with the scalar kernel, whether or not it is selected. The lengths cover
+ * the vector bodies and odd tails, the input starts up to three samples
+ * past a vector boundary and the output up to seven bytes past one, and
+ * guard bytes on both sides of the output catch stray stores */
+
+#define KERNEL_FRAMES 4099
+#define KERNEL_GUARD  64
+#define KERNEL_SHIFTS 4
+
+static const size_t lengths[] = {1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 127, 129, 255, 257, 1023, 1025,
+                                 KERNEL_FRAMES};
+static const unsigned int channel_counts[] = {1, 2, 3, 6};
+static const char* names[HRMP_PACK_OPS] = {"S16", "S24_3", "S32", "S16_LE", "S24_LE"};
+static const char* dsd_names[HRMP_PACK_DSD_OPS] = {"DoP", "DSD_U32_BE", "DSD_U32_BE reversed"};
+
+static int check(int op, unsigned int channels, hrmp_pack_kernel scalar, hrmp_pack_kernel kernel,
+                 const uint8_t* in, uint8_t* expected, uint8_t* actual);
+static int check_dsd(int op, hrmp_pack_dsd_kernel scalar, hrmp_pack_dsd_kernel kernel, const uint8_t* in,
+                     uint8_t* expected, uint8_t* actual);
+static size_t in_bytes(int op);
+static size_t out_bytes(int op);
+
+int
+main(void)
+{
+   /* aligned_alloc() wants a multiple of the alignment */
+   size_t in_size = ((KERNEL_FRAMES + KERNEL_SHIFTS) * 6 * 4 + 63) & ~(size_t)63;
+   size_t out_size = (2 * KERNEL_GUARD + KERNEL_FRAMES * 8 + 8 + 63) & ~(size_t)63;
+   uint8_t* in = aligned_alloc(64, in_size);
+   uint8_t* expected = aligned_alloc(64, out_size);
+   uint8_t* actual = aligned_alloc(64, out_size);
+   uint32_t seed = 0x2545F491u;
+   int errors = 0;
+   char* name = NULL;
+
+   if (in == NULL || expected == NULL || actual == NULL)
+   {
+      printf("out of memory\n");
+      return 1;
+   }
+
+   for (size_t i = 0; i < in_size; i++)
+   {
+      seed = seed * 1664525u + 1013904223u;
+      in[i] = (uint8_t)(seed >> 24);
+   }
+
+   /* Full scale samples here and there, so clamping and the mixdown of
+    * more channels are exercised */
+   for (size_t i = 0; i + 4 <= in_size; i += 4 * 7)
+   {
+      int32_t v = (i / 28) % 2 ? INT32_MIN : INT32_MAX;
+
+      memcpy(in + i, &v, sizeof(v));
+   }
+
+   for (int set = 1; set < hrmp_pack_sets(); set++)
+   {
+      int kernels = 0;
+      int failed = 0;
+
+      for (int op = 0; op < HRMP_PACK_OPS; op++)
+      {
+         for (size_t c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]); c++)
+         {
+            unsigned int channels = channel_counts[c];
+            hrmp_pack_kernel scalar = hrmp_pack_get(0, op, channels, &name);
+            hrmp_pack_kernel kernel = hrmp_pack_get(set, op, channels, &name);
+
+            if (kernel == NULL)
+            {
+               continue;
+            }
+
+            kernels++;
+            if (check(op, channels, scalar, kernel, in, expected, actual))
+            {
+               printf("%s: %s with %u channels differs from scalar\n", name, names[op], channels);
+               failed++;
+            }
+         }
+      }
+
+      for (int op = 0; op < HRMP_PACK_DSD_OPS; op++)
+      {
+         hrmp_pack_dsd_kernel scalar = hrmp_pack_dsd_get(0, op, &name);
+         hrmp_pack_dsd_kernel kernel = hrmp_pack_dsd_get(set, op, &name);
+
+         if (kernel == NULL)
+         {
+            continue;
+         }
+
+         kernels++;
+         if (check_dsd(op, scalar, kernel, in, expected, actual))
+         {
+            printf("%s: %s differs from scalar\n", name, dsd_names[op]);
+            failed++;
+         }
+      }
+
+      hrmp_pack_get(set, 0, 1, &name);
+      if (kernels == 0)
+      {
+         printf("%s: not supported by this CPU\n", name);
+      }
+      else
+      {
+         printf("%s: %d kernels, %d differ\n", name, kernels, failed);
+      }
+
+      errors += failed;
+   }
+
+   free(in);
+   free(expected);
+   free(actual);
+
+   return errors == 0 ? 0 : 1;
+}
+
+static int
+check(int op, unsigned int channels, hrmp_pack_kernel scalar, hrmp_pack_kernel kernel, const uint8_t* in,
+      uint8_t* expected, uint8_t* actual)
+{
+   size_t sample = in_bytes(op);
+   size_t frame = out_bytes(op);
+
+   for (size_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++)
+   {
+      for (size_t shift = 0; shift < KERNEL_SHIFTS; shift++)
+      {
+         size_t frames = lengths[t];
+         const uint8_t* src = in + shift * sample;
+         size_t skew = (shift * 3 + t) % 8;
+         size_t end = KERNEL_GUARD + skew + frames * frame + KERNEL_GUARD;
+
+         memset(expected, 0xA5, end);
+         memset(actual, 0xA5, end);
+
+         scalar(src, channels, frames, expected + KERNEL_GUARD + skew);
+         kernel(src, channels, frames, actual + KERNEL_GUARD + skew);
+
+         if (memcmp(expected, actual, end) != 0)
+         {
+            printf("  %zu frames, input %zu samples in, output %zu bytes in\n", frames, shift, skew);
+            return 1;
+         }
+      }
+   }
+
+   return 0;
+}
+
+static int
+check_dsd(int op, hrmp_pack_dsd_kernel scalar, hrmp_pack_dsd_kernel kernel, const uint8_t* in, uint8_t* expected,
+          uint8_t* actual)
+{
+   static const uint8_t markers[] = {HRMP_PACK_DOP_MARKER_LSB, HRMP_PACK_DOP_MARKER_MSB};
+
+   for (size_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++)
+   {
+      for (size_t shift = 0; shift < KERNEL_SHIFTS; shift++)
+      {
+         for (size_t mk = 0; mk < sizeof(markers); mk++)
+         {
+            size_t frames = lengths[t];
+            const uint8_t* left = in + shift;
+            const uint8_t* right = left + KERNEL_FRAMES * 4 + 2 * shift + 1;
+            size_t skew = (shift * 3 + t) % 8;
+            size_t end = KERNEL_GUARD + skew + frames * 8 + KERNEL_GUARD;
+            uint8_t expected_marker = markers[mk];
+            uint8_t actual_marker = markers[mk];
+
+            memset(expected, 0xA5, end);
+            memset(actual, 0xA5, end);
+
+            scalar(left, right, frames, expected + KERNEL_GUARD + skew, &expected_marker);
+            kernel(left, right, frames, actual + KERNEL_GUARD + skew, &actual_marker);
+
+            if (memcmp(expected, actual, end) != 0 || expected_marker != actual_marker)
+            {
+               printf("  %zu frames, input %zu bytes in, output %zu bytes in\n", frames, shift, skew);
+               return 1;
+            }
+         }
+      }
+   }
+
+   return 0;
+}
+
+static size_t
+in_bytes(int op)
+{
+   switch (op)
+   {
+      case HRMP_PACK_S16_LE:
+         return 2;
+      case HRMP_PACK_S24_LE:
+         return 3;
+      default:
+         break;
+   }
+
+   return 4;
+}
+
+static size_t
+out_bytes(int op)
+{
+   switch (op)
+   {
+      case HRMP_PACK_S16:
+      case HRMP_PACK_S16_LE:
+         return 4;
+      case HRMP_PACK_S24_3:
+      case HRMP_PACK_S24_LE:
+         return 6;
+      default:
+         break;
+   }
+
+   return 8;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <ringbuffer.h>
+
+/* system */
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Throughput of a producer and a consumer thread copying through a
+ * ringbuffer, lock-free in SPSC mode against the same ringbuffer behind a
+ * mutex, for several span sizes */
+
+#define BENCH_BYTES ((uint64_t)4 * 1024 * 1024 * 1024)
+
+struct bench
+{
+   struct ringbuffer* rb;
+   pthread_mutex_t* lock;
+   uint64_t total;
+   size_t span;
+   uint8_t* source;
+   uint8_t* sink;
+};
+
+static void* producer(void* arg);
+static void* consumer(void* arg);
+static double run(int flags, bool spsc, size_t span, uint64_t total);
+
+int
+main(int argc, char** argv)
+{
+   static const size_t spans[] = {64, 1024, 16384, 262144};
+   uint64_t total = BENCH_BYTES;
+
+   if (argc > 1)
+   {
+      total = strtoull(argv[1], NULL, 10) * 1024 * 1024;
+   }
+
+   printf("%-10s %8s %12s %12s\n", "backing", "span", "spsc GB/s", "mutex GB/s");
+
+   for (int mirror = 0; mirror < 2; mirror++)
+   {
+      int flags = mirror ? HRMP_RINGBUFFER_FLAG_MIRROR : HRMP_RINGBUFFER_FLAG_NONE;
+
+      for (size_t i = 0; i < sizeof(spans) / sizeof(spans[0]); i++)
+      {
+         double spsc = run(flags, true, spans[i], total);
+         double locked = run(flags, false, spans[i], total);
+
+         printf("%-10s %8zu %12.2f %12.2f\n", mirror ? "mirrored" : "regular", spans[i], spsc, locked);
+      }
+   }
+
+   return 0;
+}
+
+static double
+run(int flags, bool spsc, size_t span, uint64_t total)
+{
+   struct bench b = {0};
+   pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+   struct timespec start;
+   struct timespec end;
+   pthread_t p;
+   pthread_t c;
+   double seconds;
+
+   if (hrmp_ringbuffer_create(HRMP_RINGBUFFER_MIN_BYTES, HRMP_RINGBUFFER_MIN_BYTES, HRMP_RINGBUFFER_MIN_BYTES,
+                              flags, &b.rb))
+   {
+      return 0.0;
+   }
+
+   hrmp_ringbuffer_set_spsc(b.rb, spsc);
+
+   b.lock = spsc ? NULL : &lock;
+   b.total = total;
+   b.span = span;
+   b.source = calloc(1, span);
+   b.sink = calloc(1, span);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   pthread_create(&c, NULL, consumer, &b);
+   pthread_create(&p, NULL, producer, &b);
+   pthread_join(p, NULL);
+   pthread_join(c, NULL);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+   free(b.source);
+   free(b.sink);
+   hrmp_ringbuffer_destroy(b.rb);
+
+   return (double)total / seconds / 1e9;
+}
+
+static void*
+producer(void* arg)
+{
+   struct bench* b = (struct bench*)arg;
+   uint64_t pos = 0;
+   void* span = NULL;
+   size_t n;
+
+   while (pos < b->total)
+   {
+      if (b->lock != NULL)
+      {
+         pthread_mutex_lock(b->lock);
+      }
+
+      n = hrmp_ringbuffer_get_write_span(b->rb, &span);
+      n = n < b->span ? n : b->span;
+      if (n > b->total - pos)
+      {
+         n = (size_t)(b->total - pos);
+      }
+      if (n > 0)
+      {
+         memcpy(span, b->source, n);
+         hrmp_ringbuffer_produce(b->rb, n);
+      }
+
+      if (b->lock != NULL)
+      {
+         pthread_mutex_unlock(b->lock);
+      }
+
+      if (n == 0)
+      {
+         sched_yield();
+      }
+      pos += n;
+   }
+
+   return NULL;
+}
+
+static void*
+consumer(void* arg)
+{
+   struct bench* b = (struct bench*)arg;
+   uint64_t pos = 0;
+   void* span = NULL;
+   size_t n;
+
+   while (pos < b->total)
+   {
+      if (b->lock != NULL)
+      {
+         pthread_mutex_lock(b->lock);
+      }
+
+      n = hrmp_ringbuffer_peek(b->rb, &span);
+      n = n < b->span ? n : b->span;
+      if (n > 0)
+      {
+         memcpy(b->sink, span, n);
+         hrmp_ringbuffer_consume(b->rb, n);
+      }
+
+      if (b->lock != NULL)
+      {
+         pthread_mutex_unlock(b->lock);
+      }
+
+      if (n == 0)
+      {
+         sched_yield();
+      }
+      pos += n;
+   }
+
+   return NULL;
+}
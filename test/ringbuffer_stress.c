@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2026 The HighResMusicPlayer community
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* hrmp */
+#include <ringbuffer.h>
+
+/* system */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A producer and a consumer thread share a ringbuffer in SPSC mode with
+ * random span sizes. Every byte is checked against its stream position,
+ * and the producer grows the ringbuffer on the way while the consumer keeps
+ * reading. Outside SPSC mode a ringbuffer whose content wraps is grown as
+ * well, by less and by more than the wrapped part */
+
+#define STRESS_BYTES ((uint64_t)1024 * 1024 * 1024)
+#define STRESS_GROWS 3
+
+struct stress
+{
+   struct ringbuffer* rb;
+   uint64_t total;
+   size_t max;
+   int grows;
+   atomic_int errors;
+};
+
+static void* producer(void* arg);
+static void* consumer(void* arg);
+static uint64_t next(uint64_t* state);
+static uint8_t pattern(uint64_t pos);
+static int run(int flags, const char* name, uint64_t total);
+static int wrapped(int flags, const char* name, size_t max);
+static size_t fill(struct ringbuffer* rb, uint64_t* pos, size_t n);
+static size_t check(struct ringbuffer* rb, uint64_t* pos, size_t n);
+
+int
+main(int argc, char** argv)
+{
+   uint64_t total = STRESS_BYTES;
+   int errors = 0;
+
+   if (argc > 1)
+   {
+      total = strtoull(argv[1], NULL, 10) * 1024 * 1024;
+   }
+
+   errors += run(HRMP_RINGBUFFER_FLAG_NONE, "regular", total);
+   errors += run(HRMP_RINGBUFFER_FLAG_MIRROR, "mirrored", total);
+   errors += run(HRMP_RINGBUFFER_FLAG_MIRROR | HRMP_RINGBUFFER_FLAG_PREFAULT, "mirrored prefault", total);
+
+   for (int mirror = 0; mirror < 2; mirror++)
+   {
+      int flags = mirror ? HRMP_RINGBUFFER_FLAG_MIRROR : HRMP_RINGBUFFER_FLAG_NONE;
+      const char* name = mirror ? "mirrored wrapped" : "regular wrapped";
+
+      errors += wrapped(flags, name, 2 * HRMP_RINGBUFFER_MIN_BYTES);
+      errors += wrapped(flags, name, HRMP_RINGBUFFER_MIN_BYTES + HRMP_RINGBUFFER_CHUNK_BYTES);
+   }
+
+   return errors == 0 ? 0 : 1;
+}
+
+static int
+run(int flags, const char* name, uint64_t total)
+{
+   struct stress s = {0};
+   pthread_t p;
+   pthread_t c;
+
+   s.total = total;
+   s.max = (size_t)HRMP_RINGBUFFER_MIN_BYTES << STRESS_GROWS;
+
+   if (hrmp_ringbuffer_create(HRMP_RINGBUFFER_MIN_BYTES, HRMP_RINGBUFFER_MIN_BYTES, s.max, flags, &s.rb))
+   {
+      printf("%s: create failed\n", name);
+      return 1;
+   }
+
+   hrmp_ringbuffer_set_spsc(s.rb, true);
+
+   pthread_create(&c, NULL, consumer, &s);
+   pthread_create(&p, NULL, producer, &s);
+   pthread_join(p, NULL);
+   pthread_join(c, NULL);
+
+   printf("%s (%s): %llu MiB, %d grows to %zu bytes, %d errors\n", name,
+          hrmp_ringbuffer_backing_name(s.rb), (unsigned long long)(total >> 20),
+          s.grows, hrmp_ringbuffer_capacity(s.rb), atomic_load(&s.errors));
+
+   hrmp_ringbuffer_destroy(s.rb);
+
+   return s.grows == STRESS_GROWS && atomic_load(&s.errors) == 0 ? 0 : 1;
+}
+
+static int
+wrapped(int flags, const char* name, size_t max)
+{
+   struct ringbuffer* rb = NULL;
+   size_t cap = HRMP_RINGBUFFER_MIN_BYTES;
+   size_t start = 3 * cap / 4;
+   uint64_t in = 0;
+   uint64_t out = 0;
+   int errors = 0;
+
+   if (hrmp_ringbuffer_create(cap, cap, max, flags, &rb))
+   {
+      printf("%s: create failed\n", name);
+      return 1;
+   }
+
+   /* Full, with the last three quarters at the start of the storage */
+   if (fill(rb, &in, start) != start || check(rb, &out, start) != start || fill(rb, &in, cap) != cap)
+   {
+      printf("%s: fill failed\n", name);
+      errors++;
+   }
+   else if (hrmp_ringbuffer_ensure_write(rb, max - cap) || hrmp_ringbuffer_capacity(rb) != max)
+   {
+      printf("%s: grow to %zu failed with wrapped content\n", name, max);
+      errors++;
+   }
+   else if (fill(rb, &in, max - cap) != max - cap || check(rb, &out, max) != max)
+   {
+      printf("%s: content differs after growing to %zu\n", name, max);
+      errors++;
+   }
+
+   printf("%s: grow by %zu bytes with %zu wrapped, %d errors\n", name, max - cap, start, errors);
+
+   hrmp_ringbuffer_destroy(rb);
+
+   return errors;
+}
+
+/* Write the stream from pos on, as far as there is room */
+static size_t
+fill(struct ringbuffer* rb, uint64_t* pos, size_t n)
+{
+   size_t done = 0;
+   void* span = NULL;
+   size_t k;
+
+   while (done < n && (k = hrmp_ringbuffer_get_write_span(rb, &span)) > 0)
+   {
+      k = k < n - done ? k : n - done;
+      for (size_t i = 0; i < k; i++)
+      {
+         ((uint8_t*)span)[i] = pattern(*pos + i);
+      }
+      hrmp_ringbuffer_produce(rb, k);
+      *pos += k;
+      done += k;
+   }
+
+   return done;
+}
+
+/* Read and check the stream from pos on, up to the first bad byte */
+static size_t
+check(struct ringbuffer* rb, uint64_t* pos, size_t n)
+{
+   size_t done = 0;
+   void* span = NULL;
+   size_t k;
+
+   while (done < n && (k = hrmp_ringbuffer_peek(rb, &span)) > 0)
+   {
+      k = k < n - done ? k : n - done;
+      for (size_t i = 0; i < k; i++)
+      {
+         if (((uint8_t*)span)[i] != pattern(*pos + i))
+         {
+            return done + i;
+         }
+      }
+      hrmp_ringbuffer_consume(rb, k);
+      *pos += k;
+      done += k;
+   }
+
+   return done;
+}
+
+static void*
+producer(void* arg)
+{
+   struct stress* s = (struct stress*)arg;
+   uint64_t state = 0x9E3779B97F4A7C15ull;
+   uint64_t pos = 0;
+   uint64_t step = s->total / (STRESS_GROWS + 1);
+   void* span = NULL;
+   size_t limit;
+   size_t n;
+
+   while (pos < s->total && atomic_load(&s->errors) == 0)
+   {
+      if (s->grows < STRESS_GROWS && pos >= step * (uint64_t)(s->grows + 1))
+      {
+         /* Growing only works once the consumer has drained the
+          * ringbuffer, and must then succeed */
+         size_t want = 2 * hrmp_ringbuffer_capacity(s->rb);
+
+         while (hrmp_ringbuffer_size(s->rb) > 0 && atomic_load(&s->errors) == 0)
+         {
+            sched_yield();
+         }
+
+         if (hrmp_ringbuffer_ensure_write(s->rb, want) || hrmp_ringbuffer_capacity(s->rb) != want)
+         {
+            printf("grow to %zu failed on an empty ringbuffer\n", want);
+            atomic_fetch_add(&s->errors, 1);
+            break;
+         }
+         s->grows++;
+      }
+
+      n = hrmp_ringbuffer_get_write_span(s->rb, &span);
+      if (n == 0)
+      {
+         sched_yield();
+         continue;
+      }
+
+      limit = 1 + next(&state) % 65536;
+      n = n < limit ? n : limit;
+      if (n > s->total - pos)
+      {
+         n = (size_t)(s->total - pos);
+      }
+
+      for (size_t i = 0; i < n; i++)
+      {
+         ((uint8_t*)span)[i] = pattern(pos + i);
+      }
+
+      if (hrmp_ringbuffer_produce(s->rb, n))
+      {
+         printf("produce %zu failed at %llu\n", n, (unsigned long long)pos);
+         atomic_fetch_add(&s->errors, 1);
+         break;
+      }
+      pos += n;
+   }
+
+   return NULL;
+}
+
+static void*
+consumer(void* arg)
+{
+   struct stress* s = (struct stress*)arg;
+   uint64_t state = 0xD1B54A32D192ED03ull;
+   uint64_t pos = 0;
+   void* span = NULL;
+   size_t limit;
+   size_t n;
+
+   while (pos < s->total && atomic_load(&s->errors) == 0)
+   {
+      n = hrmp_ringbuffer_peek(s->rb, &span);
+      if (n == 0)
+      {
+         sched_yield();
+         continue;
+      }
+
+      limit = 1 + next(&state) % 65536;
+      n = n < limit ? n : limit;
+
+      for (size_t i = 0; i < n; i++)
+      {
+         if (((uint8_t*)span)[i] != pattern(pos + i))
+         {
+            printf("corrupt byte at %llu\n", (unsigned long long)(pos + i));
+            atomic_fetch_add(&s->errors, 1);
+            return NULL;
+         }
+      }
+
+      hrmp_ringbuffer_consume(s->rb, n);
+      pos += n;
+   }
+
+   return NULL;
+}
+
+static uint64_t
+next(uint64_t* state)
+{
+   *state ^= *state << 13;
+   *state ^= *state >> 7;
+   *state ^= *state << 17;
+
+   return *state;
+}
+
+static uint8_t
+pattern(uint64_t pos)
+{
+   return (uint8_t)(pos ^ (pos >> 11) ^ (pos >> 23));
+}